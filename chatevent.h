@@ -0,0 +1,92 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef CHATEVENT_H
+#define CHATEVENT_H
+
+#include <QDeadlineTimer>
+#include <QString>
+#include <QVector>
+
+// Пользователь из списка, который сервер присылает при авторизации
+struct ChatUser
+{
+    int userId;
+    QString userName;
+    int gender;
+    QString userColor;
+};
+
+// Событие, полученное от сервера и уже разобранное сетевым потоком
+struct ChatEvent
+{
+    enum Type {
+        Unknown,
+        Ping,
+        Authorized,
+        Connected,
+        Disconnected,
+        ConnectionLost,
+        PublicMessage,
+        PrivateMessage,
+        Resynced,
+        TypeCount
+    };
+
+    ChatEvent() :
+        type(Unknown),
+        userId(0),
+        gender(0),
+        sequence(0),
+        received(0),
+        traceId(0)
+    {
+    }
+
+    // Монотонное время в мкс, одно для всех потоков:
+    // по нему считается, сколько событие шло до GUI
+    static qint64 now()
+    {
+        return QDeadlineTimer::current(Qt::PreciseTimer).deadlineNSecs() / 1000;
+    }
+
+    Type type;
+    int userId;
+    QString userName;
+    int gender;
+    QString userColor;
+    QString text;
+    QVector<ChatUser> users; // только для Authorized
+
+    // Номер события в журнале сервера, 0 - событие без номера.
+    // В Authorized и Resynced - номер последнего события на момент ответа.
+    quint64 sequence;
+    qint64 received; // когда кадр пришёл из сокета, мкс по now()
+    quint64 traceId; // номер кадра, единый на процесс: связывает стадии в трассировке
+};
+
+#endif // CHATEVENT_H
@@ -0,0 +1,634 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "connectionworker.h"
+
+#include "protocol.h"
+#include "trace.h"
+
+#include <QDebug>
+#include <QRandomGenerator>
+#include <QTimer>
+#include <QUrlQuery>
+#include <QWebSocket>
+#include <QtEndian>
+
+ConnectionWorker::ConnectionWorker(QObject *parent) :
+    QObject(parent),
+    m_webSocket(nullptr),
+    m_pingTimer(new QTimer(this)),
+    m_backlogTimer(new QTimer(this)),
+    m_reconnectTimer(new QTimer(this)),
+    m_autoReconnect(false),
+    m_attempt(0),
+    m_baseDelay(1000),
+    m_maxDelay(60 * 1000),
+    m_sequence(0),
+    m_requestedFormat(Protocol::JsonFormat),
+    m_wireFormat(Protocol::JsonFormat),
+    m_online(false),
+    m_bytesInFlight(0),
+    m_highWaterMark(256 * 1024),
+    m_notified(0),
+    m_replayPending(false),
+    m_replaySpeed(1.0),
+    m_replayFrames(0),
+    m_replayTimer(new QTimer(this))
+{
+    // Таймер для пингования сервера, чтобы указать, что соединение все еще живо
+    connect(m_pingTimer, &QTimer::timeout,
+            this, &ConnectionWorker::ping);
+
+    // Если GUI не успевает вычитывать очередь, повторяем попытку чуть позже
+    m_backlogTimer->setSingleShot(true);
+    m_backlogTimer->setInterval(1);
+    connect(m_backlogTimer, &QTimer::timeout,
+            this, &ConnectionWorker::flushBacklog);
+
+    m_reconnectTimer->setSingleShot(true);
+    connect(m_reconnectTimer, &QTimer::timeout,
+            this, &ConnectionWorker::startAttempt);
+
+    m_replayTimer->setSingleShot(true);
+    m_replayTimer->setTimerType(Qt::PreciseTimer);
+    connect(m_replayTimer, &QTimer::timeout,
+            this, &ConnectionWorker::replayTick);
+}
+
+SpscQueue<ChatEvent> *ConnectionWorker::events()
+{
+    return &m_events;
+}
+
+void ConnectionWorker::acknowledgeEvents()
+{
+    m_notified.storeRelease(0);
+}
+
+void ConnectionWorker::open(const QStringList &urls)
+{
+    m_endpoints = urls;
+    m_autoReconnect = true;
+    m_attempt = 0;
+    m_sequence = 0;
+    m_reconnectTimer->stop();
+
+    startAttempt();
+}
+
+void ConnectionWorker::announce()
+{
+    emit announced(m_online, m_online ? m_webSocket->requestUrl().toString() : QString());
+
+    if (!m_events.isEmpty() || !m_backlog.isEmpty()) {
+        m_notified.storeRelease(1);
+        emit eventsAvailable();
+    }
+}
+
+void ConnectionWorker::close()
+{
+    // После close() обработчик молчит: ни таймеров, ни воспроизведения,
+    // ни сигналов сокета - сессия, которой он принадлежал, может быть
+    // уже удалена, а сетевой поток продолжает работать
+    m_autoReconnect = false;
+    m_reconnectTimer->stop();
+    m_pingTimer->stop();
+    m_backlogTimer->stop();
+    m_replayTimer->stop();
+    m_replay.close();
+    m_replayPending = false;
+    m_backlog.clear();
+    abortCandidates();
+
+    if (m_webSocket) {
+        disconnect(m_webSocket, nullptr, this, nullptr);
+        m_webSocket->close();
+        m_webSocket->deleteLater();
+        m_webSocket = nullptr;
+    }
+    m_online = false;
+}
+
+void ConnectionWorker::setReconnectDelays(int baseDelay, int maxDelay)
+{
+    m_baseDelay = qMax(100, baseDelay);
+    m_maxDelay = qMax(m_baseDelay, maxDelay);
+}
+
+void ConnectionWorker::startRecording(const QString &path)
+{
+    if (!m_recorder.open(path)) {
+        emit captureFailed(m_recorder.errorString());
+    }
+}
+
+void ConnectionWorker::replay(const QString &path, double speed)
+{
+    // Воспроизведение идёт вместо сети
+    close();
+
+    if (!m_replay.open(path)) {
+        emit captureFailed(m_replay.errorString());
+        return;
+    }
+
+    m_replayPending = false;
+    m_replaySpeed = qMax(0.0, speed);
+    m_replayFrames = 0;
+    m_replayClock.start();
+
+    replayTick();
+}
+
+void ConnectionWorker::replayTick()
+{
+    // Без ограничения скорости кадры отдаются порциями, пока очередь
+    // в GUI их принимает: скорость воспроизведения равна скорости GUI
+    static const qint64 ReplaySliceBudget = 8; // мс
+
+    QElapsedTimer budget;
+    budget.start();
+
+    while (m_replayPending || m_replay.next(m_replayFrame)) {
+        m_replayPending = true;
+
+        if (m_replayFrame.flags & CaptureWriter::Outgoing) {
+            // Свои кадры не отправляем: сети нет, а ответы сервера уже в записи
+            m_replayPending = false;
+            continue;
+        }
+
+        // GUI не успевает и очередь к нему переполнилась: при любой скорости
+        // следующий кадр ждёт, пока отложенное не уйдёт в очередь, иначе
+        // оно копится без предела и замер показывает рост отставания
+        if (!m_backlog.isEmpty()) {
+            m_replayTimer->start(1);
+            return;
+        }
+
+        if (m_replaySpeed > 0) {
+            qint64 due = qint64(m_replayFrame.time / m_replaySpeed);
+            qint64 now = m_replayClock.nsecsElapsed() / 1000;
+            if (due > now) {
+                // Вверх до миллисекунды: меньше неё таймер крутился бы по 0 мс
+                m_replayTimer->start(int((due - now + 999) / 1000));
+                return;
+            }
+        }
+        else if (budget.elapsed() >= ReplaySliceBudget) {
+            m_replayTimer->start(0);
+            return;
+        }
+
+        m_replayPending = false;
+        m_replayFrames++;
+
+        if (m_replayFrame.flags & CaptureWriter::Binary) {
+            onBinaryMessageReceived(m_replayFrame.data);
+        }
+        else {
+            onTextMessageReceived(QString::fromUtf8(m_replayFrame.data));
+        }
+    }
+
+    // Конец записи: ждём, пока GUI заберёт отложенные события
+    if (!m_backlog.isEmpty()) {
+        m_replayTimer->start(1);
+        return;
+    }
+
+    m_replay.close();
+    emit replayFinished(m_replayFrames, m_replayClock.elapsed());
+}
+
+void ConnectionWorker::startAttempt()
+{
+    abortCandidates();
+
+    // Ко всем адресам подключаемся одновременно
+    foreach (const QString &endpoint, m_endpoints) {
+        QWebSocket *candidate = new QWebSocket(QString("SimpleChatClient"),
+                                               QWebSocketProtocol::Version13,
+                                               this);
+        connect(candidate, &QWebSocket::connected,
+                this, &ConnectionWorker::onCandidateConnected);
+        connect(candidate, &QWebSocket::disconnected,
+                this, &ConnectionWorker::onCandidateFailed);
+        connect(candidate, SIGNAL(error(QAbstractSocket::SocketError)),
+                this, SLOT(onCandidateFailed()));
+
+        m_candidates.append(candidate);
+        candidate->open(resumeUrl(endpoint));
+    }
+}
+
+QUrl ConnectionWorker::resumeUrl(const QString &endpoint) const
+{
+    QUrl url(endpoint);
+    if (m_sequence == 0) {
+        return url;
+    }
+
+    // Сервер продолжит с события после since, если ещё помнит его,
+    // иначе ответит полным Authorized
+    QString query = url.query(QUrl::FullyEncoded);
+    if (!query.isEmpty()) {
+        query += '&';
+    }
+    url.setQuery(query + QString("since=%1").arg(m_sequence));
+    return url;
+}
+
+void ConnectionWorker::onCandidateConnected()
+{
+    QWebSocket *winner = qobject_cast<QWebSocket *>(sender());
+    if (!winner || !m_candidates.removeOne(winner)) {
+        return;
+    }
+
+    // Первое завершившее рукопожатие соединение остаётся, остальные закрываем
+    abortCandidates();
+    disconnect(winner, nullptr, this, nullptr);
+    attachSocket(winner);
+
+    onConnected();
+}
+
+void ConnectionWorker::onCandidateFailed()
+{
+    QWebSocket *candidate = qobject_cast<QWebSocket *>(sender());
+    if (!candidate || !m_candidates.removeOne(candidate)) {
+        return;
+    }
+
+    emit error(candidate->error(), candidate->errorString());
+
+    disconnect(candidate, nullptr, this, nullptr);
+    candidate->deleteLater();
+
+    // Не удалось ни одно подключение раунда - ждём и пробуем снова
+    if (m_candidates.isEmpty()) {
+        scheduleReconnect();
+    }
+}
+
+void ConnectionWorker::ping()
+{
+    // Время отправки уходит в полезной нагрузке и возвращается в pong,
+    // поэтому задержку считаем точнее, чем миллисекунды из сигнала
+    if (m_webSocket) {
+        QByteArray payload(sizeof(qint64), Qt::Uninitialized);
+        qToLittleEndian<qint64>(ChatEvent::now(), payload.data());
+        m_webSocket->ping(payload);
+    }
+}
+
+void ConnectionWorker::onPong(quint64 elapsedTime, const QByteArray &payload)
+{
+    if (payload.size() == int(sizeof(qint64))) {
+        emit networkRttSampled(ChatEvent::now() - qFromLittleEndian<qint64>(payload.constData()));
+    }
+    else {
+        emit networkRttSampled(qint64(elapsedTime) * 1000);
+    }
+}
+
+void ConnectionWorker::attachSocket(QWebSocket *webSocket)
+{
+    if (m_webSocket) {
+        disconnect(m_webSocket, nullptr, this, nullptr);
+        m_webSocket->deleteLater();
+    }
+
+    m_webSocket = webSocket;
+
+    m_requestedFormat = QUrlQuery(m_webSocket->requestUrl()).queryItemValue("format") == "cbor"
+            ? Protocol::CborFormat
+            : Protocol::JsonFormat;
+    m_wireFormat = Protocol::JsonFormat;
+
+    connect(m_webSocket, &QWebSocket::disconnected,
+            this, &ConnectionWorker::onDisconnected);
+    connect(m_webSocket, SIGNAL(error(QAbstractSocket::SocketError)),
+            this, SLOT(onError(QAbstractSocket::SocketError)));
+    connect(m_webSocket, &QWebSocket::textMessageReceived,
+            this, &ConnectionWorker::onTextMessageReceived);
+    connect(m_webSocket, &QWebSocket::binaryMessageReceived,
+            this, &ConnectionWorker::onBinaryMessageReceived);
+    connect(m_webSocket, &QWebSocket::bytesWritten,
+            this, &ConnectionWorker::onBytesWritten);
+    connect(m_webSocket, &QWebSocket::pong,
+            this, &ConnectionWorker::onPong);
+}
+
+void ConnectionWorker::abortCandidates()
+{
+    foreach (QWebSocket *candidate, m_candidates) {
+        disconnect(candidate, nullptr, this, nullptr);
+        candidate->abort();
+        candidate->deleteLater();
+    }
+    m_candidates.clear();
+}
+
+void ConnectionWorker::scheduleReconnect()
+{
+    if (!m_autoReconnect) {
+        return;
+    }
+
+    if (!m_downtime.isValid()) {
+        m_downtime.start();
+    }
+
+    // Экспоненциальная пауза с разбросом в пределах её второй половины,
+    // чтобы после перезапуска сервера клиенты не приходили все разом
+    qint64 delay = qint64(m_baseDelay) << qMin(m_attempt, 16);
+    delay = qMin(delay, qint64(m_maxDelay));
+    delay = delay / 2 + QRandomGenerator::global()->bounded(int(delay / 2) + 1);
+
+    m_attempt++;
+    m_reconnectTimer->start(int(delay));
+
+    emit reconnectScheduled(int(delay), m_attempt);
+}
+
+void ConnectionWorker::sendMessage(int toUserId, const QString &text)
+{
+    OutgoingMessage message;
+    message.kind = OutgoingMessage::Chat;
+    message.toUserId = toUserId;
+    message.text = text;
+    message.queued = ChatEvent::now();
+
+    TRACE_SCOPE("enqueue", "network");
+    enqueue(message);
+}
+
+void ConnectionWorker::setSendHighWaterMark(qint64 bytes)
+{
+    m_highWaterMark = qMax(qint64(1024), bytes);
+    pumpSendQueue();
+}
+
+void ConnectionWorker::onConnected()
+{
+    m_pingTimer->start(15 * 1000); // пингуем сервер каждые 15 сек
+    m_online = true;
+    m_bytesInFlight = 0;
+    m_attempt = 0;
+    emit connected(m_webSocket->requestUrl().toString());
+
+    if (m_downtime.isValid()) {
+        emit reconnected(m_downtime.elapsed());
+        m_downtime.invalidate();
+    }
+
+    // Отправляем сообщения, набранные, пока соединения не было
+    pumpSendQueue();
+}
+
+void ConnectionWorker::onDisconnected()
+{
+    m_pingTimer->stop();
+    m_online = false;
+    m_sendQueue.dropControl();
+    emit disconnected();
+    emit sendQueueChanged(m_sendQueue.depth(), 0);
+
+    m_downtime.start();
+    scheduleReconnect();
+}
+
+void ConnectionWorker::onError(QAbstractSocket::SocketError error)
+{
+    m_pingTimer->stop();
+    m_online = false;
+    m_sendQueue.dropControl();
+    emit this->error(error, m_webSocket->errorString());
+}
+
+void ConnectionWorker::onTextMessageReceived(const QString &message)
+{
+    ChatEvent event;
+    event.received = ChatEvent::now();
+    event.traceId = Trace::nextId();
+    TRACE_SCOPE_ID("frame", "network", event.traceId);
+
+    if (m_recorder.isOpen()) {
+        m_recorder.write(event.received, 0, message.toUtf8());
+    }
+
+    bool decoded;
+    {
+        TRACE_SCOPE("decode json", "network");
+        decoded = Protocol::decode(message, event);
+    }
+
+    if (!decoded) {
+        qWarning() << "malformed frame: " << message.left(128);
+        return;
+    }
+
+    handleEvent(event);
+}
+
+void ConnectionWorker::onBinaryMessageReceived(const QByteArray &message)
+{
+    ChatEvent event;
+    event.received = ChatEvent::now();
+    event.traceId = Trace::nextId();
+    TRACE_SCOPE_ID("frame", "network", event.traceId);
+
+    if (m_recorder.isOpen()) {
+        m_recorder.write(event.received, CaptureWriter::Binary, message);
+    }
+
+    bool decoded;
+    {
+        TRACE_SCOPE("decode cbor", "network");
+        decoded = Protocol::decode(message, event);
+    }
+
+    if (!decoded) {
+        qWarning() << "malformed binary frame of" << message.size() << "bytes";
+        return;
+    }
+
+    // Сервер согласился на CBOR - дальше отвечаем ему тем же
+    if (m_requestedFormat == Protocol::CborFormat) {
+        m_wireFormat = Protocol::CborFormat;
+    }
+
+    handleEvent(event);
+}
+
+void ConnectionWorker::handleEvent(const ChatEvent &event)
+{
+    switch (event.type) {
+    case ChatEvent::Ping:
+        // В ответ на "Ping" клиент должен послать действие "Pong",
+        // чтобы сервер понял, что клиент в онлайне
+        sendPong(event.received);
+        break;
+
+    case ChatEvent::Unknown:
+        // неизвестное действие
+        qWarning() << "unknown action: " << event.text;
+        break;
+
+    case ChatEvent::Authorized:
+        // Полный снимок: отсчёт начинается заново с его номера
+        m_sequence = event.sequence;
+        publish(event);
+        break;
+
+    case ChatEvent::Resynced:
+        // Номер в Resynced - последний на сервере, а пропущенные события
+        // ещё только идут следом. Если догон оборвётся, продолжать надо
+        // с последнего полученного, иначе остаток потеряется
+        publish(event);
+        break;
+
+    default:
+        // Пропущенные события идут после Resynced с меньшими номерами
+        m_sequence = qMax(m_sequence, event.sequence);
+        publish(event);
+        break;
+    }
+}
+
+void ConnectionWorker::flushBacklog()
+{
+    int published = 0;
+    while (published < m_backlog.size() && m_events.push(m_backlog.at(published))) {
+        published++;
+    }
+    m_backlog.remove(0, published);
+
+    if (published > 0 && m_notified.testAndSetOrdered(0, 1)) {
+        emit eventsAvailable();
+    }
+
+    if (!m_backlog.isEmpty()) {
+        m_backlogTimer->start();
+    }
+}
+
+void ConnectionWorker::onBytesWritten(qint64 bytes)
+{
+    // В bytesWritten входят и заголовки кадров, поэтому не уходим ниже нуля
+    m_bytesInFlight = qMax(qint64(0), m_bytesInFlight - bytes);
+    pumpSendQueue();
+}
+
+void ConnectionWorker::sendPong(qint64 pingReceived)
+{
+    OutgoingMessage message;
+    message.kind = OutgoingMessage::Pong;
+    message.toUserId = 0;
+    message.queued = pingReceived;
+
+    enqueue(message);
+}
+
+void ConnectionWorker::enqueue(const OutgoingMessage &message)
+{
+    // Без соединения Pong никому не нужен, а сообщения чата ждут переподключения
+    if (!m_online && message.kind != OutgoingMessage::Chat) {
+        return;
+    }
+
+    m_sendQueue.enqueue(message);
+    pumpSendQueue();
+}
+
+void ConnectionWorker::pumpSendQueue()
+{
+    if (m_online) {
+        OutgoingMessage message;
+        while (m_sendQueue.takeNext(message, m_bytesInFlight < m_highWaterMark)) {
+            TRACE_SCOPE("send frame", "network");
+            if (message.kind == OutgoingMessage::Pong) {
+                sendFrame(Protocol::encodePong(m_wireFormat));
+                emit pingResponseSampled(ChatEvent::now() - message.queued);
+            }
+            else {
+                QByteArray frame;
+                {
+                    TRACE_SCOPE("encode", "network");
+                    frame = Protocol::encodeMessage(message.toUserId,
+                                                    message.text,
+                                                    m_wireFormat);
+                }
+                sendFrame(frame);
+            }
+        }
+    }
+
+    emit sendQueueChanged(m_sendQueue.depth(), m_bytesInFlight);
+}
+
+void ConnectionWorker::sendFrame(const QByteArray &frame)
+{
+    TRACE_SCOPE("socket write", "network");
+
+    if (m_recorder.isOpen()) {
+        int flags = CaptureWriter::Outgoing;
+        if (m_wireFormat == Protocol::CborFormat) {
+            flags |= CaptureWriter::Binary;
+        }
+        m_recorder.write(ChatEvent::now(), flags, frame);
+    }
+
+    if (m_wireFormat == Protocol::CborFormat) {
+        m_bytesInFlight += m_webSocket->sendBinaryMessage(frame);
+    }
+    else {
+        m_bytesInFlight += m_webSocket->sendTextMessage(QString::fromUtf8(frame));
+    }
+}
+
+void ConnectionWorker::publish(const ChatEvent &event)
+{
+    TRACE_FLOW_START("event", event.traceId);
+
+    // Порядок событий сохраняется: пока есть отложенные, новые встают за ними
+    if (!m_backlog.isEmpty() || !m_events.push(event)) {
+        m_backlog.append(event);
+        if (!m_backlogTimer->isActive()) {
+            m_backlogTimer->start();
+        }
+        return;
+    }
+
+    // Сигнал отправляется один раз, пока GUI не вычитает очередь
+    if (m_notified.testAndSetOrdered(0, 1)) {
+        emit eventsAvailable();
+    }
+}
@@ -0,0 +1,179 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef CONNECTIONWORKER_H
+#define CONNECTIONWORKER_H
+
+#include <QObject>
+#include <QAbstractSocket>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QList>
+#include <QStringList>
+#include <QUrl>
+#include <QVector>
+
+#include "chatevent.h"
+#include "framecapture.h"
+#include "protocol.h"
+#include "sendqueue.h"
+#include "spscqueue.h"
+
+class QWebSocket;
+class QTimer;
+
+// Соединение с сервером, живущее в отдельном потоке.
+// Владеет websocket-клиентом, сам отвечает на Ping и пингует сервер,
+// а разобранные события передаёт GUI-потоку через очередь без блокировок.
+// Поэтому пульс соединения не останавливается, даже если интерфейс занят.
+//
+// Здесь же работает автоматическое переподключение: после разрыва попытки
+// повторяются с экспоненциально растущей паузой со случайным разбросом,
+// а если адресов сервера несколько, к ним подключаемся одновременно
+// и оставляем то соединение, которое первым завершило рукопожатие.
+// При переподключении серверу передаётся номер последнего полученного
+// события, чтобы он прислал только пропущенное, а не всё состояние.
+//
+// Кадры соединения можно записывать в файл, а записанные - воспроизводить
+// вместо сети: они проходят тот же разбор и ту же очередь в GUI.
+class ConnectionWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ConnectionWorker(QObject *parent = nullptr);
+
+    // Очередь событий для GUI. Принадлежит обработчику и живёт, пока он
+    // не удалён в сетевом потоке, поэтому закрытая вкладка может отдать
+    // обработчик deleteLater() и больше не трогать очередь.
+    SpscQueue<ChatEvent> *events();
+
+    // Вызывается потребителем перед тем, как вычитать очередь.
+    // После этого следующее событие снова пришлёт eventsAvailable().
+    void acknowledgeEvents();
+
+public slots:
+    void open(const QStringList &urls);
+    void close();
+
+    // Для сессии, подключившейся к уже запущенному обработчику (быстрый
+    // старт открывает соединение до построения окна): сообщает текущее
+    // состояние и будит чтение очереди, если события уже пришли
+    void announce();
+    void setReconnectDelays(int baseDelay, int maxDelay);
+    void sendMessage(int toUserId, const QString &text);
+    void setSendHighWaterMark(qint64 bytes);
+
+    void startRecording(const QString &path);
+
+    // speed - во сколько раз быстрее записи, 0 - так быстро, как успевает GUI
+    void replay(const QString &path, double speed);
+
+signals:
+    void connected(const QString &url);
+    void announced(bool online, const QString &url);
+    void disconnected();
+    void reconnectScheduled(int delay, int attempt);
+    void reconnected(qint64 elapsed);
+    void error(int error, const QString &errorString);
+    void eventsAvailable();
+    void sendQueueChanged(int depth, qint64 bytesInFlight);
+    void captureFailed(const QString &errorString);
+    void replayFinished(qint64 frames, qint64 elapsed); // кадров, мс
+
+    // Замеры задержек, мкс: круговая задержка управляющего ping/pong
+    // websocket и время от прихода Ping сервера до отправки Pong
+    void networkRttSampled(qint64 rtt);
+    void pingResponseSampled(qint64 response);
+
+private slots:
+    void startAttempt();
+    void onCandidateConnected();
+    void onCandidateFailed();
+    void ping();
+    void onPong(quint64 elapsedTime, const QByteArray &payload);
+    void onConnected();
+    void onDisconnected();
+    void onError(QAbstractSocket::SocketError error);
+    void onTextMessageReceived(const QString &message);
+    void onBinaryMessageReceived(const QByteArray &message);
+    void flushBacklog();
+    void onBytesWritten(qint64 bytes);
+    void replayTick();
+
+private:
+    void sendPong(qint64 pingReceived);
+    QUrl resumeUrl(const QString &endpoint) const;
+    void attachSocket(QWebSocket *webSocket);
+    void abortCandidates();
+    void scheduleReconnect();
+    void handleEvent(const ChatEvent &event);
+    void publish(const ChatEvent &event);
+    void enqueue(const OutgoingMessage &message);
+    void pumpSendQueue();
+    void sendFrame(const QByteArray &frame);
+
+    QWebSocket *m_webSocket; // установленное соединение
+    QTimer *m_pingTimer;
+    QTimer *m_backlogTimer;
+
+    QStringList m_endpoints; // адреса, к которым подключаемся наперегонки
+    QList<QWebSocket *> m_candidates; // попытки текущего раунда
+    QTimer *m_reconnectTimer;
+    bool m_autoReconnect;
+    int m_attempt; // номер попытки с момента разрыва
+    int m_baseDelay; // первая пауза перед переподключением, мс
+    int m_maxDelay; // предельная пауза, мс
+    QElapsedTimer m_downtime; // время с момента разрыва
+    quint64 m_sequence; // номер последнего события сервера, 0 - нечего продолжать
+
+    // Формат, запрошенный при подключении, и формат, в котором
+    // действительно идёт обмен: CBOR включается после первого
+    // двоичного кадра от сервера, иначе остаётся JSON
+    Protocol::WireFormat m_requestedFormat;
+    Protocol::WireFormat m_wireFormat;
+
+    SendQueue m_sendQueue;
+    bool m_online; // соединение установлено, можно отправлять
+    qint64 m_bytesInFlight; // отправлено, но ещё не записано в сокет
+    qint64 m_highWaterMark; // выше этой отметки сообщения чата ждут
+
+    SpscQueue<ChatEvent> m_events;
+    QVector<ChatEvent> m_backlog; // события, не поместившиеся в очередь
+    QAtomicInt m_notified;
+
+    CaptureWriter m_recorder;
+    CaptureReader m_replay;
+    CaptureReader::Frame m_replayFrame; // прочитан, но ещё не отдан
+    bool m_replayPending;
+    double m_replaySpeed;
+    qint64 m_replayFrames;
+    QElapsedTimer m_replayClock;
+    QTimer *m_replayTimer;
+};
+
+#endif // CONNECTIONWORKER_H
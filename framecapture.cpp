@@ -0,0 +1,194 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "framecapture.h"
+
+#include "chatevent.h"
+
+namespace {
+
+const char Signature[] = "SCCAPTR1";
+const int SignatureSize = 8;
+
+void putVarint(QByteArray &data, quint64 value)
+{
+    while (value >= 0x80) {
+        data.append(char(value | 0x80));
+        value >>= 7;
+    }
+    data.append(char(value));
+}
+
+} // namespace
+
+CaptureWriter::CaptureWriter() :
+    m_lastTime(0),
+    m_frames(0)
+{
+}
+
+bool CaptureWriter::open(const QString &path)
+{
+    close();
+
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+
+    m_file.write(Signature, SignatureSize);
+    m_lastTime = ChatEvent::now();
+    m_frames = 0;
+    return true;
+}
+
+void CaptureWriter::close()
+{
+    if (m_file.isOpen()) {
+        m_file.close();
+    }
+}
+
+bool CaptureWriter::isOpen() const
+{
+    return m_file.isOpen();
+}
+
+QString CaptureWriter::errorString() const
+{
+    return m_file.errorString();
+}
+
+void CaptureWriter::write(qint64 time, int flags, const QByteArray &frame)
+{
+    if (!m_file.isOpen()) {
+        return;
+    }
+
+    // Заголовок записи не длиннее 21 байта, кадр пишется следом без копирования
+    QByteArray header;
+    header.reserve(21);
+    putVarint(header, quint64(qMax(qint64(0), time - m_lastTime)));
+    header.append(char(flags));
+    putVarint(header, quint64(frame.size()));
+
+    m_file.write(header);
+    m_file.write(frame);
+
+    m_lastTime = qMax(m_lastTime, time);
+    m_frames++;
+}
+
+qint64 CaptureWriter::frames() const
+{
+    return m_frames;
+}
+
+CaptureReader::CaptureReader() :
+    m_data(nullptr),
+    m_size(0),
+    m_pos(0),
+    m_time(0)
+{
+}
+
+bool CaptureReader::open(const QString &path)
+{
+    close();
+
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        m_errorString = m_file.errorString();
+        return false;
+    }
+
+    m_size = m_file.size();
+    m_data = m_size > 0 ? m_file.map(0, m_size) : nullptr;
+    if (!m_data || m_size < SignatureSize
+            || qstrncmp(reinterpret_cast<const char *>(m_data), Signature, SignatureSize) != 0) {
+        m_errorString = QString("%1 не является записью кадров").arg(path);
+        close();
+        return false;
+    }
+
+    m_pos = SignatureSize;
+    m_time = 0;
+    return true;
+}
+
+void CaptureReader::close()
+{
+    if (m_data) {
+        m_file.unmap(const_cast<uchar *>(m_data));
+    }
+    m_file.close();
+
+    m_data = nullptr;
+    m_size = 0;
+    m_pos = 0;
+}
+
+QString CaptureReader::errorString() const
+{
+    return m_errorString;
+}
+
+bool CaptureReader::next(Frame &frame)
+{
+    quint64 delta;
+    quint64 length;
+
+    if (!m_data || !readVarint(delta) || m_pos >= m_size) {
+        return false;
+    }
+
+    int flags = m_data[m_pos++];
+    if (!readVarint(length) || length > quint64(m_size - m_pos)) {
+        return false;
+    }
+
+    m_time += qint64(delta);
+
+    frame.time = m_time;
+    frame.flags = flags;
+    frame.data = QByteArray(reinterpret_cast<const char *>(m_data + m_pos), int(length));
+    m_pos += qint64(length);
+    return true;
+}
+
+bool CaptureReader::readVarint(quint64 &value)
+{
+    value = 0;
+    for (int shift = 0; shift < 64 && m_pos < m_size; shift += 7) {
+        uchar byte = m_data[m_pos++];
+        value |= quint64(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
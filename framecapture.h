@@ -0,0 +1,98 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef FRAMECAPTURE_H
+#define FRAMECAPTURE_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+
+// Запись кадров соединения для последующего воспроизведения.
+// Файл начинается с сигнатуры "SCCAPTR1", за ней записи подряд:
+//   время    - varint, мкс от предыдущей записи (первой - от начала записи)
+//   флаги    - байт: Outgoing, Binary
+//   длина    - varint
+//   кадр     - байты кадра как есть, текстовые кадры в UTF-8
+// Время берётся по ChatEvent::now(), поэтому паузы между кадрами
+// воспроизводятся так же, как шли по сети.
+class CaptureWriter
+{
+public:
+    enum Flag {
+        Outgoing = 0x1, // кадр отправлен клиентом
+        Binary = 0x2 // двоичный кадр (CBOR)
+    };
+
+    CaptureWriter();
+
+    bool open(const QString &path);
+    void close();
+    bool isOpen() const;
+    QString errorString() const;
+
+    void write(qint64 time, int flags, const QByteArray &frame);
+    qint64 frames() const;
+
+private:
+    QFile m_file;
+    qint64 m_lastTime; // мкс по ChatEvent::now()
+    qint64 m_frames;
+};
+
+// Чтение записи кадров. Файл отображается в память и читается по порядку.
+class CaptureReader
+{
+public:
+    struct Frame
+    {
+        qint64 time; // мкс от начала записи
+        int flags; // CaptureWriter::Flag
+        QByteArray data;
+    };
+
+    CaptureReader();
+
+    bool open(const QString &path);
+    void close();
+    QString errorString() const;
+
+    // false - записи кончились или дальше файл повреждён
+    bool next(Frame &frame);
+
+private:
+    bool readVarint(quint64 &value);
+
+    QFile m_file;
+    QString m_errorString;
+    const uchar *m_data;
+    qint64 m_size;
+    qint64 m_pos;
+    qint64 m_time;
+};
+
+#endif // FRAMECAPTURE_H
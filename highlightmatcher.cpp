@@ -0,0 +1,303 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "highlightmatcher.h"
+
+#include <QMap>
+#include <QQueue>
+
+namespace {
+
+inline ushort fold(ushort c)
+{
+    return ushort(QChar::toCaseFolded(uint(c)));
+}
+
+inline bool isWordChar(QChar c)
+{
+    return c.isLetterOrNumber() || c == QLatin1Char('_');
+}
+
+} // namespace
+
+HighlightMatcher::HighlightMatcher() :
+    m_startChars(65536 / 64, 0)
+{
+    setPatterns(QStringList());
+}
+
+void HighlightMatcher::setPatterns(const QStringList &patterns)
+{
+    // Автомат перестраивается только при изменении набора слов
+    if (!m_states.isEmpty() && patterns == m_source) {
+        return;
+    }
+    m_source = patterns;
+
+    m_patterns.clear();
+    foreach (const QString &pattern, patterns) {
+        QString trimmed = pattern.trimmed();
+        if (!trimmed.isEmpty() && !m_patterns.contains(trimmed, Qt::CaseInsensitive)) {
+            m_patterns.append(trimmed);
+        }
+    }
+
+    // Бор строится во временных map-переходах, затем упаковывается
+    // в плоские отсортированные массивы для быстрого поиска
+    QVector<QMap<ushort, int> > trie(1);
+    QVector<int> output(1, -1);
+    QVector<int> depth(1, 0);
+
+    for (int i = 0; i < m_patterns.size(); i++) {
+        const QString &pattern = m_patterns.at(i);
+        int state = 0;
+        for (int j = 0; j < pattern.size(); j++) {
+            ushort c = fold(pattern.at(j).unicode());
+            int next = trie[state].value(c, -1);
+            if (next < 0) {
+                next = trie.size();
+                trie[state].insert(c, next);
+                trie.append(QMap<ushort, int>());
+                output.append(-1);
+                depth.append(depth.at(state) + 1);
+            }
+            state = next;
+        }
+        if (output.at(state) < 0) {
+            output[state] = i;
+        }
+    }
+
+    m_states.resize(trie.size());
+    m_edgeChars.clear();
+    m_edgeTargets.clear();
+
+    for (int i = 0; i < trie.size(); i++) {
+        State &state = m_states[i];
+        state.firstEdge = m_edgeChars.size();
+        state.edgeCount = trie.at(i).size();
+        state.fail = 0;
+        state.output = output.at(i);
+        state.outputLink = -1;
+        state.depth = depth.at(i);
+
+        for (auto it = trie.at(i).constBegin(); it != trie.at(i).constEnd(); ++it) {
+            m_edgeChars.append(it.key());
+            m_edgeTargets.append(it.value());
+        }
+    }
+
+    // Ссылки неудач строятся обходом в ширину
+    QQueue<int> queue;
+    for (int e = 0; e < m_states.at(0).edgeCount; e++) {
+        queue.enqueue(m_edgeTargets.at(e));
+    }
+
+    while (!queue.isEmpty()) {
+        int current = queue.dequeue();
+        const State &state = m_states.at(current);
+
+        for (int e = state.firstEdge; e < state.firstEdge + state.edgeCount; e++) {
+            ushort c = m_edgeChars.at(e);
+            int child = m_edgeTargets.at(e);
+
+            int fail = state.fail;
+            while (fail > 0 && transition(fail, c) < 0) {
+                fail = m_states.at(fail).fail;
+            }
+            int target = transition(fail, c);
+            m_states[child].fail = target >= 0 && target != child ? target : 0;
+
+            int link = m_states.at(child).fail;
+            m_states[child].outputLink = m_states.at(link).output >= 0
+                    ? link
+                    : m_states.at(link).outputLink;
+
+            queue.enqueue(child);
+        }
+    }
+
+    // Карта начальных символов в обоих регистрах
+    m_startChars.fill(0);
+    if (m_states.at(0).edgeCount > 0) {
+        for (int u = 0; u < 65536; u++) {
+            if (transition(0, fold(ushort(u))) >= 0) {
+                m_startChars[u >> 6] |= quint64(1) << (u & 63);
+            }
+        }
+    }
+}
+
+QStringList HighlightMatcher::patterns() const
+{
+    return m_patterns;
+}
+
+bool HighlightMatcher::isEmpty() const
+{
+    return m_patterns.isEmpty();
+}
+
+bool HighlightMatcher::matches(const QString &text) const
+{
+    bool found = false;
+    scan(text, [&found](const Match &) {
+        found = true;
+        return false;
+    });
+    return found;
+}
+
+QVector<HighlightMatcher::Match> HighlightMatcher::findAll(const QString &text) const
+{
+    QVector<Match> result;
+    scan(text, [&result](const Match &match) {
+        result.append(match);
+        return true;
+    });
+    return result;
+}
+
+template <typename Callback>
+void HighlightMatcher::scan(const QString &text, Callback callback) const
+{
+    if (m_patterns.isEmpty()) {
+        return;
+    }
+
+    const QChar *begin = text.constData();
+    const QChar *end = begin + text.size();
+    const QChar *p = begin;
+    int state = 0;
+
+    while (p < end) {
+        ushort c = p->unicode();
+
+        // В начальном состоянии быстро проматываем символы,
+        // с которых не начинается ни одно слово
+        if (state == 0) {
+            while (!isStartChar(c) && c != '<' && c != '&') {
+                if (++p == end) {
+                    return;
+                }
+                c = p->unicode();
+            }
+        }
+
+        // Разметка не ищется: теги и сущности прерывают слово
+        if (c == '<') {
+            while (p < end && *p != QLatin1Char('>')) {
+                p++;
+            }
+            if (p < end) {
+                p++;
+            }
+            state = 0;
+            continue;
+        }
+
+        if (c == '&') {
+            // &name; &#NNN; и &#xHHH;
+            const QChar *q = p + 1;
+            if (q < end && *q == QLatin1Char('#')) {
+                q++;
+            }
+            while (q < end && q - p <= 8 && q->isLetterOrNumber()) {
+                q++;
+            }
+            if (q < end && *q == QLatin1Char(';')) {
+                p = q + 1;
+                state = 0;
+                continue;
+            }
+        }
+
+        c = fold(c);
+        int next;
+        while ((next = transition(state, c)) < 0 && state > 0) {
+            state = m_states.at(state).fail;
+        }
+        state = next >= 0 ? next : 0;
+        p++;
+
+        // Все слова, заканчивающиеся здесь: само состояние и цепочка выходов
+        int candidate = m_states.at(state).output >= 0 ? state : m_states.at(state).outputLink;
+        while (candidate >= 0) {
+            const State &found = m_states.at(candidate);
+            int length = found.depth;
+            int position = int(p - begin) - length;
+
+            bool wholeWord = (position == 0 || !isWordChar(begin[position - 1]))
+                    && (p == end || !isWordChar(*p));
+            if (wholeWord) {
+                Match match = { found.output, position, length };
+                if (!callback(match)) {
+                    return;
+                }
+            }
+
+            candidate = found.outputLink;
+        }
+    }
+}
+
+int HighlightMatcher::transition(int state, ushort c) const
+{
+    const State &s = m_states.at(state);
+    const ushort *chars = m_edgeChars.constData() + s.firstEdge;
+
+    // У большинства состояний один-два перехода, у корня - много
+    if (s.edgeCount <= 8) {
+        for (int i = 0; i < s.edgeCount; i++) {
+            if (chars[i] == c) {
+                return m_edgeTargets.at(s.firstEdge + i);
+            }
+        }
+        return -1;
+    }
+
+    int lo = 0;
+    int hi = s.edgeCount - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (chars[mid] == c) {
+            return m_edgeTargets.at(s.firstEdge + mid);
+        }
+        if (chars[mid] < c) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid - 1;
+        }
+    }
+    return -1;
+}
+
+bool HighlightMatcher::isStartChar(ushort c) const
+{
+    return m_startChars.at(c >> 6) & (quint64(1) << (c & 63));
+}
@@ -0,0 +1,88 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef HIGHLIGHTMATCHER_H
+#define HIGHLIGHTMATCHER_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+// Поиск упоминаний и ключевых слов в сообщениях.
+// По набору слов строится автомат Ахо-Корасик, поэтому сообщение
+// просматривается один раз, сколько бы слов ни было задано. Автомат
+// перестраивается только при смене набора слов. Регистр не учитывается,
+// слово должно стоять целиком, а теги и HTML-сущности пропускаются.
+class HighlightMatcher
+{
+public:
+    struct Match
+    {
+        int pattern; // номер слова в наборе
+        int position; // начало в тексте
+        int length;
+    };
+
+    HighlightMatcher();
+
+    void setPatterns(const QStringList &patterns);
+    QStringList patterns() const;
+    bool isEmpty() const;
+
+    bool matches(const QString &text) const;
+    QVector<Match> findAll(const QString &text) const;
+
+private:
+    struct State
+    {
+        int firstEdge; // переходы состояния лежат в m_edgeChars/m_edgeTargets подряд
+        int edgeCount;
+        int fail; // самый длинный собственный суффикс, который тоже есть в автомате
+        int output; // слово, заканчивающееся здесь, или -1
+        int outputLink; // ближайшее по суффиксам состояние со словом или -1
+        int depth;
+    };
+
+    // Обработчик находки возвращает false, чтобы прекратить поиск
+    template <typename Callback>
+    void scan(const QString &text, Callback callback) const;
+
+    int transition(int state, ushort c) const;
+    bool isStartChar(ushort c) const;
+
+    QStringList m_source; // набор слов как он был передан
+    QStringList m_patterns; // без повторов и пустых
+    QVector<State> m_states;
+    QVector<ushort> m_edgeChars; // отсортированы внутри состояния
+    QVector<int> m_edgeTargets;
+
+    // Битовая карта кодов, с которых может начинаться слово: в начальном
+    // состоянии всё остальное пропускается без обращения к автомату
+    QVector<quint64> m_startChars;
+};
+
+#endif // HIGHLIGHTMATCHER_H
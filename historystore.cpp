@@ -0,0 +1,613 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "historystore.h"
+#include "searchindex.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QSet>
+#include <QtEndian>
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// Заголовок записи: размер тела, время, тип, флаги, userId, пол
+const int RecordHeaderSize = 4;
+const int RecordFixedSize = 8 + 1 + 1 + 4 + 1;
+
+// Запись индекса: время, смещение записи в сегменте, её номер
+const int IndexEntrySize = 8 + 4 + 4;
+
+struct IndexEntry
+{
+    qint64 timestamp;
+    quint32 offset;
+    quint32 recordNumber;
+};
+
+// Каталоги истории, занятые сессиями процесса
+QMutex claimedMutex;
+QSet<QString> claimedPaths;
+
+QString indexPath(const QString &segmentPath)
+{
+    QString path = segmentPath;
+    path.replace(path.size() - 4, 4, ".idx");
+    return path;
+}
+
+QVector<IndexEntry> readIndex(const QString &segmentPath)
+{
+    QVector<IndexEntry> entries;
+
+    QFile file(indexPath(segmentPath));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return entries;
+    }
+
+    QByteArray data = file.readAll();
+    const uchar *p = reinterpret_cast<const uchar *>(data.constData());
+    int count = data.size() / IndexEntrySize;
+
+    entries.reserve(count);
+    for (int i = 0; i < count; i++, p += IndexEntrySize) {
+        IndexEntry entry;
+        entry.timestamp = qFromLittleEndian<qint64>(p);
+        entry.offset = qFromLittleEndian<quint32>(p + 8);
+        entry.recordNumber = qFromLittleEndian<quint32>(p + 12);
+        entries.append(entry);
+    }
+
+    return entries;
+}
+
+// Сегмент, отображённый в память только на время чтения
+class MappedSegment
+{
+public:
+    explicit MappedSegment(const QString &path) :
+        m_file(path),
+        m_data(nullptr),
+        m_size(0)
+    {
+        if (m_file.open(QIODevice::ReadOnly) && m_file.size() > 0) {
+            m_size = m_file.size();
+            m_data = m_file.map(0, m_size);
+            if (!m_data) {
+                // Если отобразить не удалось, читаем файл обычным образом
+                m_buffer = m_file.readAll();
+                m_data = reinterpret_cast<uchar *>(m_buffer.data());
+                m_size = m_buffer.size();
+            }
+        }
+    }
+
+    const uchar *data() const { return m_data; }
+    qint64 size() const { return m_size; }
+
+    // Размер записи по смещению или 0, если запись обрезана
+    qint64 recordSizeAt(qint64 offset) const
+    {
+        if (offset + RecordHeaderSize > m_size) {
+            return 0;
+        }
+
+        qint64 size = RecordHeaderSize + qFromLittleEndian<quint32>(m_data + offset);
+        return offset + size <= m_size ? size : 0;
+    }
+
+private:
+    QFile m_file;
+    QByteArray m_buffer;
+    uchar *m_data;
+    qint64 m_size;
+};
+
+void put16(uchar *&p, quint16 value) { qToLittleEndian<quint16>(value, p); p += 2; }
+void put32(uchar *&p, quint32 value) { qToLittleEndian<quint32>(value, p); p += 4; }
+void put64(uchar *&p, qint64 value) { qToLittleEndian<qint64>(value, p); p += 8; }
+
+void putBytes(uchar *&p, const QByteArray &bytes)
+{
+    memcpy(p, bytes.constData(), size_t(bytes.size()));
+    p += bytes.size();
+}
+
+bool takeString(const uchar *&p, const uchar *end, int lengthSize, QString &value)
+{
+    if (end - p < lengthSize) {
+        return false;
+    }
+
+    qint64 length = lengthSize == 2 ? qFromLittleEndian<quint16>(p)
+                                    : qFromLittleEndian<quint32>(p);
+    p += lengthSize;
+
+    if (end - p < length) {
+        return false;
+    }
+
+    value = QString::fromUtf8(reinterpret_cast<const char *>(p), int(length));
+    p += length;
+    return true;
+}
+
+} // namespace
+
+HistoryReader::HistoryReader(const QString &path) :
+    m_path(path)
+{
+}
+
+QStringList HistoryReader::segments() const
+{
+    return QDir(m_path).entryList(QStringList() << "*.seg", QDir::Files, QDir::Name);
+}
+
+QVector<HistoryRecord> HistoryReader::recent(int count) const
+{
+    QVector<HistoryRecord> result;
+    QStringList names = segments();
+
+    // Идём от новых сегментов к старым, пока не наберём нужное число записей
+    for (int i = names.size() - 1; i >= 0 && result.size() < count; i--) {
+        QString path = m_path + "/" + names.at(i);
+
+        int total = recordCount(path);
+        int first = qMax(0, total - (count - result.size()));
+
+        // Ближайшая точка индекса перед первой нужной записью
+        QVector<IndexEntry> index = readIndex(path);
+        qint64 offset = 0;
+        int number = 0;
+        int lo = 0;
+        int hi = index.size() - 1;
+        while (lo <= hi) {
+            int mid = (lo + hi) / 2;
+            if (int(index.at(mid).recordNumber) <= first) {
+                offset = index.at(mid).offset;
+                number = int(index.at(mid).recordNumber);
+                lo = mid + 1;
+            }
+            else {
+                hi = mid - 1;
+            }
+        }
+
+        MappedSegment segment(path);
+        QVector<HistoryRecord> records;
+        records.reserve(total - first);
+
+        qint64 size;
+        while ((size = segment.recordSizeAt(offset)) > 0) {
+            if (number >= first) {
+                HistoryRecord record;
+                if (HistoryStore::decode(segment.data() + offset, size, record, nullptr)) {
+                    records.append(record);
+                }
+            }
+            offset += size;
+            number++;
+        }
+
+        result = records + result;
+    }
+
+    return result;
+}
+
+QVector<HistoryRecord> HistoryReader::segmentRange(const QString &segmentName,
+                                                   qint64 from, qint64 to) const
+{
+    QVector<HistoryRecord> records;
+    QString path = m_path + "/" + segmentName;
+
+    // Двоичный поиск последней точки индекса не позже from
+    QVector<IndexEntry> index = readIndex(path);
+    if (!index.isEmpty() && index.first().timestamp > to) {
+        return records;
+    }
+
+    int lo = 0;
+    int hi = index.size() - 1;
+    int found = -1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (index.at(mid).timestamp <= from) {
+            found = mid;
+            lo = mid + 1;
+        }
+        else {
+            hi = mid - 1;
+        }
+    }
+
+    qint64 offset = found >= 0 ? index.at(found).offset : 0;
+
+    MappedSegment segment(path);
+    qint64 size;
+    while ((size = segment.recordSizeAt(offset)) > 0) {
+        HistoryRecord record;
+        if (HistoryStore::decode(segment.data() + offset, size, record, nullptr)) {
+            if (record.timestamp > to) {
+                break;
+            }
+            if (record.timestamp >= from) {
+                records.append(record);
+            }
+        }
+        offset += size;
+    }
+
+    return records;
+}
+
+QVector<HistoryRecord> HistoryReader::records(int segment,
+                                              const QVector<quint32> &offsets,
+                                              QVector<int> *found) const
+{
+    QVector<HistoryRecord> result;
+    result.reserve(offsets.size());
+
+    MappedSegment mapped(m_path + "/" + segmentName(segment));
+    for (int i = 0; i < offsets.size(); i++) {
+        quint32 offset = offsets.at(i);
+        qint64 size = mapped.recordSizeAt(offset);
+        HistoryRecord record;
+        if (size > 0 && HistoryStore::decode(mapped.data() + offset, size, record, nullptr)) {
+            result.append(record);
+            if (found) {
+                found->append(i);
+            }
+        }
+    }
+
+    return result;
+}
+
+QString HistoryReader::segmentName(int number)
+{
+    return QString("%1.seg").arg(number, 8, 10, QChar('0'));
+}
+
+int HistoryReader::recordCount(const QString &segmentPath, qint64 *validSize)
+{
+    QVector<IndexEntry> index = readIndex(segmentPath);
+    MappedSegment segment(segmentPath);
+
+    qint64 offset = 0;
+    int count = 0;
+
+    // Начинаем с последней точки индекса, которая ещё лежит внутри файла
+    for (int i = index.size() - 1; i >= 0; i--) {
+        if (segment.recordSizeAt(index.at(i).offset) > 0) {
+            offset = index.at(i).offset;
+            count = int(index.at(i).recordNumber);
+            break;
+        }
+    }
+
+    qint64 size;
+    while ((size = segment.recordSizeAt(offset)) > 0) {
+        offset += size;
+        count++;
+    }
+
+    if (validSize) {
+        *validSize = offset;
+    }
+
+    return count;
+}
+
+HistoryStore::HistoryStore(const QString &path,
+                           qint64 segmentSize,
+                           QObject *parent) :
+    QObject(parent),
+    m_path(path),
+    m_segmentSize(segmentSize),
+    m_segmentNumber(0),
+    m_recordCount(0),
+    m_search(nullptr)
+{
+    QDir().mkpath(m_path);
+
+    // Продолжаем писать в последний сегмент
+    QStringList names = HistoryReader(m_path).segments();
+    int number = names.isEmpty() ? 1 : names.last().left(8).toInt();
+    openSegment(qMax(1, number));
+}
+
+HistoryStore::~HistoryStore()
+{
+    m_segment.close();
+    m_index.close();
+
+    // Свежая часть индекса сохраняется, чтобы при запуске не переиндексировать её
+    if (m_search) {
+        m_search->flush(true);
+        delete m_search;
+    }
+}
+
+QString HistoryStore::claimPath(const QString &path)
+{
+    QMutexLocker locker(&claimedMutex);
+
+    QString claimed = path;
+    for (int i = 2; claimedPaths.contains(claimed); i++) {
+        claimed = QString("%1-%2").arg(path).arg(i);
+    }
+    claimedPaths.insert(claimed);
+
+    return claimed;
+}
+
+void HistoryStore::releasePath(const QString &path)
+{
+    QMutexLocker locker(&claimedMutex);
+    claimedPaths.remove(path);
+}
+
+QByteArray HistoryStore::encode(const HistoryRecord &record)
+{
+    QByteArray userName = record.userName.toUtf8().left(0xffff);
+    QByteArray userColor = record.userColor.toUtf8().left(0xffff);
+    QByteArray text = record.text.toUtf8();
+
+    int bodySize = RecordFixedSize
+            + 2 + userName.size()
+            + 2 + userColor.size()
+            + 4 + text.size();
+
+    QByteArray data(RecordHeaderSize + bodySize, Qt::Uninitialized);
+    uchar *p = reinterpret_cast<uchar *>(data.data());
+
+    put32(p, quint32(bodySize));
+    put64(p, record.timestamp);
+    *p++ = record.type;
+    *p++ = record.flags;
+    put32(p, quint32(record.userId));
+    *p++ = uchar(record.gender);
+    put16(p, quint16(userName.size()));
+    putBytes(p, userName);
+    put16(p, quint16(userColor.size()));
+    putBytes(p, userColor);
+    put32(p, quint32(text.size()));
+    putBytes(p, text);
+
+    return data;
+}
+
+bool HistoryStore::decode(const uchar *data, qint64 size,
+                          HistoryRecord &record, qint64 *recordSize)
+{
+    if (size < RecordHeaderSize + RecordFixedSize) {
+        return false;
+    }
+
+    qint64 total = RecordHeaderSize + qFromLittleEndian<quint32>(data);
+    if (total > size) {
+        return false;
+    }
+
+    const uchar *p = data + RecordHeaderSize;
+    const uchar *end = data + total;
+
+    record.timestamp = qFromLittleEndian<qint64>(p);
+    p += 8;
+    record.type = *p++;
+    record.flags = *p++;
+    record.userId = int(qFromLittleEndian<quint32>(p));
+    p += 4;
+    record.gender = *p++;
+
+    if (!takeString(p, end, 2, record.userName)
+            || !takeString(p, end, 2, record.userColor)
+            || !takeString(p, end, 4, record.text)) {
+        return false;
+    }
+
+    if (recordSize) {
+        *recordSize = total;
+    }
+
+    return true;
+}
+
+void HistoryStore::append(const QVector<HistoryRecord> &records)
+{
+    if (!m_segment.isOpen()) {
+        return;
+    }
+
+    SearchIndex *index = searchIndex();
+
+    foreach (const HistoryRecord &record, records) {
+        if (m_segment.pos() >= m_segmentSize) {
+            rotate();
+        }
+
+        index->addDocument(record, m_segmentNumber, quint32(m_segment.pos()));
+
+        // Каждая IndexInterval-я запись попадает в разреженный индекс
+        if (m_recordCount % HistoryReader::IndexInterval == 0) {
+            uchar entry[IndexEntrySize];
+            uchar *p = entry;
+            put64(p, record.timestamp);
+            put32(p, quint32(m_segment.pos()));
+            put32(p, quint32(m_recordCount));
+            m_index.write(reinterpret_cast<const char *>(entry), IndexEntrySize);
+        }
+
+        m_segment.write(encode(record));
+        m_recordCount++;
+    }
+
+    m_segment.flush();
+    m_index.flush();
+    index->flush();
+}
+
+void HistoryStore::search(const QString &query, const QString &userName,
+                          qint64 from, qint64 to, int limit)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    // Индекс отбирает автора по хэшу имени, поэтому имя сверяется
+    // с самой записью. Если после сверки совпадений не хватает,
+    // запрос повторяется с большим лимитом.
+    QString author = userName.toCaseFolded();
+    QVector<HistoryRecord> records;
+    HistoryReader reader(m_path);
+    int wanted = limit;
+    for (;;) {
+        QVector<SearchIndex::Location> locations =
+                searchIndex()->search(query, userName, from, to, wanted);
+
+        // Найденные записи читаются из сегментов, по одному отображению на сегмент
+        records.clear();
+        QVector<quint32> offsets;
+        for (int i = 0; i < locations.size(); i++) {
+            offsets.append(locations.at(i).offset);
+            if (i + 1 == locations.size() || locations.at(i + 1).segment != locations.at(i).segment) {
+                records += reader.records(locations.at(i).segment, offsets);
+                offsets.clear();
+            }
+        }
+
+        if (!author.isEmpty()) {
+            records.erase(std::remove_if(records.begin(), records.end(),
+                                         [&author](const HistoryRecord &record) {
+                                             return record.userName.toCaseFolded() != author;
+                                         }),
+                          records.end());
+        }
+
+        if (records.size() >= limit || locations.size() < wanted
+                || wanted >= int(searchIndex()->documentCount())) {
+            break;
+        }
+        wanted *= 2;
+    }
+
+    // Самые новые совпадения - в конце
+    if (records.size() > limit) {
+        records.remove(0, records.size() - limit);
+    }
+
+    emit searchFinished(query, records, timer.nsecsElapsed() / 1000);
+}
+
+bool HistoryStore::openSegment(int number)
+{
+    m_segmentNumber = number;
+
+    QString path = m_path + "/" + HistoryReader::segmentName(number);
+
+    qint64 validSize = 0;
+    m_recordCount = HistoryReader::recordCount(path, &validSize);
+
+    m_segment.setFileName(path);
+    if (!m_segment.open(QIODevice::ReadWrite)) {
+        qWarning() << "cannot open history segment" << path;
+        return false;
+    }
+
+    // Обрезаем недописанную запись, оставшуюся после аварийного завершения
+    if (m_segment.size() > validSize) {
+        m_segment.resize(validSize);
+    }
+    m_segment.seek(validSize);
+
+    m_index.setFileName(indexPath(path));
+    if (!m_index.open(QIODevice::ReadWrite)) {
+        qWarning() << "cannot open history index" << m_index.fileName();
+        m_segment.close();
+        return false;
+    }
+
+    // Точки индекса хранят номер записи, поэтому недописанный хвост
+    // индекса достаточно обрезать: индекс просто станет реже
+    qint64 entries = (m_recordCount + HistoryReader::IndexInterval - 1) / HistoryReader::IndexInterval;
+    entries = qMin(entries, m_index.size() / IndexEntrySize);
+    m_index.resize(entries * IndexEntrySize);
+    m_index.seek(entries * IndexEntrySize);
+
+    return true;
+}
+
+SearchIndex *HistoryStore::searchIndex()
+{
+    if (m_search) {
+        return m_search;
+    }
+
+    m_search = new SearchIndex(m_path);
+
+    // Документы, не попавшие в куски индекса до завершения программы,
+    // индексируются заново по записям истории
+    HistoryReader reader(m_path);
+    quint32 document = m_search->indexedCount();
+    while (document < m_search->documentCount()) {
+        int segment = m_search->location(document).segment;
+
+        QVector<quint32> offsets;
+        quint32 first = document;
+        while (document < m_search->documentCount()
+               && m_search->location(document).segment == segment) {
+            offsets.append(m_search->location(document).offset);
+            document++;
+        }
+
+        // Номер документа берётся по смещению прочитанной записи:
+        // пропущенная запись не должна сдвигать номера следующих
+        QVector<int> found;
+        QVector<HistoryRecord> records = reader.records(segment, offsets, &found);
+        if (records.size() != offsets.size()) {
+            qWarning() << "search index refers to missing history records";
+        }
+        for (int i = 0; i < records.size(); i++) {
+            m_search->indexDocument(first + quint32(found.at(i)), records.at(i));
+        }
+    }
+
+    return m_search;
+}
+
+void HistoryStore::rotate()
+{
+    m_segment.close();
+    m_index.close();
+    openSegment(m_segmentNumber + 1);
+}
@@ -0,0 +1,156 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef HISTORYSTORE_H
+#define HISTORYSTORE_H
+
+#include <QFile>
+#include <QMetaType>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+class SearchIndex;
+
+// Сообщение чата, сохранённое в локальной истории
+struct HistoryRecord
+{
+    enum Type {
+        PublicMessage = 1,
+        PrivateMessage = 2
+    };
+
+    enum Flag {
+        Outgoing = 0x1 // приватное сообщение, отправленное нами
+    };
+
+    qint64 timestamp; // мс с начала эпохи
+    quint8 type;
+    quint8 flags;
+    int userId;
+    int gender;
+    QString userName;
+    QString userColor;
+    QString text;
+};
+
+Q_DECLARE_METATYPE(HistoryRecord)
+Q_DECLARE_METATYPE(QVector<HistoryRecord>)
+
+// Чтение истории.
+// История хранится в каталоге как последовательность сегментов:
+// NNNNNNNN.seg с записями друг за другом и NNNNNNNN.idx с разреженным
+// индексом (время и смещение каждой IndexInterval-й записи).
+// Сегменты читаются через отображение в память, поэтому последние записи
+// достаются без чтения и разбора файла целиком.
+class HistoryReader
+{
+public:
+    explicit HistoryReader(const QString &path);
+
+    QStringList segments() const;
+
+    // Последние count записей в хронологическом порядке
+    QVector<HistoryRecord> recent(int count) const;
+
+    // Записи сегмента со временем в диапазоне [from, to]
+    QVector<HistoryRecord> segmentRange(const QString &segment,
+                                        qint64 from, qint64 to) const;
+
+    // Записи сегмента по смещениям (смещения по возрастанию).
+    // Недостающие и испорченные записи пропускаются; в found попадают
+    // номера смещений, по которым записи прочитаны
+    QVector<HistoryRecord> records(int segment, const QVector<quint32> &offsets,
+                                   QVector<int> *found = nullptr) const;
+
+    // Число целых записей в сегменте и конец последней из них
+    static int recordCount(const QString &segmentPath, qint64 *validSize = nullptr);
+
+    static QString segmentName(int number);
+
+    static const int IndexInterval = 64;
+
+private:
+    QString m_path;
+};
+
+// Запись истории.
+// Живёт в отдельном потоке: GUI отдаёт ей записи пачками, а она дописывает
+// их в текущий сегмент и начинает новый, когда сегмент превышает лимит.
+// Здесь же пополняется поисковый индекс и выполняются запросы к нему,
+// чтобы поиск не задерживал GUI.
+class HistoryStore : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit HistoryStore(const QString &path,
+                          qint64 segmentSize = 4 * 1024 * 1024,
+                          QObject *parent = nullptr);
+    ~HistoryStore();
+
+    // Занимает каталог истории для одной сессии процесса. Если path уже
+    // занят, возвращает первый свободный из path-2, path-3 и так далее:
+    // два HistoryStore в одном каталоге портили бы сегменты и индексы
+    // друг друга. Каталог освобождается releasePath().
+    static QString claimPath(const QString &path);
+    static void releasePath(const QString &path);
+
+    static QByteArray encode(const HistoryRecord &record);
+    static bool decode(const uchar *data, qint64 size,
+                       HistoryRecord &record, qint64 *recordSize);
+
+public slots:
+    void append(const QVector<HistoryRecord> &records);
+
+    // Сообщения со всеми словами запроса; пустое имя - любой автор
+    void search(const QString &query, const QString &userName,
+                qint64 from, qint64 to, int limit);
+
+signals:
+    void searchFinished(const QString &query,
+                        const QVector<HistoryRecord> &records,
+                        qint64 elapsed); // мкс
+
+private:
+    bool openSegment(int number);
+    void rotate();
+    SearchIndex *searchIndex();
+
+    QString m_path;
+    qint64 m_segmentSize;
+
+    int m_segmentNumber;
+    QFile m_segment;
+    QFile m_index;
+    int m_recordCount; // записей в текущем сегменте
+
+    SearchIndex *m_search; // открывается в потоке истории при первом обращении
+};
+
+#endif // HISTORYSTORE_H
@@ -0,0 +1,117 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "latencyhistogram.h"
+
+#include <QDateTime>
+
+#include <algorithm>
+
+LatencyHistogram::LatencyHistogram(int window) :
+    m_ring(qMax(1, window)),
+    m_next(0),
+    m_count(0),
+    m_total(0)
+{
+}
+
+void LatencyHistogram::add(qint64 value)
+{
+    Sample &sample = m_ring[m_next];
+    sample.time = QDateTime::currentMSecsSinceEpoch();
+    sample.value = qMax(qint64(0), value);
+
+    m_next = (m_next + 1) % m_ring.size();
+    m_count = qMin(m_count + 1, m_ring.size());
+    m_total++;
+}
+
+void LatencyHistogram::clear()
+{
+    m_next = 0;
+    m_count = 0;
+}
+
+int LatencyHistogram::count() const
+{
+    return m_count;
+}
+
+qint64 LatencyHistogram::total() const
+{
+    return m_total;
+}
+
+qint64 LatencyHistogram::last() const
+{
+    if (m_count == 0) {
+        return -1;
+    }
+    return m_ring.at((m_next + m_ring.size() - 1) % m_ring.size()).value;
+}
+
+qint64 LatencyHistogram::percentile(double p) const
+{
+    return percentiles(QVector<double>() << p).first();
+}
+
+QVector<qint64> LatencyHistogram::percentiles(const QVector<double> &points) const
+{
+    QVector<qint64> result(points.size(), -1);
+    if (m_count == 0) {
+        return result;
+    }
+
+    QVector<qint64> values;
+    values.reserve(m_count);
+    foreach (const Sample &sample, samples()) {
+        values.append(sample.value);
+    }
+
+    // Для нескольких перцентилей дешевле один раз отсортировать окно
+    std::sort(values.begin(), values.end());
+
+    for (int i = 0; i < points.size(); i++) {
+        int rank = qBound(0, int(points.at(i) * values.size() + 0.5) - 1, values.size() - 1);
+        result[i] = values.at(rank);
+    }
+
+    return result;
+}
+
+QVector<LatencyHistogram::Sample> LatencyHistogram::samples() const
+{
+    QVector<Sample> result;
+    result.reserve(m_count);
+
+    int first = (m_next + m_ring.size() - m_count) % m_ring.size();
+    for (int i = 0; i < m_count; i++) {
+        result.append(m_ring.at((first + i) % m_ring.size()));
+    }
+
+    return result;
+}
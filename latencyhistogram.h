@@ -0,0 +1,70 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <QVector>
+#include <QtGlobal>
+
+// Скользящее окно замеров задержки.
+// Хранит последние window замеров в кольцевом буфере, перцентили
+// считаются по окну при запросе, поэтому добавление стоит O(1)
+// и не мешает горячему пути, а панель обновляется раз в секунду.
+class LatencyHistogram
+{
+public:
+    struct Sample
+    {
+        qint64 time; // мс с начала эпохи
+        qint64 value; // мкс
+    };
+
+    explicit LatencyHistogram(int window = 1024);
+
+    void add(qint64 value);
+    void clear();
+
+    int count() const; // замеров в окне
+    qint64 total() const; // замеров за всё время
+    qint64 last() const;
+
+    // Перцентиль по окну, p от 0 до 1; -1, если замеров нет
+    qint64 percentile(double p) const;
+    QVector<qint64> percentiles(const QVector<double> &points) const;
+
+    // Замеры окна в хронологическом порядке
+    QVector<Sample> samples() const;
+
+private:
+    QVector<Sample> m_ring;
+    int m_next;
+    int m_count;
+    qint64 m_total;
+};
+
+#endif // LATENCYHISTOGRAM_H
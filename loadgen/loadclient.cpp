@@ -0,0 +1,209 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "loadclient.h"
+#include "loadstats.h"
+
+#include <QUrlQuery>
+
+namespace {
+
+// Метка сообщения генератора: "lg:<номер сессии>:<время отправки, мкс>"
+const QString MessageMarker = QStringLiteral("lg:");
+
+} // namespace
+
+LoadClient::LoadClient(int number,
+                       const QUrl &url,
+                       const QElapsedTimer *clock,
+                       LoadStats *stats,
+                       QObject *parent) :
+    QObject(parent),
+    m_number(number),
+    m_url(url),
+    m_clock(clock),
+    m_stats(stats),
+    m_requestedFormat(Protocol::JsonFormat),
+    m_wireFormat(Protocol::JsonFormat),
+    m_ready(false),
+    m_userId(0)
+{
+    m_requestedFormat = QUrlQuery(m_url).queryItemValue("format") == "cbor"
+            ? Protocol::CborFormat
+            : Protocol::JsonFormat;
+
+    connect(&m_socket, &QWebSocket::connected,
+            this, &LoadClient::onConnected);
+    connect(&m_socket, &QWebSocket::disconnected,
+            this, &LoadClient::onDisconnected);
+    connect(&m_socket, SIGNAL(error(QAbstractSocket::SocketError)),
+            this, SLOT(onError(QAbstractSocket::SocketError)));
+    connect(&m_socket, &QWebSocket::textMessageReceived,
+            this, &LoadClient::onTextMessageReceived);
+    connect(&m_socket, &QWebSocket::binaryMessageReceived,
+            this, &LoadClient::onBinaryMessageReceived);
+}
+
+void LoadClient::open()
+{
+    m_stats->opened++;
+    m_socket.open(m_url);
+}
+
+void LoadClient::close()
+{
+    m_ready = false;
+    disconnect(&m_socket, nullptr, this, nullptr);
+    m_socket.close();
+}
+
+bool LoadClient::isReady() const
+{
+    return m_ready;
+}
+
+void LoadClient::sendMessage(int payloadSize)
+{
+    QString text = MessageMarker
+            + QString::number(m_number) + ':'
+            + QString::number(m_clock->nsecsElapsed() / 1000) + ' ';
+
+    if (text.size() < payloadSize) {
+        text += QString(payloadSize - text.size(), QChar('x'));
+    }
+
+    sendFrame(Protocol::encodeMessage(0, text, m_wireFormat));
+    m_stats->messagesSent++;
+}
+
+void LoadClient::onConnected()
+{
+    m_wireFormat = Protocol::JsonFormat;
+}
+
+void LoadClient::onDisconnected()
+{
+    if (m_ready) {
+        m_ready = false;
+        m_stats->ready--;
+    }
+    m_stats->closed++;
+}
+
+void LoadClient::onError(QAbstractSocket::SocketError error)
+{
+    Q_UNUSED(error)
+
+    // Ошибка до авторизации считается неудачным подключением
+    if (!m_ready) {
+        m_stats->failed++;
+    }
+}
+
+void LoadClient::onTextMessageReceived(const QString &message)
+{
+    m_stats->framesReceived++;
+    m_stats->bytesReceived += message.size();
+
+    ChatEvent event;
+    if (Protocol::decode(message, event)) {
+        handleEvent(event);
+    }
+}
+
+void LoadClient::onBinaryMessageReceived(const QByteArray &message)
+{
+    m_stats->framesReceived++;
+    m_stats->bytesReceived += message.size();
+
+    ChatEvent event;
+    if (!Protocol::decode(message, event)) {
+        return;
+    }
+
+    if (m_requestedFormat == Protocol::CborFormat) {
+        m_wireFormat = Protocol::CborFormat;
+    }
+
+    handleEvent(event);
+}
+
+void LoadClient::handleEvent(const ChatEvent &event)
+{
+    switch (event.type) {
+    case ChatEvent::Ping:
+        sendFrame(Protocol::encodePong(m_wireFormat));
+        break;
+
+    case ChatEvent::Authorized:
+        m_userId = event.userId;
+        if (!m_ready) {
+            m_ready = true;
+            m_stats->ready++;
+        }
+        break;
+
+    case ChatEvent::PublicMessage:
+    case ChatEvent::PrivateMessage: {
+        // Задержку меряет только отправитель: все сессии процесса
+        // пользуются одними часами, поэтому разность времени честная
+        if (event.userId != m_userId || !event.text.startsWith(MessageMarker)) {
+            break;
+        }
+
+        int numberEnd = event.text.indexOf(':', MessageMarker.size());
+        int timeEnd = event.text.indexOf(' ', numberEnd + 1);
+        if (numberEnd < 0 || timeEnd < 0) {
+            break;
+        }
+
+        bool numberOk = false;
+        bool timeOk = false;
+        int number = event.text.midRef(MessageMarker.size(),
+                                       numberEnd - MessageMarker.size()).toInt(&numberOk);
+        qint64 sent = event.text.midRef(numberEnd + 1, timeEnd - numberEnd - 1).toLongLong(&timeOk);
+        if (numberOk && timeOk && number == m_number) {
+            m_stats->echoes++;
+            m_stats->latencies.append(m_clock->nsecsElapsed() / 1000 - sent);
+        }
+        break;
+    }
+
+    default:
+        break;
+    }
+}
+
+void LoadClient::sendFrame(const QByteArray &frame)
+{
+    if (m_wireFormat == Protocol::CborFormat) {
+        m_socket.sendBinaryMessage(frame);
+    }
+    else {
+        m_socket.sendTextMessage(QString::fromUtf8(frame));
+    }
+}
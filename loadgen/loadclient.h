@@ -0,0 +1,86 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef LOADCLIENT_H
+#define LOADCLIENT_H
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QUrl>
+#include <QWebSocket>
+
+#include "protocol.h"
+
+struct LoadStats;
+
+// Одна имитируемая сессия чата.
+// Обрабатывает те же действия, что и клиент (Ping, Authorized,
+// PublicMessage...), но вместо показа пользователю только считает их.
+// В отправляемое сообщение вписывается время отправки, поэтому, получив
+// своё сообщение обратно, сессия знает задержку доставки.
+class LoadClient : public QObject
+{
+    Q_OBJECT
+
+public:
+    LoadClient(int number,
+               const QUrl &url,
+               const QElapsedTimer *clock,
+               LoadStats *stats,
+               QObject *parent = nullptr);
+
+    void open();
+    void close();
+
+    bool isReady() const;
+    void sendMessage(int payloadSize);
+
+private slots:
+    void onConnected();
+    void onDisconnected();
+    void onError(QAbstractSocket::SocketError error);
+    void onTextMessageReceived(const QString &message);
+    void onBinaryMessageReceived(const QByteArray &message);
+
+private:
+    void handleEvent(const ChatEvent &event);
+    void sendFrame(const QByteArray &frame);
+
+    int m_number;
+    QUrl m_url;
+    const QElapsedTimer *m_clock; // общие часы всех сессий
+    LoadStats *m_stats;
+
+    QWebSocket m_socket;
+    Protocol::WireFormat m_requestedFormat;
+    Protocol::WireFormat m_wireFormat;
+
+    bool m_ready;
+    int m_userId; // id, выданный сервером при авторизации
+};
+
+#endif // LOADCLIENT_H
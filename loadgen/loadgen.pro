@@ -0,0 +1,14 @@
+# Генератор нагрузки: много одновременных сессий без виджетов.
+# Использует тот же разбор протокола, что и клиент.
+QT += core websockets
+QT -= gui
+
+TARGET = simplechat-loadgen
+TEMPLATE = app
+DEFINES += QT_DEPRECATED_WARNINGS
+CONFIG += c++11 console
+CONFIG -= app_bundle
+SOURCES += main.cpp loadclient.cpp loadgenerator.cpp
+HEADERS += loadclient.h loadgenerator.h loadstats.h
+
+include(../protocol.pri)
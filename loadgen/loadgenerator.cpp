@@ -0,0 +1,242 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "loadgenerator.h"
+#include "loadclient.h"
+
+#include <QTextStream>
+#include <QTimer>
+#include <QUrlQuery>
+
+#include <algorithm>
+
+namespace {
+
+const int ConnectInterval = 10; // мс между порциями подключений
+const int SendInterval = 5; // мс между тактами отправки
+const int DrainTime = 2000; // мс ожидания последних ответов после замера
+
+QTextStream &out()
+{
+    static QTextStream stream(stdout);
+    return stream;
+}
+
+} // namespace
+
+LoadGenerator::LoadGenerator(const LoadOptions &options, QObject *parent) :
+    QObject(parent),
+    m_options(options),
+    m_nextClient(0),
+    m_connectTimer(new QTimer(this)),
+    m_sendTimer(new QTimer(this)),
+    m_reportTimer(new QTimer(this)),
+    m_lastTick(0),
+    m_sendCredit(0),
+    m_lastReport(0),
+    m_reportedSent(0),
+    m_reportedFrames(0),
+    m_reportedBytes(0)
+{
+    m_clients.reserve(m_options.clients);
+
+    m_connectTimer->setInterval(ConnectInterval);
+    connect(m_connectTimer, &QTimer::timeout,
+            this, &LoadGenerator::openNext);
+
+    m_sendTimer->setInterval(SendInterval);
+    m_sendTimer->setTimerType(Qt::PreciseTimer);
+    connect(m_sendTimer, &QTimer::timeout,
+            this, &LoadGenerator::sendTick);
+
+    m_reportTimer->setInterval(1000);
+    connect(m_reportTimer, &QTimer::timeout,
+            this, &LoadGenerator::report);
+}
+
+void LoadGenerator::start()
+{
+    out() << "simplechat-loadgen: " << m_options.clients << " clients -> "
+          << m_options.url.toString() << ", " << m_options.messageRate << " msg/s, "
+          << m_options.duration << " s" << endl;
+
+    m_clock.start();
+    m_connectTimer->start();
+    m_sendTimer->start();
+    m_reportTimer->start();
+
+    QTimer::singleShot(m_options.duration * 1000, this, &LoadGenerator::stop);
+}
+
+void LoadGenerator::openNext()
+{
+    // Подключаемся порциями, чтобы не упереться в очередь accept() сервера
+    int batch = qMax(1, m_options.connectRate * ConnectInterval / 1000);
+
+    for (int i = 0; i < batch && m_clients.size() < m_options.clients; i++) {
+        int number = m_clients.size();
+        LoadClient *client = new LoadClient(number, sessionUrl(number),
+                                            &m_clock, &m_stats, this);
+        m_clients.append(client);
+        client->open();
+    }
+
+    if (m_clients.size() >= m_options.clients) {
+        m_connectTimer->stop();
+    }
+}
+
+void LoadGenerator::sendTick()
+{
+    qint64 now = m_clock.nsecsElapsed() / 1000;
+    m_sendCredit += m_options.messageRate * (now - m_lastTick) / 1000000.0;
+    m_lastTick = now;
+
+    // Не копим долг дольше секунды, иначе после затора уйдёт пачка
+    m_sendCredit = qMin(m_sendCredit, qMax(1.0, m_options.messageRate));
+
+    while (m_sendCredit >= 1.0) {
+        // Ищем следующую авторизованную сессию по кругу
+        LoadClient *client = nullptr;
+        for (int i = 0; i < m_clients.size() && !client; i++) {
+            LoadClient *candidate = m_clients.at(m_nextClient);
+            m_nextClient = (m_nextClient + 1) % m_clients.size();
+            if (candidate->isReady()) {
+                client = candidate;
+            }
+        }
+
+        if (!client) {
+            m_sendCredit = 0;
+            break;
+        }
+
+        client->sendMessage(m_options.messageSize);
+        m_sendCredit -= 1.0;
+    }
+}
+
+void LoadGenerator::report()
+{
+    qint64 now = m_clock.elapsed();
+    double seconds = qMax<qint64>(1, now - m_lastReport) / 1000.0;
+
+    double sent = (m_stats.messagesSent - m_reportedSent) / seconds;
+    double frames = (m_stats.framesReceived - m_reportedFrames) / seconds;
+    double kbytes = (m_stats.bytesReceived - m_reportedBytes) / seconds / 1024;
+
+    out() << QString("%1s ready %2/%3 failed %4 | sent %5/s recv %6/s %7 KiB/s | %8")
+             .arg(now / 1000, 4)
+             .arg(m_stats.ready)
+             .arg(m_options.clients)
+             .arg(m_stats.failed)
+             .arg(sent, 0, 'f', 0)
+             .arg(frames, 0, 'f', 0)
+             .arg(kbytes, 0, 'f', 0)
+             .arg(latencySummary(m_stats.latencies))
+          << endl;
+
+    m_allLatencies += m_stats.latencies;
+    m_stats.latencies.clear();
+
+    m_lastReport = now;
+    m_reportedSent = m_stats.messagesSent;
+    m_reportedFrames = m_stats.framesReceived;
+    m_reportedBytes = m_stats.bytesReceived;
+}
+
+void LoadGenerator::stop()
+{
+    // Больше не отправляем, но ещё немного ждём эхо уже отправленного
+    m_connectTimer->stop();
+    m_sendTimer->stop();
+
+    QTimer::singleShot(DrainTime, this, &LoadGenerator::finish);
+}
+
+void LoadGenerator::finish()
+{
+    m_reportTimer->stop();
+    report();
+
+    double seconds = m_clock.elapsed() / 1000.0;
+    qint64 lost = m_stats.messagesSent - m_stats.echoes;
+
+    out() << "total: sent " << m_stats.messagesSent
+          << " (" << QString::number(m_stats.messagesSent / seconds, 'f', 1) << " msg/s)"
+          << ", received " << m_stats.framesReceived << " frames"
+          << " (" << QString::number(m_stats.framesReceived / seconds, 'f', 1) << " frames/s)"
+          << ", echoes " << m_stats.echoes << ", lost " << lost
+          << ", failed connections " << m_stats.failed
+          << ", closed by server " << m_stats.closed << endl;
+    out() << "latency: " << latencySummary(m_allLatencies) << endl;
+
+    foreach (LoadClient *client, m_clients) {
+        client->close();
+    }
+
+    emit finished();
+}
+
+QUrl LoadGenerator::sessionUrl(int number) const
+{
+    // Параметры сессии те же, что передаёт клиент
+    QUrl url = m_options.url;
+    QUrlQuery query(url);
+    query.addQueryItem("userName", QString("load%1").arg(number));
+    query.addQueryItem("userColor", "#7f8c8d");
+    query.addQueryItem("gender", "0");
+    if (m_options.wireFormat == "cbor") {
+        query.addQueryItem("format", "cbor");
+    }
+    url.setQuery(query);
+    return url;
+}
+
+qint64 LoadGenerator::percentile(const QVector<qint64> &sorted, double p)
+{
+    int rank = qBound(0, int(p * sorted.size() + 0.5) - 1, sorted.size() - 1);
+    return sorted.at(rank);
+}
+
+QString LoadGenerator::latencySummary(QVector<qint64> samples)
+{
+    if (samples.isEmpty()) {
+        return "n/a";
+    }
+
+    std::sort(samples.begin(), samples.end());
+
+    auto ms = [](qint64 usec) { return QString::number(usec / 1000.0, 'f', 2); };
+
+    return QString("n %1 p50 %2 p95 %3 p99 %4 max %5 ms")
+            .arg(samples.size())
+            .arg(ms(percentile(samples, 0.50)))
+            .arg(ms(percentile(samples, 0.95)))
+            .arg(ms(percentile(samples, 0.99)))
+            .arg(ms(samples.last()));
+}
@@ -0,0 +1,101 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef LOADGENERATOR_H
+#define LOADGENERATOR_H
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QUrl>
+#include <QVector>
+
+#include "loadstats.h"
+
+class LoadClient;
+class QTimer;
+
+struct LoadOptions
+{
+    QUrl url; // адрес сервера без параметров сессии
+    int clients; // число одновременных сессий
+    int connectRate; // новых подключений в секунду
+    double messageRate; // сообщений в секунду от всех сессий вместе
+    int messageSize; // размер текста сообщения, символов
+    int duration; // длительность замера, с
+    QString wireFormat; // json или cbor
+};
+
+// Генератор нагрузки.
+// Постепенно открывает сессии, равномерно распределяет отправку
+// сообщений между авторизованными сессиями и раз в секунду печатает
+// пропускную способность и перцентили задержки доставки.
+class LoadGenerator : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit LoadGenerator(const LoadOptions &options, QObject *parent = nullptr);
+
+    void start();
+
+signals:
+    void finished();
+
+private slots:
+    void openNext();
+    void sendTick();
+    void report();
+    void stop();
+    void finish();
+
+private:
+    QUrl sessionUrl(int number) const;
+    static qint64 percentile(const QVector<qint64> &sorted, double p);
+    static QString latencySummary(QVector<qint64> samples);
+
+    LoadOptions m_options;
+    LoadStats m_stats;
+    QElapsedTimer m_clock;
+
+    QVector<LoadClient *> m_clients;
+    int m_nextClient; // следующая сессия для отправки сообщения
+
+    QTimer *m_connectTimer;
+    QTimer *m_sendTimer;
+    QTimer *m_reportTimer;
+
+    qint64 m_lastTick; // время предыдущего такта отправки, мкс
+    double m_sendCredit; // накопленное число сообщений к отправке
+
+    qint64 m_lastReport; // время предыдущего отчёта, мс
+    qint64 m_reportedSent; // счётчики на момент предыдущего отчёта
+    qint64 m_reportedFrames;
+    qint64 m_reportedBytes;
+    QVector<qint64> m_allLatencies; // задержки за весь замер
+};
+
+#endif // LOADGENERATOR_H
@@ -0,0 +1,64 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef LOADSTATS_H
+#define LOADSTATS_H
+
+#include <QVector>
+#include <QtGlobal>
+
+// Счётчики генератора нагрузки.
+// Все сессии живут в одном потоке и пишут сюда напрямую, без сигналов:
+// при тысячах сессий сигнал на каждый кадр стоил бы дороже самого кадра.
+struct LoadStats
+{
+    LoadStats() :
+        opened(0),
+        ready(0),
+        failed(0),
+        closed(0),
+        messagesSent(0),
+        framesReceived(0),
+        bytesReceived(0),
+        echoes(0)
+    {
+    }
+
+    int opened; // начато подключений
+    int ready; // сессий прошли авторизацию
+    int failed; // ошибок подключения
+    int closed; // сессий закрыто сервером
+
+    qint64 messagesSent;
+    qint64 framesReceived;
+    qint64 bytesReceived;
+    qint64 echoes; // своих сообщений вернулось от сервера
+
+    QVector<qint64> latencies; // мкс от отправки до получения своего сообщения
+};
+
+#endif // LOADSTATS_H
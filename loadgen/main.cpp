@@ -0,0 +1,87 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "loadgenerator.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#endif
+
+// Каждая сессия - отдельный сокет, поэтому для тысяч сессий
+// поднимаем лимит открытых файлов до максимально разрешённого
+static void raiseFileLimit()
+{
+#ifdef Q_OS_UNIX
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+#endif
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    a.setApplicationName("simplechat-loadgen");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("SimpleChat load generator");
+    parser.addHelpOption();
+
+    QCommandLineOption urlOption("url", "Server address.", "url", "ws://127.0.0.1:27800");
+    QCommandLineOption clientsOption("clients", "Concurrent sessions.", "count", "1000");
+    QCommandLineOption connectRateOption("connect-rate", "New sessions per second.", "count", "500");
+    QCommandLineOption rateOption("rate", "Messages per second from all sessions.", "count", "100");
+    QCommandLineOption sizeOption("size", "Message text size in characters.", "chars", "64");
+    QCommandLineOption durationOption("duration", "Measurement time in seconds.", "seconds", "30");
+    QCommandLineOption formatOption("format", "Wire format: json or cbor.", "format", "json");
+    parser.addOptions({ urlOption, clientsOption, connectRateOption, rateOption,
+                        sizeOption, durationOption, formatOption });
+    parser.process(a);
+
+    LoadOptions options;
+    options.url = QUrl(parser.value(urlOption));
+    options.clients = qMax(1, parser.value(clientsOption).toInt());
+    options.connectRate = qMax(1, parser.value(connectRateOption).toInt());
+    options.messageRate = qMax(0.0, parser.value(rateOption).toDouble());
+    options.messageSize = qMax(0, parser.value(sizeOption).toInt());
+    options.duration = qMax(1, parser.value(durationOption).toInt());
+    options.wireFormat = parser.value(formatOption);
+
+    raiseFileLimit();
+
+    LoadGenerator generator(options);
+    QObject::connect(&generator, &LoadGenerator::finished,
+                     &a, &QCoreApplication::quit, Qt::QueuedConnection);
+    generator.start();
+
+    return a.exec();
+}
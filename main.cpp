@@ -25,21 +25,141 @@
  * SOFTWARE.
  */
 
+#include "connectionworker.h"
+#include "sessionwindow.h"
+#include "startup.h"
 #include "widget.h"
 #include <QApplication>
+#include <QCommandLineParser>
+#include <QThread>
 #include <QTimer>
 
 int main(int argc, char *argv[])
 {
+    Startup::start();
+
     QApplication a(argc, argv);
     a.setApplicationName("SimpleChat");
     a.setApplicationDisplayName("SimpleChat");
 
-    Widget w;
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Простой клиент websocket-чата");
+    parser.addHelpOption();
+
+    QCommandLineOption fastStartOption(QStringList() << "f" << "fast-start",
+            "Подключиться сразу, без окна авторизации, с сохранёнными данными.");
+    QCommandLineOption serverOption("server", "Адрес сервера.", "host");
+    QCommandLineOption portOption("port", "Порт сервера.", "port");
+    QCommandLineOption userOption("user", "Имя пользователя.", "name");
+    QCommandLineOption colorOption("color", "Цвет имени, например #34495e.", "color");
+    QCommandLineOption genderOption("gender", "Пол: 0, 1 или 2.", "gender");
+    QCommandLineOption reportOption("startup-report",
+            "Печатать в stderr время этапов запуска.");
+    QCommandLineOption exitOption("exit-after-first-message",
+            "Завершиться после отрисовки первого сообщения (для замеров).");
+    QCommandLineOption recordOption("record",
+            "Записывать кадры соединения в файл.", "file");
+    QCommandLineOption replayOption("replay",
+            "Воспроизвести запись кадров вместо подключения к серверу.", "file");
+    QCommandLineOption replaySpeedOption("replay-speed",
+            "Скорость воспроизведения относительно записи, 0 - без ограничения.", "factor", "1");
+    QCommandLineOption exitReplayOption("exit-after-replay",
+            "Завершиться после воспроизведения записи (для замеров).");
+    parser.addOption(fastStartOption);
+    parser.addOption(serverOption);
+    parser.addOption(portOption);
+    parser.addOption(userOption);
+    parser.addOption(colorOption);
+    parser.addOption(genderOption);
+    parser.addOption(reportOption);
+    parser.addOption(exitOption);
+    parser.addOption(recordOption);
+    parser.addOption(replayOption);
+    parser.addOption(replaySpeedOption);
+    parser.addOption(exitReplayOption);
+    parser.process(a);
+
+    Startup::setReportEnabled(parser.isSet(reportOption));
+    if (parser.isSet(exitOption)) {
+        Startup::setExitMilestone("first message rendered");
+    }
+
+    // Данные для подключения: сохранённые, поверх них - из командной строки.
+    // Любой из параметров подключения тоже включает быстрый старт.
+    AuthDialog::ConnectionData data = Widget::savedConnectionData();
+    if (parser.isSet(serverOption)) {
+        data.server = parser.value(serverOption);
+    }
+    if (parser.isSet(portOption)) {
+        data.port = parser.value(portOption).toInt();
+    }
+    if (parser.isSet(userOption)) {
+        data.userName = parser.value(userOption);
+    }
+    if (parser.isSet(colorOption)) {
+        data.userColor = parser.value(colorOption);
+    }
+    if (parser.isSet(genderOption)) {
+        data.gender = parser.value(genderOption).toInt();
+    }
+
+    // Воспроизведение записи идёт вместо сети, подключения не будет
+    bool replay = parser.isSet(replayOption);
+    bool fastStart = !replay
+            && (parser.isSet(fastStartOption) || parser.isSet(serverOption)
+                || parser.isSet(portOption) || parser.isSet(userOption)
+                || parser.isSet(colorOption) || parser.isSet(genderOption));
+
+    // Соединение открывается до построения окна: рукопожатие идёт
+    // в сетевом потоке, пока создаются окно и история основной сессии.
+    // Готовые поток и обработчик окно затем забирает себе.
+    QThread *networkThread = nullptr;
+    ConnectionWorker *worker = nullptr;
+    if (fastStart) {
+        networkThread = new QThread;
+        networkThread->setObjectName("network");
+        networkThread->start();
+
+        worker = new ConnectionWorker;
+        worker->moveToThread(networkThread);
+
+        // Запись включается раньше открытия, чтобы не потерять первые кадры
+        if (parser.isSet(recordOption)) {
+            QMetaObject::invokeMethod(worker, "startRecording", Qt::QueuedConnection,
+                                      Q_ARG(QString, parser.value(recordOption)));
+        }
+        QMetaObject::invokeMethod(worker, "open", Qt::QueuedConnection,
+                                  Q_ARG(QStringList, Widget::savedEndpointUrls(data)));
+        Startup::mark("connection started");
+    }
+
+    SessionWindow w(networkThread, worker);
     w.setWindowTitle("Простой чат");
+    Startup::mark("ui built");
+
+    if (parser.isSet(recordOption) && !fastStart) {
+        w.currentSession()->startRecording(parser.value(recordOption));
+    }
+
+    if (replay) {
+        Widget *session = w.currentSession();
+        if (parser.isSet(exitReplayOption)) {
+            QObject::connect(session, &Widget::replayCompleted,
+                             &a, &QApplication::quit, Qt::QueuedConnection);
+        }
+        session->startReplay(parser.value(replayOption),
+                             parser.value(replaySpeedOption).toDouble());
+    }
+    else if (fastStart) {
+        w.currentSession()->startConnection(data);
+    }
+
     w.show();
+    Startup::mark("window shown");
 
-    QTimer::singleShot(1000, &w, &Widget::connectToServer);
+    if (!fastStart && !replay) {
+        QTimer::singleShot(1000, &w, &SessionWindow::connectToServer);
+    }
 
     return a.exec();
 }
@@ -0,0 +1,500 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "markuprenderer.h"
+
+#include <initializer_list>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SIMPLECHAT_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+enum CharClass : uchar {
+    Plain = 0,
+    Escape = 0x1, // требует экранирования
+    Markup = 0x2 // может начинать разметку
+};
+
+// Классы ASCII-символов; всё, что за пределами ASCII, - обычный текст.
+// Путь SSE2 в skipPlain() сравнивает с тем же набором символов
+struct CharTable
+{
+    CharTable()
+    {
+        for (int i = 0; i < 128; i++) {
+            classes[i] = Plain;
+        }
+
+        classes['<'] = Escape | Markup;
+        classes['>'] = Escape | Markup;
+        classes['&'] = Escape | Markup;
+        classes['"'] = Escape | Markup;
+        classes['\''] = Escape | Markup;
+        classes['{'] = Markup;
+        classes['*'] = Markup;
+        classes[':'] = Markup;
+    }
+
+    uchar classes[128];
+};
+
+const CharTable charTable;
+
+// Конец отрезка без символов из mask
+inline const QChar *skipPlain(const QChar *p, const QChar *end, uchar mask)
+{
+#ifdef SIMPLECHAT_SSE2
+    // По восемь символов за шаг: каждый сравнивается сразу со всеми
+    // особыми символами из таблицы. Символы вне ASCII ни с одним из них
+    // не совпадают, а точное место находки ищет цикл ниже
+    const __m128i lt = _mm_set1_epi16('<');
+    const __m128i gt = _mm_set1_epi16('>');
+    const __m128i amp = _mm_set1_epi16('&');
+    const __m128i quot = _mm_set1_epi16('"');
+    const __m128i apos = _mm_set1_epi16('\'');
+    const __m128i brace = _mm_set1_epi16('{');
+    const __m128i star = _mm_set1_epi16('*');
+    const __m128i colon = _mm_set1_epi16(':');
+    const bool markup = mask & Markup;
+
+    while (end - p >= 8) {
+        __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        __m128i hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi16(chars, lt),
+                                                 _mm_cmpeq_epi16(chars, gt)),
+                                    _mm_or_si128(_mm_cmpeq_epi16(chars, amp),
+                                                 _mm_or_si128(_mm_cmpeq_epi16(chars, quot),
+                                                              _mm_cmpeq_epi16(chars, apos))));
+        if (markup) {
+            hits = _mm_or_si128(hits,
+                                _mm_or_si128(_mm_cmpeq_epi16(chars, brace),
+                                             _mm_or_si128(_mm_cmpeq_epi16(chars, star),
+                                                          _mm_cmpeq_epi16(chars, colon))));
+        }
+        if (_mm_movemask_epi8(hits)) {
+            break;
+        }
+        p += 8;
+    }
+#else
+    // По четыре символа за шаг: в обычном тексте проверка почти всегда
+    // проходит, и ветвление на каждом символе не нужно
+    while (end - p >= 4) {
+        ushort c0 = p[0].unicode();
+        ushort c1 = p[1].unicode();
+        ushort c2 = p[2].unicode();
+        ushort c3 = p[3].unicode();
+        bool special = (c0 < 128 && (charTable.classes[c0] & mask))
+                | (c1 < 128 && (charTable.classes[c1] & mask))
+                | (c2 < 128 && (charTable.classes[c2] & mask))
+                | (c3 < 128 && (charTable.classes[c3] & mask));
+        if (special) {
+            break;
+        }
+        p += 4;
+    }
+#endif
+
+    while (p < end) {
+        ushort c = p->unicode();
+        if (c < 128 && (charTable.classes[c] & mask)) {
+            break;
+        }
+        p++;
+    }
+
+    return p;
+}
+
+inline bool isAsciiLetter(ushort c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+inline bool isAsciiDigit(ushort c)
+{
+    return c >= '0' && c <= '9';
+}
+
+inline bool isHexDigit(ushort c)
+{
+    return isAsciiDigit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+inline bool isTrailingPunctuation(ushort c)
+{
+    return c == '.' || c == ',' || c == ':' || c == '!' || c == '?' || c == ')';
+}
+
+// Длина готовой сущности &name; &#NNN; или &#xHHH; с позиции p, иначе 0
+int entityLength(const QChar *p, const QChar *end)
+{
+    const QChar *q = p + 1;
+
+    if (q < end && *q == QLatin1Char('#')) {
+        q++;
+        bool hex = q < end && (*q == QLatin1Char('x') || *q == QLatin1Char('X'));
+        if (hex) {
+            q++;
+        }
+
+        const QChar *digits = q;
+        while (q < end && q - digits < 7
+               && (hex ? isHexDigit(q->unicode()) : isAsciiDigit(q->unicode()))) {
+            q++;
+        }
+        if (q == digits) {
+            return 0;
+        }
+    }
+    else {
+        const QChar *name = q;
+        while (q < end && q - name < 8 && isAsciiLetter(q->unicode())) {
+            q++;
+        }
+        if (q - name < 2) {
+            return 0;
+        }
+    }
+
+    return q < end && *q == QLatin1Char(';') ? int(q - p + 1) : 0;
+}
+
+void appendEscaped(ushort c, QString &out)
+{
+    switch (c) {
+    case '<':
+        out += QLatin1String("&lt;");
+        break;
+    case '>':
+        out += QLatin1String("&gt;");
+        break;
+    case '&':
+        out += QLatin1String("&amp;");
+        break;
+    case '"':
+        out += QLatin1String("&quot;");
+        break;
+    case '\'':
+        out += QLatin1String("&#39;");
+        break;
+    default:
+        out += QChar(c);
+    }
+}
+
+// Сравнение без учёта регистра с ASCII-строкой в нижнем регистре
+bool startsWith(const QChar *p, const QChar *end, const char *latin)
+{
+    for (; *latin; latin++, p++) {
+        if (p == end) {
+            return false;
+        }
+        ushort c = p->unicode();
+        if (c >= 'A' && c <= 'Z') {
+            c += 'a' - 'A';
+        }
+        if (c != ushort(uchar(*latin))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Разрешённый тег с позиции '<': возвращает его длину, иначе 0
+int tagLength(const QChar *p, const QChar *end, const char **html)
+{
+    static const struct {
+        const char *tag;
+        const char *html;
+    } tags[] = {
+        { "<b>", "<b>" },
+        { "</b>", "</b>" },
+        { "<br>", "<br>" },
+        { "<br/>", "<br>" },
+        { "<br />", "<br>" }
+    };
+
+    for (const auto &tag : tags) {
+        if (startsWith(p, end, tag.tag)) {
+            *html = tag.html;
+            return int(qstrlen(tag.tag));
+        }
+    }
+    return 0;
+}
+
+// Длина схемы http/https, заканчивающейся перед ':' в позиции colon.
+// Схема должна целиком лежать в [run, colon) и начинаться не внутри слова
+int schemeLength(const QChar *begin, const QChar *run, const QChar *colon)
+{
+    for (int length : { 5, 4 }) {
+        const QChar *scheme = colon - length;
+        if (scheme < run) {
+            continue;
+        }
+        if (!startsWith(scheme, colon, length == 5 ? "https" : "http")) {
+            continue;
+        }
+        if (scheme > begin && scheme[-1].isLetterOrNumber()) {
+            return 0;
+        }
+        return length;
+    }
+    return 0;
+}
+
+} // namespace
+
+QString MarkupRenderer::render(QStringView text)
+{
+    QString out;
+    render(text, out);
+    return out;
+}
+
+void MarkupRenderer::render(QStringView text, QString &out)
+{
+    const QChar *begin = text.data();
+    const QChar *end = begin + text.size();
+    const QChar *p = begin;
+
+    int boldDepth = 0; // открытые <b>
+    bool starBold = false; // открытый **
+
+    // Экранирование удлиняет текст редко и ненамного
+    out.reserve(out.size() + text.size() + text.size() / 8 + 16);
+
+    while (p < end) {
+        const QChar *run = p;
+        p = skipPlain(p, end, Markup);
+
+        // Схема ссылки уже попала в отрезок - выводим его без неё
+        if (p < end && *p == QLatin1Char(':') && end - p >= 3
+                && p[1] == QLatin1Char('/') && p[2] == QLatin1Char('/')) {
+            int scheme = schemeLength(begin, run, p);
+            if (scheme > 0) {
+                out.append(run, int(p - run) - scheme);
+
+                const QChar *url = p - scheme;
+                const QChar *q = p + 3;
+                while (q < end) {
+                    ushort c = q->unicode();
+                    if (QChar::isSpace(c) || c == '<' || c == '>' || c == '"' || c == '\'') {
+                        break;
+                    }
+                    // Экранированные сервером кавычки и скобки тоже завершают ссылку
+                    if (c == '&') {
+                        int entity = entityLength(q, end);
+                        if (entity > 0 && !startsWith(q, end, "&amp;")) {
+                            break;
+                        }
+                    }
+                    q++;
+                }
+
+                // Знаки препинания в конце обычно относятся к предложению
+                while (q > p + 3 && isTrailingPunctuation(q[-1].unicode())) {
+                    q--;
+                }
+
+                if (q == p + 3) {
+                    out.append(url, int(q - url));
+                }
+                else {
+                    QStringView link(url, int(q - url));
+                    out += QLatin1String("<a href=\"");
+                    escape(link, out);
+                    out += QLatin1String("\">");
+                    escape(link, out);
+                    out += QLatin1String("</a>");
+                }
+
+                p = q;
+                continue;
+            }
+        }
+
+        out.append(run, int(p - run));
+        if (p == end) {
+            break;
+        }
+
+        ushort c = p->unicode();
+        switch (c) {
+        case '<': {
+            const char *html = nullptr;
+            int length = tagLength(p, end, &html);
+            if (length == 0) {
+                out += QLatin1String("&lt;");
+                p++;
+                break;
+            }
+
+            if (qstrcmp(html, "<b>") == 0) {
+                boldDepth++;
+            }
+            else if (qstrcmp(html, "</b>") == 0) {
+                // Закрываем только то, что открыто
+                if (boldDepth == 0) {
+                    out += QLatin1String("&lt;");
+                    p++;
+                    break;
+                }
+                boldDepth--;
+            }
+            out += QLatin1String(html);
+            p += length;
+            break;
+        }
+        case '&': {
+            int length = entityLength(p, end);
+            if (length > 0) {
+                out.append(p, length);
+                p += length;
+            }
+            else {
+                out += QLatin1String("&amp;");
+                p++;
+            }
+            break;
+        }
+        case '{': {
+            const QChar *q = p + 1;
+            while (q < end && q - p <= MaxMentionLength
+                   && *q != QLatin1Char('}') && *q != QLatin1Char('{')
+                   && *q != QLatin1Char('<') && *q != QLatin1Char('\n')) {
+                q++;
+            }
+
+            QStringView name = q < end && *q == QLatin1Char('}')
+                    ? QStringView(p + 1, int(q - p - 1)).trimmed()
+                    : QStringView();
+            if (name.isEmpty()) {
+                out += QLatin1Char('{');
+                p++;
+                break;
+            }
+
+            out += QLatin1String("<b>");
+            escape(name, out);
+            out += QLatin1String("</b>");
+            p = q + 1;
+            break;
+        }
+        case '*':
+            if (end - p >= 2 && p[1] == QLatin1Char('*')) {
+                out += starBold ? QLatin1String("</b>") : QLatin1String("<b>");
+                starBold = !starBold;
+                p += 2;
+            }
+            else {
+                out += QLatin1Char('*');
+                p++;
+            }
+            break;
+        case ':':
+            out += QLatin1Char(':');
+            p++;
+            break;
+        default:
+            appendEscaped(c, out);
+            p++;
+        }
+    }
+
+    if (starBold) {
+        boldDepth++;
+    }
+    while (boldDepth-- > 0) {
+        out += QLatin1String("</b>");
+    }
+}
+
+QString MarkupRenderer::escape(QStringView text)
+{
+    QString out;
+    escape(text, out);
+    return out;
+}
+
+void MarkupRenderer::escape(QStringView text, QString &out)
+{
+    const QChar *p = text.data();
+    const QChar *end = p + text.size();
+
+    out.reserve(out.size() + text.size() + 16);
+
+    while (p < end) {
+        const QChar *run = p;
+        p = skipPlain(p, end, Escape);
+        out.append(run, int(p - run));
+        if (p == end) {
+            break;
+        }
+
+        int length = p->unicode() == '&' ? entityLength(p, end) : 0;
+        if (length > 0) {
+            out.append(p, length);
+            p += length;
+        }
+        else {
+            appendEscaped(p->unicode(), out);
+            p++;
+        }
+    }
+}
+
+QString MarkupRenderer::color(const QString &value, const QString &fallback)
+{
+    const QChar *p = value.constData();
+    int size = value.size();
+
+    if (size > 0 && p[0] == QLatin1Char('#')) {
+        if (size != 4 && size != 7 && size != 9) {
+            return fallback;
+        }
+        for (int i = 1; i < size; i++) {
+            if (!isHexDigit(p[i].unicode())) {
+                return fallback;
+            }
+        }
+        return value;
+    }
+
+    if (size == 0 || size > 24) {
+        return fallback;
+    }
+    for (int i = 0; i < size; i++) {
+        if (!isAsciiLetter(p[i].unicode())) {
+            return fallback;
+        }
+    }
+    return value;
+}
@@ -0,0 +1,63 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef MARKUPRENDERER_H
+#define MARKUPRENDERER_H
+
+#include <QString>
+#include <QStringView>
+
+// Превращение текста сообщения в HTML журнала.
+// Текст от сервера считается недоверенным: всё, кроме небольшого набора
+// разметки, экранируется. Поддерживаются:
+//   <b>...</b> и **...** - жирный текст;
+//   {имя} - упоминание, которое вставляет клик по имени;
+//   http:// и https:// - ссылки;
+//   <br> - перевод строки;
+//   готовые сущности &lt; &#39; и т.п. - остаются как есть, поэтому текст,
+//   уже экранированный сервером, не экранируется второй раз.
+// Текст просматривается один раз. Отрезки без особых символов определяются
+// по таблице и копируются целиком, теги в результате всегда сбалансированы.
+class MarkupRenderer
+{
+public:
+    static QString render(QStringView text);
+    static void render(QStringView text, QString &out);
+
+    // Только экранирование, без разметки - для имён и т.п.
+    static QString escape(QStringView text);
+    static void escape(QStringView text, QString &out);
+
+    // Цвет для атрибута style: #rgb, #rrggbb, #aarrggbb или имя цвета.
+    // Любое другое значение заменяется цветом по умолчанию
+    static QString color(const QString &value,
+                         const QString &fallback = QStringLiteral("#34495e"));
+
+    static const int MaxMentionLength = 64;
+};
+
+#endif // MARKUPRENDERER_H
@@ -0,0 +1,105 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "memorydialog.h"
+#include "ui_memorydialog.h"
+
+#include <QHeaderView>
+
+namespace {
+
+QString formatBytes(qint64 bytes)
+{
+    if (bytes < 1024 * 1024) {
+        return QString("%1 КБ").arg(bytes / 1024.0, 0, 'f', 1);
+    }
+    return QString("%1 МБ").arg(bytes / (1024.0 * 1024.0), 0, 'f', 1);
+}
+
+} // namespace
+
+MemoryDialog::MemoryDialog(QWidget *parent) :
+    QDialog(parent),
+    ui(new Ui::MemoryDialog)
+{
+    ui->setupUi(this);
+
+    ui->tableWidget_usage->setColumnCount(8);
+    ui->tableWidget_usage->setHorizontalHeaderLabels(QStringList()
+            << "Сессия" << "Журнал" << "Строк" << "Вытеснено"
+            << "Список" << "Вёрстка" << "В очереди" << "Всего");
+    ui->tableWidget_usage->horizontalHeader()->setSectionResizeMode(0, QHeaderView::Stretch);
+}
+
+MemoryDialog::~MemoryDialog()
+{
+    delete ui;
+}
+
+void MemoryDialog::setUsage(const QVector<Row> &rows, qint64 budget, quint64 trimmed)
+{
+    ui->tableWidget_usage->setRowCount(rows.size());
+
+    qint64 total = 0;
+    for (int i = 0; i < rows.size(); i++) {
+        const Widget::MemoryUsage &usage = rows.at(i).usage;
+        qint64 sessionTotal = usage.log + usage.roster + usage.cache + usage.pending;
+        total += sessionTotal;
+
+        QString evicted = QString::number(usage.evicted);
+        if (usage.evicted > 0) {
+            evicted += usage.history ? " (в истории)" : " (удалено)";
+        }
+
+        const QString cells[] = {
+            rows.at(i).session,
+            formatBytes(usage.log),
+            QString::number(usage.lines),
+            evicted,
+            formatBytes(usage.roster),
+            formatBytes(usage.cache),
+            formatBytes(usage.pending),
+            formatBytes(sessionTotal)
+        };
+
+        for (int column = 0; column < 8; column++) {
+            QTableWidgetItem *item = ui->tableWidget_usage->item(i, column);
+            if (!item) {
+                item = new QTableWidgetItem;
+                ui->tableWidget_usage->setItem(i, column, item);
+            }
+            item->setText(cells[column]);
+        }
+    }
+
+    ui->label_total->setText(budget > 0
+            ? QString("Всего: %1 из %2, освобождено по бюджету: %3")
+              .arg(formatBytes(total))
+              .arg(formatBytes(budget))
+              .arg(formatBytes(qint64(trimmed)))
+            : QString("Всего: %1, бюджет не ограничен").arg(formatBytes(total)));
+}
@@ -0,0 +1,62 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef MEMORYDIALOG_H
+#define MEMORYDIALOG_H
+
+#include <QDialog>
+#include <QVector>
+
+#include "widget.h"
+
+namespace Ui {
+class MemoryDialog;
+}
+
+// Диагностика памяти: сколько держит каждая сессия и сколько всего
+// относительно бюджета. Данные приносит SessionWindow раз в секунду.
+class MemoryDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    struct Row
+    {
+        QString session;
+        Widget::MemoryUsage usage;
+    };
+
+    explicit MemoryDialog(QWidget *parent = nullptr);
+    ~MemoryDialog();
+
+    void setUsage(const QVector<Row> &rows, qint64 budget, quint64 trimmed);
+
+private:
+    Ui::MemoryDialog *ui;
+};
+
+#endif // MEMORYDIALOG_H
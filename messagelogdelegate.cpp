@@ -0,0 +1,141 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "messagelogdelegate.h"
+#include "messagelogmodel.h"
+#include "trace.h"
+
+#include <QAbstractTextDocumentLayout>
+#include <QPainter>
+#include <QTextDocument>
+#include <QtMath>
+
+// Сколько памяти отдаём свёрстанным строкам. С запасом покрывает
+// несколько экранов, остальные строки хранятся только как HTML.
+static const int MaxCachedBytes = 4 * 1024 * 1024;
+
+// Грубая оценка памяти свёрстанного документа: сам документ с вёрсткой
+// и фрагменты текста с форматами
+static int documentCost(const QString &html)
+{
+    return 2048 + html.size() * 32;
+}
+
+MessageLogDelegate::MessageLogDelegate(QObject *parent) :
+    QStyledItemDelegate(parent),
+    m_textWidth(400),
+    m_documents(MaxCachedBytes)
+{
+}
+
+void MessageLogDelegate::paint(QPainter *painter,
+                               const QStyleOptionViewItem &option,
+                               const QModelIndex &index) const
+{
+    TRACE_SCOPE("paint", "render");
+
+    QTextDocument *doc = document(index, option);
+
+    painter->save();
+    painter->translate(option.rect.topLeft());
+    painter->setClipRect(QRect(QPoint(0, 0), option.rect.size()));
+
+    QAbstractTextDocumentLayout::PaintContext context;
+    context.palette = option.palette;
+    doc->documentLayout()->draw(painter, context);
+
+    painter->restore();
+}
+
+QSize MessageLogDelegate::sizeHint(const QStyleOptionViewItem &option,
+                                   const QModelIndex &index) const
+{
+    const MessageLogModel *model = qobject_cast<const MessageLogModel *>(index.model());
+
+    if (model) {
+        int height = model->cachedHeight(index.row(), m_textWidth);
+        if (height >= 0) {
+            return QSize(m_textWidth, height);
+        }
+    }
+
+    TRACE_SCOPE("layout", "render");
+    int height = qCeil(document(index, option)->size().height());
+
+    if (model) {
+        model->cacheHeight(index.row(), m_textWidth, height);
+    }
+
+    return QSize(m_textWidth, height);
+}
+
+QString MessageLogDelegate::anchorAt(const QModelIndex &index,
+                                     const QStyleOptionViewItem &option,
+                                     const QPoint &pos) const
+{
+    QTextDocument *doc = document(index, option);
+    return doc->documentLayout()->anchorAt(pos - option.rect.topLeft());
+}
+
+void MessageLogDelegate::setTextWidth(int width)
+{
+    m_textWidth = width;
+}
+
+void MessageLogDelegate::clearCache()
+{
+    m_documents.clear();
+}
+
+qint64 MessageLogDelegate::cacheBytes() const
+{
+    return m_documents.totalCost();
+}
+
+QTextDocument *MessageLogDelegate::document(const QModelIndex &index,
+                                            const QStyleOptionViewItem &option) const
+{
+    quint64 id = index.data(MessageLogModel::MessageIdRole).toULongLong();
+
+    QTextDocument *doc = m_documents.object(id);
+    if (!doc) {
+        TRACE_SCOPE("parse html", "render");
+        doc = new QTextDocument;
+        doc->setDefaultFont(option.font);
+        doc->setDocumentMargin(2);
+        QString html = index.data(MessageLogModel::HtmlRole).toString();
+        doc->setHtml(html);
+        // Документ дороже всего кэша QCache удалил бы сразу при вставке
+        m_documents.insert(id, doc, qMin(documentCost(html), MaxCachedBytes));
+    }
+
+    if (doc->textWidth() != m_textWidth) {
+        doc->setTextWidth(m_textWidth);
+    }
+
+    return doc;
+}
@@ -0,0 +1,68 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef MESSAGELOGDELEGATE_H
+#define MESSAGELOGDELEGATE_H
+
+#include <QStyledItemDelegate>
+#include <QCache>
+
+class QTextDocument;
+
+// Делегат журнала сообщений.
+// Размечает HTML строки только тогда, когда вид запрашивает её размер или
+// отрисовку, и держит свёрстанные документы лишь для недавно видимых строк.
+class MessageLogDelegate : public QStyledItemDelegate
+{
+    Q_OBJECT
+
+public:
+    explicit MessageLogDelegate(QObject *parent = nullptr);
+
+    void paint(QPainter *painter,
+               const QStyleOptionViewItem &option,
+               const QModelIndex &index) const override;
+    QSize sizeHint(const QStyleOptionViewItem &option,
+                   const QModelIndex &index) const override;
+
+    QString anchorAt(const QModelIndex &index,
+                     const QStyleOptionViewItem &option,
+                     const QPoint &pos) const;
+
+    void setTextWidth(int width);
+    void clearCache();
+    qint64 cacheBytes() const; // оценка памяти свёрстанных строк
+
+private:
+    QTextDocument *document(const QModelIndex &index,
+                            const QStyleOptionViewItem &option) const;
+
+    int m_textWidth;
+    mutable QCache<quint64, QTextDocument> m_documents;
+};
+
+#endif // MESSAGELOGDELEGATE_H
@@ -0,0 +1,213 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "messagelogmodel.h"
+
+#include <algorithm>
+
+MessageLogModel::MessageLogModel(int capacity, QObject *parent) :
+    QAbstractListModel(parent),
+    m_first(0),
+    m_count(0),
+    m_capacity(qMax(1, capacity)),
+    m_nextId(1),
+    m_bytes(0),
+    m_evicted(0)
+{
+}
+
+int MessageLogModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : m_count;
+}
+
+QVariant MessageLogModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= m_count) {
+        return QVariant();
+    }
+
+    const Entry &entry = m_ring.at(slot(index.row()));
+
+    switch (role) {
+    case Qt::DisplayRole:
+    case HtmlRole:
+        return entry.html;
+    case MessageIdRole:
+        return entry.id;
+    default:
+        return QVariant();
+    }
+}
+
+int MessageLogModel::capacity() const
+{
+    return m_capacity;
+}
+
+void MessageLogModel::setCapacity(int capacity)
+{
+    capacity = qMax(1, capacity);
+
+    if (m_count > capacity) {
+        evict(m_count - capacity);
+    }
+
+    // Разворачиваем кольцо в линейный массив нового размера
+    QVector<Entry> ring;
+    ring.reserve(qMin(capacity, 1024));
+    for (int i = 0; i < m_count; i++) {
+        ring.append(m_ring.at(slot(i)));
+    }
+
+    m_ring.swap(ring);
+    m_first = 0;
+    m_capacity = capacity;
+}
+
+void MessageLogModel::append(const QString &html)
+{
+    append(QStringList(html));
+}
+
+void MessageLogModel::append(const QStringList &lines)
+{
+    // Из пачки больше лимита имеет смысл хранить только хвост
+    int skip = qMax(0, lines.size() - m_capacity);
+    int n = lines.size() - skip;
+    if (n == 0) {
+        return;
+    }
+
+    // Пока кольцо не заполнено, его можно нарастить. Вытеснение по бюджету
+    // памяти сдвигает начало и раньше, поэтому сперва разворачиваем кольцо,
+    // чтобы живые строки лежали с нуля и не попали под изменение размера.
+    if (m_ring.size() < m_capacity) {
+        if (m_first != 0) {
+            std::rotate(m_ring.begin(), m_ring.begin() + m_first, m_ring.end());
+            m_first = 0;
+        }
+        m_ring.resize(qMax(m_ring.size(), qMin(m_capacity, m_count + n)));
+    }
+
+    int overflow = m_count + n - m_capacity;
+    if (overflow > 0) {
+        evict(overflow);
+    }
+
+    beginInsertRows(QModelIndex(), m_count, m_count + n - 1);
+
+    for (int i = skip; i < lines.size(); i++) {
+        Entry &entry = m_ring[slot(m_count)];
+        entry.id = m_nextId++;
+        entry.html = lines.at(i);
+        entry.width = -1;
+        m_bytes += entryBytes(entry.html);
+        entry.height = 0;
+        m_count++;
+    }
+
+    endInsertRows();
+}
+
+void MessageLogModel::clear()
+{
+    beginResetModel();
+    m_ring.clear();
+    m_first = 0;
+    m_count = 0;
+    m_bytes = 0;
+    endResetModel();
+}
+
+qint64 MessageLogModel::bytes() const
+{
+    return m_bytes + qint64(m_ring.capacity()) * qint64(sizeof(Entry));
+}
+
+qint64 MessageLogModel::evictBytes(qint64 bytes, int keep)
+{
+    // Сначала считаем, сколько строк нужно, затем удаляем их одной операцией
+    qint64 freed = 0;
+    int count = 0;
+    while (freed < bytes && m_count - count > keep) {
+        freed += entryBytes(m_ring.at(slot(count)).html);
+        count++;
+    }
+
+    if (count == 0) {
+        return 0;
+    }
+    return evict(count);
+}
+
+quint64 MessageLogModel::evictedCount() const
+{
+    return m_evicted;
+}
+
+int MessageLogModel::cachedHeight(int row, int width) const
+{
+    const Entry &entry = m_ring.at(slot(row));
+    return entry.width == width ? entry.height : -1;
+}
+
+void MessageLogModel::cacheHeight(int row, int width, int height) const
+{
+    const Entry &entry = m_ring.at(slot(row));
+    entry.width = width;
+    entry.height = height;
+}
+
+int MessageLogModel::slot(int row) const
+{
+    return (m_first + row) % m_ring.size();
+}
+
+qint64 MessageLogModel::evict(int count)
+{
+    qint64 freed = 0;
+
+    beginRemoveRows(QModelIndex(), 0, count - 1);
+    for (int i = 0; i < count; i++) {
+        freed += entryBytes(m_ring.at(m_first).html);
+        m_ring[m_first].html = QString(); // освобождаем память сразу
+        m_first = (m_first + 1) % m_ring.size();
+    }
+    m_count -= count;
+    m_bytes -= freed;
+    m_evicted += count;
+    endRemoveRows();
+
+    return freed;
+}
+
+qint64 MessageLogModel::entryBytes(const QString &html)
+{
+    // Данные строки и заголовок её буфера
+    return qint64(html.capacity()) * qint64(sizeof(QChar)) + 24;
+}
@@ -0,0 +1,100 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef MESSAGELOGMODEL_H
+#define MESSAGELOGMODEL_H
+
+#include <QAbstractListModel>
+#include <QVector>
+#include <QStringList>
+
+// Журнал сообщений чата.
+// Хранит строки в кольцевом буфере ограниченного размера: при достижении
+// лимита самая старая строка вытесняется, поэтому добавление стоит O(1)
+// и память не растёт бесконечно, сколько бы ни длилась сессия.
+// Модель ведёт счёт занятых строками байт, и старые строки можно
+// вытеснить раньше лимита, если превышен общий бюджет памяти.
+class MessageLogModel : public QAbstractListModel
+{
+    Q_OBJECT
+
+public:
+    enum Role {
+        HtmlRole = Qt::UserRole + 1,
+        MessageIdRole
+    };
+
+    explicit MessageLogModel(int capacity = 5000, QObject *parent = nullptr);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+
+    int capacity() const;
+    void setCapacity(int capacity);
+
+    void append(const QString &html);
+    void append(const QStringList &lines);
+    void clear();
+
+    // Оценка памяти, занятой строками журнала, байт
+    qint64 bytes() const;
+
+    // Вытесняет самые старые строки, пока не освободится bytes байт,
+    // но оставляет не меньше keep строк. Возвращает освобождённое
+    qint64 evictBytes(qint64 bytes, int keep);
+
+    // Сколько строк вытеснено за всё время
+    quint64 evictedCount() const;
+
+    // Кэш высоты строки для делегата: высота зависит только от ширины,
+    // поэтому вёрстка каждой строки выполняется один раз на ширину вида.
+    int cachedHeight(int row, int width) const;
+    void cacheHeight(int row, int width, int height) const;
+
+private:
+    struct Entry
+    {
+        quint64 id;
+        QString html;
+        mutable int width;
+        mutable int height;
+    };
+
+    int slot(int row) const;
+    qint64 evict(int count);
+    static qint64 entryBytes(const QString &html);
+
+    QVector<Entry> m_ring;
+    int m_first;
+    int m_count;
+    int m_capacity;
+    quint64 m_nextId;
+    qint64 m_bytes; // строки, без самого кольца
+    quint64 m_evicted;
+};
+
+#endif // MESSAGELOGMODEL_H
@@ -0,0 +1,133 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "messagelogview.h"
+#include "messagelogdelegate.h"
+
+#include <QMouseEvent>
+#include <QScrollBar>
+
+MessageLogView::MessageLogView(QWidget *parent) :
+    QListView(parent),
+    m_delegate(new MessageLogDelegate(this))
+{
+    setItemDelegate(m_delegate);
+    setSelectionMode(QAbstractItemView::NoSelection);
+    setEditTriggers(QAbstractItemView::NoEditTriggers);
+    setVerticalScrollMode(QAbstractItemView::ScrollPerPixel);
+    setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+    setResizeMode(QListView::Adjust);
+    setWordWrap(true);
+    setMouseTracking(true);
+
+    // Размеры строк считаются порциями между итерациями цикла событий,
+    // поэтому даже полный перерасчёт после изменения ширины не блокирует GUI
+    setLayoutMode(QListView::Batched);
+    setBatchSize(100);
+}
+
+qint64 MessageLogView::cacheBytes() const
+{
+    return m_delegate->cacheBytes();
+}
+
+void MessageLogView::clearCache()
+{
+    m_delegate->clearCache();
+}
+
+void MessageLogView::resizeEvent(QResizeEvent *event)
+{
+    m_delegate->setTextWidth(viewport()->width());
+    QListView::resizeEvent(event);
+}
+
+void MessageLogView::hideEvent(QHideEvent *event)
+{
+    // Скрытый журнал (неактивная вкладка) не держит свёрстанные строки,
+    // при показе видимые строки сверстаются заново
+    m_delegate->clearCache();
+    QListView::hideEvent(event);
+}
+
+void MessageLogView::paintEvent(QPaintEvent *event)
+{
+    QListView::paintEvent(event);
+    emit painted();
+}
+
+void MessageLogView::mouseMoveEvent(QMouseEvent *event)
+{
+    QListView::mouseMoveEvent(event);
+
+    if (anchorAt(event->pos()).isEmpty()) {
+        viewport()->unsetCursor();
+    }
+    else {
+        viewport()->setCursor(Qt::PointingHandCursor);
+    }
+}
+
+void MessageLogView::mouseReleaseEvent(QMouseEvent *event)
+{
+    QListView::mouseReleaseEvent(event);
+
+    if (event->button() != Qt::LeftButton) {
+        return;
+    }
+
+    QString anchor = anchorAt(event->pos());
+    if (!anchor.isEmpty()) {
+        emit anchorClicked(QUrl(anchor));
+    }
+}
+
+void MessageLogView::rowsInserted(const QModelIndex &parent, int start, int end)
+{
+    // Прокручиваем вниз только если пользователь не листает историю
+    QScrollBar *bar = verticalScrollBar();
+    bool atBottom = bar->value() >= bar->maximum();
+
+    QListView::rowsInserted(parent, start, end);
+
+    if (atBottom) {
+        scrollToBottom();
+    }
+}
+
+QString MessageLogView::anchorAt(const QPoint &pos) const
+{
+    QModelIndex index = indexAt(pos);
+    if (!index.isValid()) {
+        return QString();
+    }
+
+    QStyleOptionViewItem option = viewOptions();
+    option.rect = visualRect(index);
+
+    return m_delegate->anchorAt(index, option, pos);
+}
@@ -0,0 +1,68 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef MESSAGELOGVIEW_H
+#define MESSAGELOGVIEW_H
+
+#include <QListView>
+
+class MessageLogDelegate;
+
+// Вид журнала сообщений вместо QTextBrowser.
+// Рисует только видимые строки, сам прокручивается вниз, если пользователь
+// уже находится в конце журнала, и сообщает о кликах по ссылкам.
+class MessageLogView : public QListView
+{
+    Q_OBJECT
+
+public:
+    explicit MessageLogView(QWidget *parent = nullptr);
+
+    qint64 cacheBytes() const;
+    void clearCache();
+
+signals:
+    void anchorClicked(const QUrl &url);
+    void painted();
+
+protected:
+    void resizeEvent(QResizeEvent *event) override;
+    void hideEvent(QHideEvent *event) override;
+    void paintEvent(QPaintEvent *event) override;
+    void mouseMoveEvent(QMouseEvent *event) override;
+    void mouseReleaseEvent(QMouseEvent *event) override;
+
+protected slots:
+    void rowsInserted(const QModelIndex &parent, int start, int end) override;
+
+private:
+    QString anchorAt(const QPoint &pos) const;
+
+    MessageLogDelegate *m_delegate;
+};
+
+#endif // MESSAGELOGVIEW_H
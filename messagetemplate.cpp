@@ -0,0 +1,133 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "messagetemplate.h"
+
+#include <QDateTime>
+
+#include <cstring>
+
+MessageTemplate::MessageTemplate(const QString &pattern) :
+    m_pattern(pattern),
+    m_literalLength(0),
+    m_slotCount(0)
+{
+    const QChar *data = m_pattern.constData();
+    int size = m_pattern.size();
+    int literalBegin = 0;
+
+    auto addLiteral = [&](int end) {
+        if (end > literalBegin) {
+            Segment segment = { literalBegin, end - literalBegin, -1 };
+            m_segments.append(segment);
+            m_literalLength += segment.length;
+        }
+    };
+
+    int i = 0;
+    while (i < size) {
+        // %N, где N от 1 до 99; всё остальное - часть литерала
+        if (data[i] != QLatin1Char('%') || i + 1 >= size
+                || data[i + 1] < QLatin1Char('1') || data[i + 1] > QLatin1Char('9')) {
+            i++;
+            continue;
+        }
+
+        int slot = data[i + 1].unicode() - '0';
+        int end = i + 2;
+        if (end < size && data[end].isDigit()) {
+            slot = slot * 10 + data[end].unicode() - '0';
+            end++;
+        }
+
+        addLiteral(i);
+
+        Segment segment = { 0, 0, slot - 1 };
+        m_segments.append(segment);
+        m_slotCount = qMax(m_slotCount, slot);
+
+        i = end;
+        literalBegin = end;
+    }
+
+    addLiteral(size);
+}
+
+QString MessageTemplate::render(std::initializer_list<QStringView> args) const
+{
+    const QStringView *values = args.begin();
+    int count = int(args.size());
+
+    int length = m_literalLength;
+    foreach (const Segment &segment, m_segments) {
+        if (segment.slot >= 0 && segment.slot < count) {
+            length += int(values[segment.slot].size());
+        }
+    }
+
+    QString result(length, Qt::Uninitialized);
+    QChar *out = result.data();
+    const QChar *pattern = m_pattern.constData();
+
+    foreach (const Segment &segment, m_segments) {
+        if (segment.slot < 0) {
+            memcpy(out, pattern + segment.begin, size_t(segment.length) * sizeof(QChar));
+            out += segment.length;
+        }
+        else if (segment.slot < count) {
+            const QStringView &value = values[segment.slot];
+            memcpy(out, value.data(), size_t(value.size()) * sizeof(QChar));
+            out += value.size();
+        }
+    }
+
+    return result;
+}
+
+int MessageTemplate::slotCount() const
+{
+    return m_slotCount;
+}
+
+TimestampCache::TimestampCache() :
+    m_second(-1)
+{
+}
+
+QString TimestampCache::format(qint64 msecs)
+{
+    qint64 second = msecs / 1000;
+    if (second != m_second) {
+        static const MessageTemplate html(QStringLiteral("<span style='color:#34495e'><b>[%1]</b></span>"));
+
+        QString time = QDateTime::fromMSecsSinceEpoch(second * 1000).toString("dd.MM.yyyy HH:mm:ss");
+        m_html = html.render({ time });
+        m_second = second;
+    }
+
+    return m_html;
+}
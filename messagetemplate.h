@@ -0,0 +1,81 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef MESSAGETEMPLATE_H
+#define MESSAGETEMPLATE_H
+
+#include <QString>
+#include <QStringView>
+#include <QVector>
+
+#include <initializer_list>
+
+// Заранее разобранный шаблон строки журнала.
+// Шаблон с подстановками %1..%99 разбирается один раз на куски
+// "литерал" и "слот". При заполнении сначала считается итоговая длина,
+// затем все куски копируются в одну заранее выделенную строку - без
+// промежуточных строк и повторного просмотра шаблона, как в цепочке arg().
+// Заодно значение, содержащее "%2", больше не подменяется следующим arg().
+class MessageTemplate
+{
+public:
+    explicit MessageTemplate(const QString &pattern);
+
+    QString render(std::initializer_list<QStringView> args) const;
+
+    int slotCount() const;
+
+private:
+    struct Segment
+    {
+        int begin; // начало литерала в m_pattern
+        int length;
+        int slot; // номер аргумента или -1 для литерала
+    };
+
+    QString m_pattern;
+    QVector<Segment> m_segments;
+    int m_literalLength; // суммарная длина литералов
+    int m_slotCount;
+};
+
+// Кэш отметки времени строки журнала.
+// Сообщения одной секунды получают одну и ту же уже готовую строку,
+// а QDateTime::toString() вызывается только при смене секунды.
+class TimestampCache
+{
+public:
+    TimestampCache();
+
+    QString format(qint64 msecs);
+
+private:
+    qint64 m_second; // секунда с начала эпохи, для которой готов m_html
+    QString m_html;
+};
+
+#endif // MESSAGETEMPLATE_H
@@ -0,0 +1,142 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "presenceaggregator.h"
+
+#include <QStringList>
+
+PresenceAggregator::PresenceAggregator() :
+    m_count(0),
+    m_joined(0),
+    m_left(0),
+    m_lost(0)
+{
+}
+
+void PresenceAggregator::add(const ChatEvent &event)
+{
+    if (m_count++ == 0) {
+        m_first = event;
+    }
+
+    if (event.type == ChatEvent::Connected) {
+        m_joined++;
+
+        ChatUser user;
+        user.userId = event.userId;
+        user.userName = event.userName;
+        user.gender = event.gender;
+        user.userColor = event.userColor;
+
+        m_joinRows.insert(user.userId, m_joins.size());
+        m_joins.append(user);
+        return;
+    }
+
+    if (event.type == ChatEvent::ConnectionLost) {
+        m_lost++;
+    }
+    else {
+        m_left++;
+    }
+
+    // Вошёл и вышел в этом же окне - в списке его ещё нет
+    QHash<int, int>::iterator it = m_joinRows.find(event.userId);
+    if (it != m_joinRows.end()) {
+        m_joins[it.value()].userId = 0;
+        m_joinRows.erase(it);
+        return;
+    }
+
+    m_leaves.append(event.userId);
+}
+
+void PresenceAggregator::clear()
+{
+    m_first = ChatEvent();
+    m_count = 0;
+    m_joined = 0;
+    m_left = 0;
+    m_lost = 0;
+    m_joins.clear();
+    m_joinRows.clear();
+    m_leaves.clear();
+}
+
+bool PresenceAggregator::isEmpty() const
+{
+    return m_count == 0;
+}
+
+int PresenceAggregator::count() const
+{
+    return m_count;
+}
+
+const ChatEvent &PresenceAggregator::first() const
+{
+    return m_first;
+}
+
+QVector<ChatUser> PresenceAggregator::joins() const
+{
+    QVector<ChatUser> users;
+    users.reserve(m_joinRows.size());
+
+    foreach (const ChatUser &user, m_joins) {
+        if (user.userId != 0) {
+            users.append(user);
+        }
+    }
+
+    return users;
+}
+
+QVector<int> PresenceAggregator::leaves() const
+{
+    return m_leaves;
+}
+
+QString PresenceAggregator::summary() const
+{
+    QStringList parts;
+    if (m_joined > 0) {
+        parts << QString("вошли: %1").arg(m_joined);
+    }
+    if (m_left > 0) {
+        parts << QString("вышли: %1").arg(m_left);
+    }
+    if (m_lost > 0) {
+        parts << QString("потеряли соединение: %1").arg(m_lost);
+    }
+
+    QString text = parts.join(", ");
+    if (!text.isEmpty()) {
+        text[0] = text.at(0).toUpper();
+    }
+    return text;
+}
@@ -0,0 +1,74 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef PRESENCEAGGREGATOR_H
+#define PRESENCEAGGREGATOR_H
+
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+#include "chatevent.h"
+
+// Свёртка входов и выходов пользователей.
+// Пока идёт шквал событий присутствия (например, после перезапуска
+// сервера), они копятся здесь, а затем применяются к списку одной пачкой
+// и показываются в журнале одной строкой. Вошедший и вышедший в пределах
+// одного окна пользователь список не меняет вовсе.
+class PresenceAggregator
+{
+public:
+    PresenceAggregator();
+
+    // Connected, Disconnected или ConnectionLost
+    void add(const ChatEvent &event);
+    void clear();
+
+    bool isEmpty() const;
+    int count() const; // сколько событий свёрнуто
+    const ChatEvent &first() const;
+
+    // Итоговое изменение списка пользователей
+    QVector<ChatUser> joins() const;
+    QVector<int> leaves() const;
+
+    // "Вошли: 42, вышли: 17, потеряли соединение: 3"
+    QString summary() const;
+
+private:
+    ChatEvent m_first; // показывается как есть, если событие одно
+    int m_count;
+    int m_joined;
+    int m_left;
+    int m_lost;
+
+    QVector<ChatUser> m_joins; // в порядке входа; userId 0 - вход отменён выходом
+    QHash<int, int> m_joinRows; // userId -> позиция в m_joins
+    QVector<int> m_leaves;
+};
+
+#endif // PRESENCEAGGREGATOR_H
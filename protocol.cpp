@@ -0,0 +1,863 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "protocol.h"
+
+#include <QCborArray>
+#include <QCborMap>
+#include <QCborStreamReader>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include <limits>
+
+namespace {
+
+// Какие строковые поля нужны каждому действию
+enum Field {
+    FieldUserName = 0x1,
+    FieldUserColor = 0x2,
+    FieldText = 0x4,
+    FieldUsers = 0x8
+};
+
+struct ActionInfo
+{
+    const char *name;
+    int length;
+    ChatEvent::Type type;
+    int fields;
+    int code; // код действия в CBOR-кадре
+};
+
+const ActionInfo Actions[] = {
+    { "Ping", 4, ChatEvent::Ping, 0,
+      Protocol::ActionPing },
+    { "PublicMessage", 13, ChatEvent::PublicMessage, FieldUserName | FieldUserColor | FieldText,
+      Protocol::ActionPublicMessage },
+    { "PrivateMessage", 14, ChatEvent::PrivateMessage, FieldUserName | FieldUserColor | FieldText,
+      Protocol::ActionPrivateMessage },
+    { "Connected", 9, ChatEvent::Connected, FieldUserName | FieldUserColor,
+      Protocol::ActionConnected },
+    { "Disconnected", 12, ChatEvent::Disconnected, FieldUserName | FieldUserColor,
+      Protocol::ActionDisconnected },
+    { "ConnectionLost", 14, ChatEvent::ConnectionLost, FieldUserName | FieldUserColor,
+      Protocol::ActionConnectionLost },
+    { "Authorized", 10, ChatEvent::Authorized, FieldUserName | FieldUsers,
+      Protocol::ActionAuthorized },
+    { "Resynced", 8, ChatEvent::Resynced, FieldUserName,
+      Protocol::ActionResynced }
+};
+
+const int ActionCount = int(sizeof(Actions) / sizeof(Actions[0]));
+
+int hexValue(ushort c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return 0;
+}
+
+// Участок исходной строки. Строка с escape-последовательностями
+// раскодируется только при обращении к ней.
+struct Span
+{
+    Span() : begin(nullptr), length(0), escaped(false) {}
+
+    const QChar *begin;
+    int length;
+    bool escaped;
+
+    bool equals(const char *literal, int literalLength) const
+    {
+        if (length != literalLength || escaped) {
+            return false;
+        }
+        for (int i = 0; i < length; i++) {
+            if (begin[i].unicode() != ushort(uchar(literal[i]))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    QString toString() const
+    {
+        if (!escaped) {
+            return QString(begin, length);
+        }
+
+        QString result;
+        result.reserve(length);
+
+        const QChar *p = begin;
+        const QChar *end = begin + length;
+        while (p < end) {
+            if (*p != QLatin1Char('\\') || p + 1 >= end) {
+                result.append(*p++);
+                continue;
+            }
+
+            ushort c = (++p)->unicode();
+            p++;
+            switch (c) {
+            case 'b': result.append(QChar('\b')); break;
+            case 'f': result.append(QChar('\f')); break;
+            case 'n': result.append(QChar('\n')); break;
+            case 'r': result.append(QChar('\r')); break;
+            case 't': result.append(QChar('\t')); break;
+            case 'u': {
+                // Суррогатные пары остаются парами UTF-16 как есть
+                ushort code = 0;
+                int digits = 0;
+                for (; digits < 4 && p < end; digits++, p++) {
+                    code = ushort((code << 4) | hexValue(p->unicode()));
+                }
+                result.append(QChar(code));
+                break;
+            }
+            default:
+                result.append(QChar(c));
+                break;
+            }
+        }
+
+        return result;
+    }
+};
+
+// Курсор по JSON-тексту. Понимает ровно столько, сколько нужно протоколу,
+// а всё остальное пропускает без разбора.
+class JsonCursor
+{
+public:
+    JsonCursor(const QChar *begin, const QChar *end) :
+        m_pos(begin),
+        m_end(end)
+    {
+    }
+
+    const QChar *pos() const { return m_pos; }
+
+    void skipSpace()
+    {
+        while (m_pos < m_end) {
+            ushort c = m_pos->unicode();
+            if (c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+                break;
+            }
+            m_pos++;
+        }
+    }
+
+    bool peek(char c)
+    {
+        skipSpace();
+        return m_pos < m_end && m_pos->unicode() == ushort(c);
+    }
+
+    bool consume(char c)
+    {
+        if (!peek(c)) {
+            return false;
+        }
+        m_pos++;
+        return true;
+    }
+
+    bool readString(Span &span)
+    {
+        if (!consume('"')) {
+            return false;
+        }
+
+        span.begin = m_pos;
+        span.escaped = false;
+
+        while (m_pos < m_end) {
+            ushort c = m_pos->unicode();
+            if (c == '"') {
+                span.length = int(m_pos - span.begin);
+                m_pos++;
+                return true;
+            }
+            if (c == '\\') {
+                span.escaped = true;
+                m_pos++;
+            }
+            m_pos++;
+        }
+
+        return false;
+    }
+
+    bool readInt(int &value)
+    {
+        qint64 result;
+        if (!readInteger(result)) {
+            return false;
+        }
+        // Как toInt(): значение вне int не урезается до чужого id
+        if (result < std::numeric_limits<int>::min() || result > std::numeric_limits<int>::max()) {
+            return false;
+        }
+        value = int(result);
+        return true;
+    }
+
+    bool readInteger(qint64 &value)
+    {
+        skipSpace();
+        const QChar *start = m_pos;
+
+        bool negative = false;
+        if (m_pos < m_end && m_pos->unicode() == '-') {
+            negative = true;
+            m_pos++;
+        }
+
+        if (m_pos >= m_end || !isDigit(m_pos->unicode())) {
+            return false;
+        }
+
+        qint64 result = 0;
+        while (m_pos < m_end && isDigit(m_pos->unicode())) {
+            int digit = m_pos->unicode() - '0';
+            // Слишком длинное число не влезает в qint64: поле считаем
+            // испорченным, а само значение пропустит skipValue()
+            if (result > (std::numeric_limits<qint64>::max() - digit) / 10) {
+                m_pos = start;
+                return false;
+            }
+            result = result * 10 + digit;
+            m_pos++;
+        }
+
+        // Дробную часть и экспоненту отбрасываем, как это делал toInt()
+        skipScalar();
+
+        value = negative ? -result : result;
+        return true;
+    }
+
+    bool skipValue()
+    {
+        skipSpace();
+        if (m_pos >= m_end) {
+            return false;
+        }
+
+        ushort c = m_pos->unicode();
+        if (c == '"') {
+            Span span;
+            return readString(span);
+        }
+        if (c == '{' || c == '[') {
+            return skipContainer();
+        }
+
+        skipScalar();
+        return true;
+    }
+
+private:
+    static bool isDigit(ushort c)
+    {
+        return c >= '0' && c <= '9';
+    }
+
+    void skipScalar()
+    {
+        while (m_pos < m_end) {
+            ushort c = m_pos->unicode();
+            if (c == ',' || c == '}' || c == ']' || c == ' '
+                    || c == '\t' || c == '\n' || c == '\r') {
+                break;
+            }
+            m_pos++;
+        }
+    }
+
+    bool skipContainer()
+    {
+        int depth = 0;
+        while (m_pos < m_end) {
+            ushort c = m_pos->unicode();
+            if (c == '"') {
+                Span span;
+                if (!readString(span)) {
+                    return false;
+                }
+                continue;
+            }
+            m_pos++;
+            if (c == '{' || c == '[') {
+                depth++;
+            }
+            else if (c == '}' || c == ']') {
+                if (--depth == 0) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    const QChar *m_pos;
+    const QChar *m_end;
+};
+
+// Разбирает поле целого числа; нечисловое значение даёт 0, как toInt()
+bool readIntField(JsonCursor &cursor, int &value)
+{
+    if (cursor.readInt(value)) {
+        return true;
+    }
+    value = 0;
+    return cursor.skipValue();
+}
+
+// Номер события: отрицательный или нечисловой даёт 0
+bool readSequenceField(JsonCursor &cursor, quint64 &value)
+{
+    qint64 result;
+    if (cursor.readInteger(result)) {
+        value = quint64(qMax(qint64(0), result));
+        return true;
+    }
+    value = 0;
+    return cursor.skipValue();
+}
+
+// Разбирает поле строки; null или нестроковое значение даёт пустую строку,
+// как toString(), и не роняет весь кадр
+bool readStringField(JsonCursor &cursor, Span &value)
+{
+    if (cursor.peek('"')) {
+        return cursor.readString(value);
+    }
+    value = Span();
+    return cursor.skipValue();
+}
+
+bool decodeUsers(const QChar *begin, const QChar *end, QVector<ChatUser> &users)
+{
+    JsonCursor cursor(begin, end);
+    if (!cursor.consume('[')) {
+        return false;
+    }
+
+    if (cursor.consume(']')) {
+        return true;
+    }
+
+    do {
+        if (!cursor.consume('{')) {
+            return false;
+        }
+
+        ChatUser user;
+        user.userId = 0;
+        user.gender = 0;
+
+        if (!cursor.consume('}')) {
+            do {
+                Span key;
+                if (!cursor.readString(key) || !cursor.consume(':')) {
+                    return false;
+                }
+
+                bool ok;
+                Span value;
+                if (key.equals("userId", 6)) {
+                    ok = readIntField(cursor, user.userId);
+                }
+                else if (key.equals("gender", 6)) {
+                    ok = readIntField(cursor, user.gender);
+                }
+                else if (key.equals("userName", 8)) {
+                    ok = readStringField(cursor, value);
+                    user.userName = value.toString();
+                }
+                else if (key.equals("userColor", 9)) {
+                    ok = readStringField(cursor, value);
+                    user.userColor = value.toString();
+                }
+                else {
+                    ok = cursor.skipValue();
+                }
+
+                if (!ok) {
+                    return false;
+                }
+            } while (cursor.consume(','));
+
+            if (!cursor.consume('}')) {
+                return false;
+            }
+        }
+
+        users.append(user);
+    } while (cursor.consume(','));
+
+    return cursor.consume(']');
+}
+
+// Строки CBOR могут быть разбиты на куски, собираем их целиком
+bool readCborString(QCborStreamReader &reader, QString &value)
+{
+    value.clear();
+    if (!reader.isString()) {
+        return reader.next();
+    }
+
+    QCborStreamReader::StringResult<QString> chunk = reader.readString();
+    while (chunk.status == QCborStreamReader::Ok) {
+        value += chunk.data;
+        chunk = reader.readString();
+    }
+
+    return chunk.status == QCborStreamReader::EndOfString;
+}
+
+quint64 readCborSequence(QCborStreamReader &reader)
+{
+    if (!reader.isUnsignedInteger()) {
+        reader.next();
+        return 0;
+    }
+
+    quint64 value = quint64(reader.toUnsignedInteger());
+    reader.next();
+    return value;
+}
+
+int readCborInt(QCborStreamReader &reader)
+{
+    if (!reader.isInteger()) {
+        reader.next();
+        return 0;
+    }
+
+    // Как toInt(): значение вне int даёт 0, а не урезанный чужой id
+    bool fits;
+    qint64 value;
+    if (reader.isUnsignedInteger()) {
+        quint64 unsignedValue = reader.toUnsignedInteger();
+        fits = unsignedValue <= quint64(std::numeric_limits<int>::max());
+        value = qint64(unsignedValue);
+    }
+    else {
+        value = reader.toInteger();
+        fits = value < 0 && value >= std::numeric_limits<int>::min();
+    }
+    reader.next();
+    return fits ? int(value) : 0;
+}
+
+// Ключ карты. Нецелый, отрицательный или слишком большой ключ даёт -1:
+// такого ключа в протоколе нет, и его значение пропускается как неизвестное
+int readCborKey(QCborStreamReader &reader)
+{
+    if (!reader.isUnsignedInteger()
+            || reader.toUnsignedInteger() > quint64(std::numeric_limits<int>::max())) {
+        reader.next();
+        return -1;
+    }
+    return readCborInt(reader);
+}
+
+bool decodeCborUser(QCborStreamReader &reader, ChatUser &user)
+{
+    user.userId = 0;
+    user.gender = 0;
+
+    if (!reader.isMap() || !reader.enterContainer()) {
+        return false;
+    }
+
+    while (reader.lastError() == QCborError::NoError && reader.hasNext()) {
+        int key = readCborKey(reader);
+        bool ok = true;
+
+        switch (key) {
+        case Protocol::KeyUserId:
+            user.userId = readCborInt(reader);
+            break;
+        case Protocol::KeyGender:
+            user.gender = readCborInt(reader);
+            break;
+        case Protocol::KeyUserName:
+            ok = readCborString(reader, user.userName);
+            break;
+        case Protocol::KeyUserColor:
+            ok = readCborString(reader, user.userColor);
+            break;
+        default:
+            ok = reader.next();
+            break;
+        }
+
+        if (!ok) {
+            return false;
+        }
+    }
+
+    return reader.leaveContainer();
+}
+
+} // namespace
+
+bool Protocol::decode(const QString &frame, ChatEvent &event)
+{
+    const QChar *begin = frame.constData();
+    JsonCursor cursor(begin, begin + frame.size());
+
+    if (!cursor.consume('{')) {
+        return false;
+    }
+
+    Span action;
+    Span userName;
+    Span userColor;
+    Span text;
+    const QChar *usersBegin = nullptr;
+    const QChar *usersEnd = nullptr;
+
+    event.userId = 0;
+    event.gender = 0;
+    event.sequence = 0;
+
+    // Один проход по кадру: целые числа читаем сразу, а для строк
+    // запоминаем только положение - какие из них нужны, решит действие
+    if (!cursor.consume('}')) {
+        do {
+            Span key;
+            if (!cursor.readString(key) || !cursor.consume(':')) {
+                return false;
+            }
+
+            bool ok;
+            if (key.equals("action", 6)) {
+                ok = readStringField(cursor, action);
+            }
+            else if (key.equals("userId", 6)) {
+                ok = readIntField(cursor, event.userId);
+            }
+            else if (key.equals("gender", 6)) {
+                ok = readIntField(cursor, event.gender);
+            }
+            else if (key.equals("userName", 8)) {
+                ok = readStringField(cursor, userName);
+            }
+            else if (key.equals("userColor", 9)) {
+                ok = readStringField(cursor, userColor);
+            }
+            else if (key.equals("text", 4)) {
+                ok = readStringField(cursor, text);
+            }
+            else if (key.equals("seq", 3)) {
+                ok = readSequenceField(cursor, event.sequence);
+            }
+            else if (key.equals("users", 5)) {
+                cursor.skipSpace();
+                usersBegin = cursor.pos();
+                ok = cursor.skipValue();
+                usersEnd = cursor.pos();
+            }
+            else {
+                ok = cursor.skipValue();
+            }
+
+            if (!ok) {
+                return false;
+            }
+        } while (cursor.consume(','));
+
+        if (!cursor.consume('}')) {
+            return false;
+        }
+    }
+
+    int fields = 0;
+    event.type = ChatEvent::Unknown;
+    for (int i = 0; i < ActionCount; i++) {
+        if (action.equals(Actions[i].name, Actions[i].length)) {
+            event.type = Actions[i].type;
+            fields = Actions[i].fields;
+            break;
+        }
+    }
+
+    if (event.type == ChatEvent::Unknown) {
+        event.text = action.toString(); // для диагностики
+        return true;
+    }
+
+    if (fields & FieldUserName) {
+        event.userName = userName.toString();
+    }
+    if (fields & FieldUserColor) {
+        event.userColor = userColor.toString();
+    }
+    if (fields & FieldText) {
+        event.text = text.toString();
+    }
+    if ((fields & FieldUsers) && usersBegin) {
+        if (!decodeUsers(usersBegin, usersEnd, event.users)) {
+            event.users.clear();
+        }
+    }
+
+    return true;
+}
+
+bool Protocol::decode(const QByteArray &frame, ChatEvent &event)
+{
+    QCborStreamReader reader(frame);
+
+    if (!reader.isMap() || !reader.enterContainer()) {
+        return false;
+    }
+
+    int action = 0;
+    event.userId = 0;
+    event.gender = 0;
+    event.sequence = 0;
+
+    while (reader.lastError() == QCborError::NoError && reader.hasNext()) {
+        int key = readCborKey(reader);
+        bool ok = true;
+
+        switch (key) {
+        case KeyAction:
+            action = readCborInt(reader);
+            break;
+        case KeyUserId:
+            event.userId = readCborInt(reader);
+            break;
+        case KeyGender:
+            event.gender = readCborInt(reader);
+            break;
+        case KeyUserName:
+            ok = readCborString(reader, event.userName);
+            break;
+        case KeyUserColor:
+            ok = readCborString(reader, event.userColor);
+            break;
+        case KeyText:
+            ok = readCborString(reader, event.text);
+            break;
+        case KeySequence:
+            event.sequence = readCborSequence(reader);
+            break;
+        case KeyUsers:
+            if (reader.isArray() && reader.enterContainer()) {
+                while (ok && reader.hasNext()) {
+                    ChatUser user;
+                    ok = decodeCborUser(reader, user);
+                    event.users.append(user);
+                }
+                ok = ok && reader.leaveContainer();
+            }
+            else {
+                ok = reader.next();
+            }
+            break;
+        default:
+            ok = reader.next();
+            break;
+        }
+
+        if (!ok) {
+            return false;
+        }
+    }
+
+    if (reader.lastError() != QCborError::NoError || !reader.leaveContainer()) {
+        return false;
+    }
+
+    event.type = ChatEvent::Unknown;
+    for (int i = 0; i < ActionCount; i++) {
+        if (Actions[i].code == action) {
+            event.type = Actions[i].type;
+            break;
+        }
+    }
+
+    if (event.type == ChatEvent::Unknown) {
+        event.text = QString::number(action); // для диагностики
+    }
+
+    return true;
+}
+
+QByteArray Protocol::encodeEvent(const ChatEvent &event, WireFormat format)
+{
+    const ActionInfo *info = nullptr;
+    for (int i = 0; i < ActionCount; i++) {
+        if (Actions[i].type == event.type) {
+            info = &Actions[i];
+            break;
+        }
+    }
+
+    if (!info) {
+        return QByteArray();
+    }
+
+    // Поля кадра те же, что читает decode() для этого действия
+    bool hasUser = info->fields & FieldUserName;
+
+    if (format == CborFormat) {
+        QCborMap messageData;
+        messageData.insert(qint64(KeyAction), info->code);
+        if (hasUser) {
+            messageData.insert(qint64(KeyUserId), event.userId);
+            messageData.insert(qint64(KeyUserName), event.userName);
+            messageData.insert(qint64(KeyGender), event.gender);
+        }
+        if (info->fields & FieldUserColor) {
+            messageData.insert(qint64(KeyUserColor), event.userColor);
+        }
+        if (info->fields & FieldText) {
+            messageData.insert(qint64(KeyText), event.text);
+        }
+        if (info->fields & FieldUsers) {
+            QCborArray users;
+            foreach (const ChatUser &user, event.users) {
+                QCborMap userData;
+                userData.insert(qint64(KeyUserId), user.userId);
+                userData.insert(qint64(KeyUserName), user.userName);
+                userData.insert(qint64(KeyGender), user.gender);
+                userData.insert(qint64(KeyUserColor), user.userColor);
+                users.append(userData);
+            }
+            messageData.insert(qint64(KeyUsers), users);
+        }
+        if (event.sequence) {
+            messageData.insert(qint64(KeySequence), qint64(event.sequence));
+        }
+        return messageData.toCborValue().toCbor();
+    }
+
+    QJsonObject messageData;
+    messageData.insert("action", QLatin1String(info->name));
+    if (hasUser) {
+        messageData.insert("userId", event.userId);
+        messageData.insert("userName", event.userName);
+        messageData.insert("gender", event.gender);
+    }
+    if (info->fields & FieldUserColor) {
+        messageData.insert("userColor", event.userColor);
+    }
+    if (info->fields & FieldText) {
+        messageData.insert("text", event.text);
+    }
+    if (info->fields & FieldUsers) {
+        QJsonArray users;
+        foreach (const ChatUser &user, event.users) {
+            QJsonObject userData;
+            userData.insert("userId", user.userId);
+            userData.insert("userName", user.userName);
+            userData.insert("gender", user.gender);
+            userData.insert("userColor", user.userColor);
+            users.append(userData);
+        }
+        messageData.insert("users", users);
+    }
+    if (event.sequence) {
+        // Номера сервера укладываются в точность double (до 2^53)
+        messageData.insert("seq", qint64(event.sequence));
+    }
+    return QJsonDocument(messageData).toJson(QJsonDocument::Compact);
+}
+
+QByteArray Protocol::encodePong(WireFormat format)
+{
+    if (format == CborFormat) {
+        QCborMap messageData;
+        messageData.insert(qint64(KeyAction), ActionPong);
+        return messageData.toCborValue().toCbor();
+    }
+
+    QJsonObject messageData;
+    messageData.insert("action", "Pong");
+    return QJsonDocument(messageData).toJson(QJsonDocument::Compact);
+}
+
+QByteArray Protocol::encodeMessage(int toUserId,
+                                   const QString &text,
+                                   WireFormat format)
+{
+    if (format == CborFormat) {
+        QCborMap messageData;
+        messageData.insert(qint64(KeyToUserId), toUserId);
+        messageData.insert(qint64(KeyText), text);
+        return messageData.toCborValue().toCbor();
+    }
+
+    QJsonObject messageData;
+    messageData.insert("toUserId", toUserId);
+    messageData.insert("text", text);
+    return QJsonDocument(messageData).toJson(QJsonDocument::Compact);
+}
+
+ChatEvent::Type Protocol::actionType(const QChar *name, int length)
+{
+    Span span;
+    span.begin = name;
+    span.length = length;
+
+    for (int i = 0; i < ActionCount; i++) {
+        if (span.equals(Actions[i].name, Actions[i].length)) {
+            return Actions[i].type;
+        }
+    }
+
+    return ChatEvent::Unknown;
+}
+
+const char *Protocol::actionName(ChatEvent::Type type)
+{
+    for (int i = 0; i < ActionCount; i++) {
+        if (Actions[i].type == type) {
+            return Actions[i].name;
+        }
+    }
+
+    return "";
+}
@@ -0,0 +1,103 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <QByteArray>
+#include <QString>
+
+#include "chatevent.h"
+
+// Разбор кадров протокола чата.
+// Кадр читается один раз прямо из UTF-16 строки websocket-клиента, без
+// промежуточных QJsonDocument/QJsonObject. Действие сразу превращается
+// в значение перечисления, а строковые поля копируются только те,
+// которые нужны этому действию.
+//
+// Кроме текстового JSON поддерживается двоичный формат CBOR: клиент
+// запрашивает его параметром format=cbor в адресе подключения, и если
+// сервер отвечает двоичными кадрами, дальше общение идёт в CBOR.
+// В CBOR-кадре вместо имён полей используются короткие целые ключи,
+// а действие передаётся числом.
+//
+// События, разосланные всем, сервер нумерует по порядку (поле seq).
+// После разрыва клиент подключается с параметром since=<последний номер>,
+// и если сервер ещё помнит следующие события, он отвечает не Authorized
+// со всем списком, а Resynced и пропущенными событиями.
+class Protocol
+{
+public:
+    enum WireFormat {
+        JsonFormat,
+        CborFormat
+    };
+
+    // Ключи полей CBOR-кадра
+    enum CborKey {
+        KeyAction = 0,
+        KeyUserId = 1,
+        KeyUserName = 2,
+        KeyGender = 3,
+        KeyUserColor = 4,
+        KeyText = 5,
+        KeyUsers = 6,
+        KeyToUserId = 7,
+        KeySequence = 8
+    };
+
+    // Коды действий CBOR-кадра
+    enum CborAction {
+        ActionPing = 1,
+        ActionPong = 2,
+        ActionAuthorized = 3,
+        ActionConnected = 4,
+        ActionDisconnected = 5,
+        ActionConnectionLost = 6,
+        ActionPublicMessage = 7,
+        ActionPrivateMessage = 8,
+        ActionResynced = 9
+    };
+
+    // Возвращает false, если кадр не удалось разобрать как JSON-объект.
+    // Неизвестное действие даёт событие с типом ChatEvent::Unknown.
+    static bool decode(const QString &frame, ChatEvent &event);
+    static bool decode(const QByteArray &frame, ChatEvent &event);
+
+    // Кадр сервера для клиента: нужен тестовому серверу и записи кадров
+    static QByteArray encodeEvent(const ChatEvent &event, WireFormat format);
+
+    static QByteArray encodePong(WireFormat format);
+    static QByteArray encodeMessage(int toUserId,
+                                    const QString &text,
+                                    WireFormat format);
+
+    static ChatEvent::Type actionType(const QChar *name, int length);
+    static const char *actionName(ChatEvent::Type type);
+};
+
+#endif // PROTOCOL_H
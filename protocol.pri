@@ -0,0 +1,8 @@
+# Разбор и упаковка кадров протокола чата.
+# Общая часть клиента и вспомогательных программ (генератора нагрузки),
+# не зависящая от виджетов.
+INCLUDEPATH += $$PWD
+DEPENDPATH += $$PWD
+
+SOURCES += $$PWD/protocol.cpp
+HEADERS += $$PWD/protocol.h $$PWD/chatevent.h
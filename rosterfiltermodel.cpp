@@ -0,0 +1,140 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "rosterfiltermodel.h"
+#include "rostermodel.h"
+
+RosterFilterModel::RosterFilterModel(RosterModel *source, QObject *parent) :
+    QAbstractListModel(parent),
+    m_source(source)
+{
+    connect(m_source, &RosterModel::usersAdded,
+            this, &RosterFilterModel::onUsersAdded);
+    connect(m_source, &RosterModel::userRemoved,
+            this, &RosterFilterModel::onUserRemoved);
+    connect(m_source, &RosterModel::modelReset,
+            this, &RosterFilterModel::onSourceReset);
+}
+
+int RosterFilterModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : m_userIds.size();
+}
+
+QVariant RosterFilterModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= m_userIds.size()) {
+        return QVariant();
+    }
+
+    int row = m_source->rowOf(m_userIds.at(index.row()));
+    return m_source->data(m_source->index(row), role);
+}
+
+QString RosterFilterModel::filter() const
+{
+    return m_filter;
+}
+
+void RosterFilterModel::setFilter(const QString &filter)
+{
+    if (filter == m_filter) {
+        return;
+    }
+
+    beginResetModel();
+    m_filter = filter;
+    m_userIds = m_source->nameIndex().search(m_filter);
+    rebuildRows();
+    endResetModel();
+}
+
+void RosterFilterModel::onUsersAdded(const QVector<int> &userIds)
+{
+    if (m_filter.isEmpty()) {
+        return;
+    }
+
+    QVector<int> matched;
+    foreach (int userId, userIds) {
+        if (m_source->nameIndex().matches(userId, m_filter)) {
+            matched.append(userId);
+        }
+    }
+
+    if (matched.isEmpty()) {
+        return;
+    }
+
+    beginInsertRows(QModelIndex(), m_userIds.size(), m_userIds.size() + matched.size() - 1);
+    foreach (int userId, matched) {
+        m_rows.insert(userId, m_userIds.size());
+        m_userIds.append(userId);
+    }
+    endInsertRows();
+}
+
+void RosterFilterModel::onUserRemoved(int userId)
+{
+    QHash<int, int>::iterator it = m_rows.find(userId);
+    if (it == m_rows.end()) {
+        return;
+    }
+
+    int row = it.value();
+    m_rows.erase(it);
+
+    // Как и в RosterModel: последняя строка переносится на место удаляемой
+    int last = m_userIds.size() - 1;
+    if (row != last) {
+        int movedId = m_userIds.at(last);
+        m_userIds[row] = movedId;
+        m_rows[movedId] = row;
+        emit dataChanged(index(row), index(row));
+    }
+
+    beginRemoveRows(QModelIndex(), last, last);
+    m_userIds.removeLast();
+    endRemoveRows();
+}
+
+void RosterFilterModel::onSourceReset()
+{
+    beginResetModel();
+    m_userIds.clear();
+    m_rows.clear();
+    endResetModel();
+}
+
+void RosterFilterModel::rebuildRows()
+{
+    m_rows.clear();
+    m_rows.reserve(m_userIds.size());
+    for (int row = 0; row < m_userIds.size(); row++) {
+        m_rows.insert(m_userIds.at(row), row);
+    }
+}
@@ -0,0 +1,69 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ROSTERFILTERMODEL_H
+#define ROSTERFILTERMODEL_H
+
+#include <QAbstractListModel>
+#include <QHash>
+#include <QVector>
+
+class RosterModel;
+
+// Отфильтрованный список пользователей.
+// Подходящие пользователи берутся из индекса имён RosterModel, а не
+// перебором всех строк, как в QSortFilterProxyModel. Пока фильтр задан,
+// вход и выход пользователей применяются к результату по одному,
+// удаление строки стоит O(1).
+class RosterFilterModel : public QAbstractListModel
+{
+    Q_OBJECT
+
+public:
+    explicit RosterFilterModel(RosterModel *source, QObject *parent = nullptr);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+
+    QString filter() const;
+    void setFilter(const QString &filter);
+
+private slots:
+    void onUsersAdded(const QVector<int> &userIds);
+    void onUserRemoved(int userId);
+    void onSourceReset();
+
+private:
+    RosterModel *m_source;
+    QString m_filter;
+    QVector<int> m_userIds; // userId найденных пользователей
+    QHash<int, int> m_rows; // userId -> номер строки в m_userIds
+
+    void rebuildRows();
+};
+
+#endif // ROSTERFILTERMODEL_H
@@ -0,0 +1,236 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "rosterindex.h"
+
+#include <algorithm>
+
+// Оценка памяти на пользователя: узел хэша имён и заголовки строки и
+// векторов, на каждый ключ - элемент списка, доля узла хэша списков,
+// сам ключ и позиция в списке
+static const int NameOverhead = 96;
+static const int KeyOverhead = 20;
+
+static qint64 entryBytes(const QString &folded, int keyCount)
+{
+    return NameOverhead + qint64(folded.size()) * qint64(sizeof(QChar))
+            + qint64(keyCount) * KeyOverhead;
+}
+
+RosterIndex::RosterIndex() :
+    m_bytes(0)
+{
+}
+
+void RosterIndex::add(int userId, const QString &userName)
+{
+    if (m_entries.contains(userId)) {
+        return;
+    }
+
+    Entry &entry = m_entries[userId];
+    entry.name = fold(userName);
+    entry.keys = keys(entry.name);
+    entry.slots.reserve(entry.keys.size());
+    foreach (quint64 key, entry.keys) {
+        QVector<int> &ids = m_postings[key];
+        entry.slots.append(ids.size());
+        ids.append(userId);
+    }
+
+    m_bytes += entryBytes(entry.name, entry.keys.size());
+}
+
+void RosterIndex::remove(int userId)
+{
+    QHash<int, Entry>::iterator it = m_entries.find(userId);
+    if (it == m_entries.end()) {
+        return;
+    }
+
+    // Порядок внутри списка не важен: на место удалённого ставим последний
+    // и переписываем перенесённому пользователю его позицию
+    const Entry &entry = it.value();
+    for (int i = 0; i < entry.keys.size(); i++) {
+        quint64 key = entry.keys.at(i);
+        QHash<quint64, QVector<int> >::iterator posting = m_postings.find(key);
+        if (posting == m_postings.end()) {
+            continue;
+        }
+
+        QVector<int> &ids = posting.value();
+        int pos = entry.slots.at(i);
+        int moved = ids.last();
+        if (moved != userId) {
+            ids[pos] = moved;
+            Entry &movedEntry = m_entries.find(moved).value();
+            int k = int(std::lower_bound(movedEntry.keys.constBegin(),
+                                         movedEntry.keys.constEnd(), key)
+                        - movedEntry.keys.constBegin());
+            movedEntry.slots[k] = pos;
+        }
+        ids.removeLast();
+        if (ids.isEmpty()) {
+            m_postings.erase(posting);
+        }
+    }
+
+    m_bytes -= entryBytes(entry.name, entry.keys.size());
+    m_entries.erase(it);
+}
+
+void RosterIndex::clear()
+{
+    m_entries.clear();
+    m_postings.clear();
+    m_bytes = 0;
+}
+
+qint64 RosterIndex::bytes() const
+{
+    return m_bytes;
+}
+
+bool RosterIndex::matches(int userId, const QString &query) const
+{
+    QString folded = fold(query.trimmed());
+    if (folded.isEmpty()) {
+        return true;
+    }
+
+    QHash<int, Entry>::const_iterator it = m_entries.constFind(userId);
+    if (it == m_entries.constEnd()) {
+        return false;
+    }
+
+    const QString &name = it.value().name;
+    if (folded.size() >= 3) {
+        return name.contains(folded);
+    }
+    if (!folded.at(0).isLetterOrNumber()) {
+        return false;
+    }
+
+    // Короткий запрос - начало любого слова имени
+    for (int pos = name.indexOf(folded); pos >= 0; pos = name.indexOf(folded, pos + 1)) {
+        if (pos == 0 || !name.at(pos - 1).isLetterOrNumber()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+QVector<int> RosterIndex::search(const QString &query, int limit) const
+{
+    QString folded = fold(query.trimmed());
+    QVector<int> result;
+    if (folded.isEmpty()) {
+        return result;
+    }
+
+    if (folded.size() < 3) {
+        result = m_postings.value(prefixKey(folded.constData(), folded.size()));
+        if (limit > 0 && result.size() > limit) {
+            result.resize(limit);
+        }
+        return result;
+    }
+
+    // Самый короткий список триграмм запроса даёт кандидатов
+    const QVector<int> *shortest = nullptr;
+    for (int i = 0; i + 3 <= folded.size(); i++) {
+        QHash<quint64, QVector<int> >::const_iterator it =
+                m_postings.constFind(trigramKey(folded.constData() + i));
+        if (it == m_postings.constEnd()) {
+            return result;
+        }
+        if (!shortest || it.value().size() < shortest->size()) {
+            shortest = &it.value();
+        }
+    }
+
+    foreach (int userId, *shortest) {
+        if (m_entries.constFind(userId).value().name.contains(folded)) {
+            result.append(userId);
+            if (limit > 0 && result.size() >= limit) {
+                break;
+            }
+        }
+    }
+
+    return result;
+}
+
+QString RosterIndex::fold(const QString &text)
+{
+    return text.toCaseFolded();
+}
+
+QVector<quint64> RosterIndex::keys(const QString &folded) const
+{
+    QVector<quint64> result;
+    const QChar *p = folded.constData();
+    int size = folded.size();
+
+    // Начала слов: одна и две буквы
+    for (int i = 0; i < size; i++) {
+        if (!p[i].isLetterOrNumber() || (i > 0 && p[i - 1].isLetterOrNumber())) {
+            continue;
+        }
+        result.append(prefixKey(p + i, 1));
+        if (i + 1 < size) {
+            result.append(prefixKey(p + i, 2));
+        }
+    }
+
+    for (int i = 0; i + 3 <= size; i++) {
+        result.append(trigramKey(p + i));
+    }
+
+    // Повторяющийся ключ должен дать одну запись в списке
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
+}
+
+quint64 RosterIndex::prefixKey(const QChar *p, int length)
+{
+    // Старшие биты отличают префиксы от триграмм и друг от друга
+    quint64 key = quint64(length) << 48;
+    for (int i = 0; i < length; i++) {
+        key |= quint64(p[i].unicode()) << (16 * (length - 1 - i));
+    }
+    return key;
+}
+
+quint64 RosterIndex::trigramKey(const QChar *p)
+{
+    return (quint64(3) << 48)
+            | (quint64(p[0].unicode()) << 32)
+            | (quint64(p[1].unicode()) << 16)
+            | quint64(p[2].unicode());
+}
@@ -0,0 +1,78 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ROSTERINDEX_H
+#define ROSTERINDEX_H
+
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+// Индекс имён пользователей для мгновенного поиска по списку.
+// Для каждого слова имени хранятся его первая буква и первые две буквы,
+// а для всего имени - все триграммы. Запрос из одной-двух букв ищет
+// пользователей, у которых с них начинается одно из слов имени; более
+// длинный запрос пересекает списки его триграмм, начиная с самого
+// короткого, и проверяет кандидатов подстрокой. Индекс пополняется
+// и чистится по одному пользователю, без перестроения: пользователь помнит
+// своё место в каждом списке, поэтому удаление не просматривает списки.
+class RosterIndex
+{
+public:
+    RosterIndex();
+
+    void add(int userId, const QString &userName);
+    void remove(int userId);
+    void clear();
+
+    bool matches(int userId, const QString &query) const;
+
+    // userId подходящих пользователей, не больше limit (0 - без ограничения)
+    QVector<int> search(const QString &query, int limit = 0) const;
+
+    static QString fold(const QString &text);
+
+    qint64 bytes() const; // оценка занятой памяти
+
+private:
+    struct Entry
+    {
+        QString name; // имя без учёта регистра
+        QVector<quint64> keys; // упорядоченные ключи имени
+        QVector<int> slots; // позиция в списке каждого ключа
+    };
+
+    QVector<quint64> keys(const QString &folded) const;
+    static quint64 prefixKey(const QChar *p, int length);
+    static quint64 trigramKey(const QChar *p);
+
+    QHash<int, Entry> m_entries; // userId -> имя и его ключи
+    QHash<quint64, QVector<int> > m_postings; // ключ -> userId
+    qint64 m_bytes;
+};
+
+#endif // ROSTERINDEX_H
@@ -0,0 +1,270 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "rostermodel.h"
+
+#include <algorithm>
+
+RosterModel::RosterModel(QObject *parent) :
+    QAbstractListModel(parent),
+    m_stringBytes(0)
+{
+}
+
+int RosterModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : m_users.size();
+}
+
+QVariant RosterModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= m_users.size()) {
+        return QVariant();
+    }
+
+    const Entry &entry = m_users.at(index.row());
+
+    switch (role) {
+    case Qt::DisplayRole:
+    case UserNameRole:
+        return entry.userName;
+    case Qt::DecorationRole:
+        return genderIcon(entry.gender);
+    case Qt::ForegroundRole:
+        return entry.color;
+    case UserIdRole:
+        return entry.userId;
+    case GenderRole:
+        return entry.gender;
+    case UserColorRole:
+        return entry.userColor;
+    default:
+        return QVariant();
+    }
+}
+
+bool RosterModel::contains(int userId) const
+{
+    return m_rows.contains(userId);
+}
+
+int RosterModel::rowOf(int userId) const
+{
+    return m_rows.value(userId, -1);
+}
+
+void RosterModel::addUser(const ChatUser &user)
+{
+    addUsers(QVector<ChatUser>() << user);
+}
+
+void RosterModel::addUsers(const QVector<ChatUser> &users)
+{
+    QVector<Entry> entries;
+    entries.reserve(users.size());
+    QVector<int> userIds;
+    userIds.reserve(users.size());
+
+    foreach (const ChatUser &user, users) {
+        if (!m_rows.contains(user.userId)) {
+            m_rows.insert(user.userId, m_users.size() + entries.size());
+            m_nameIndex.add(user.userId, user.userName);
+            entries.append(makeEntry(user));
+            m_stringBytes += entryBytes(entries.last());
+            userIds.append(user.userId);
+        }
+    }
+
+    if (entries.isEmpty()) {
+        return;
+    }
+
+    // Весь снимок вставляется одной операцией
+    beginInsertRows(QModelIndex(), m_users.size(), m_users.size() + entries.size() - 1);
+    m_users += entries;
+    endInsertRows();
+
+    emit usersAdded(userIds);
+}
+
+bool RosterModel::removeUser(int userId)
+{
+    int row = m_rows.value(userId, -1);
+    if (row < 0) {
+        return false;
+    }
+
+    int last = m_users.size() - 1;
+    m_stringBytes -= entryBytes(m_users.at(row));
+
+    // Порядок в списке не важен, поэтому на место удаляемой строки
+    // переносим последнюю и удаляем уже её
+    if (row != last) {
+        m_users[row] = m_users.at(last);
+        m_rows.insert(m_users.at(row).userId, row);
+        emit dataChanged(index(row), index(row));
+    }
+
+    beginRemoveRows(QModelIndex(), last, last);
+    m_users.removeLast();
+    m_rows.remove(userId);
+    m_nameIndex.remove(userId);
+    endRemoveRows();
+
+    emit userRemoved(userId);
+    return true;
+}
+
+int RosterModel::removeUsers(const QVector<int> &userIds)
+{
+    QVector<int> rows;
+    rows.reserve(userIds.size());
+    foreach (int userId, userIds) {
+        int row = m_rows.value(userId, -1);
+        if (row >= 0) {
+            rows.append(row);
+        }
+    }
+
+    std::sort(rows.begin(), rows.end());
+    rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+
+    if (rows.size() <= 1) {
+        return rows.isEmpty() ? 0 : int(removeUser(m_users.at(rows.first()).userId));
+    }
+
+    QVector<int> removed;
+    removed.reserve(rows.size());
+    foreach (int row, rows) {
+        const Entry &entry = m_users.at(row);
+        m_stringBytes -= entryBytes(entry);
+        m_rows.remove(entry.userId);
+        m_nameIndex.remove(entry.userId);
+        removed.append(entry.userId);
+    }
+
+    // Как и при удалении одного: дыры ниже нового конца списка занимают
+    // оставшиеся строки из хвоста, и хвост удаляется одной операцией
+    int size = m_users.size() - rows.size();
+    int tail = m_users.size() - 1;
+    int skip = rows.size() - 1; // удаляемые строки хвоста, идём с конца
+    int firstHole = -1;
+    int lastHole = -1;
+
+    for (int i = 0; i < rows.size() && rows.at(i) < size; i++) {
+        while (skip >= 0 && rows.at(skip) == tail) {
+            skip--;
+            tail--;
+        }
+
+        int hole = rows.at(i);
+        m_users[hole] = m_users.at(tail--);
+        m_rows.insert(m_users.at(hole).userId, hole);
+
+        if (firstHole < 0) {
+            firstHole = hole;
+        }
+        lastHole = hole;
+    }
+
+    if (firstHole >= 0) {
+        emit dataChanged(index(firstHole), index(lastHole));
+    }
+
+    beginRemoveRows(QModelIndex(), size, m_users.size() - 1);
+    m_users.resize(size);
+    endRemoveRows();
+
+    foreach (int userId, removed) {
+        emit userRemoved(userId);
+    }
+    return removed.size();
+}
+
+void RosterModel::clear()
+{
+    beginResetModel();
+    m_users.clear();
+    m_rows.clear();
+    m_nameIndex.clear();
+    m_stringBytes = 0;
+    endResetModel();
+}
+
+const RosterIndex &RosterModel::nameIndex() const
+{
+    return m_nameIndex;
+}
+
+qint64 RosterModel::bytes() const
+{
+    // Массив строк, узлы хэша userId -> строка, строки и индекс
+    return qint64(m_users.capacity()) * qint64(sizeof(Entry))
+            + qint64(m_rows.size()) * 32
+            + m_stringBytes
+            + m_nameIndex.bytes();
+}
+
+qint64 RosterModel::entryBytes(const Entry &entry)
+{
+    return qint64(entry.userName.size() + entry.userColor.size()) * qint64(sizeof(QChar)) + 48;
+}
+
+RosterModel::Entry RosterModel::makeEntry(const ChatUser &user)
+{
+    Entry entry;
+    entry.userId = user.userId;
+    entry.userName = user.userName;
+    entry.gender = qBound(0, user.gender, 2);
+    entry.userColor = user.userColor;
+
+    // Разобранные цвета имён общие для всех списков (только поток GUI).
+    // Ключи приходят от сервера, поэтому кэш ограничен: при переполнении
+    // он сбрасывается, и цвета разбираются заново
+    static const int MaxCachedColors = 1024;
+    static QHash<QString, QColor> colors;
+
+    QHash<QString, QColor>::const_iterator it = colors.constFind(user.userColor);
+    if (it == colors.constEnd()) {
+        if (colors.size() >= MaxCachedColors) {
+            colors.clear();
+        }
+        it = colors.insert(user.userColor, QColor(user.userColor));
+    }
+    entry.color = it.value();
+
+    return entry;
+}
+
+QIcon RosterModel::genderIcon(int gender)
+{
+    static QIcon icons[3];
+    if (icons[gender].isNull()) {
+        icons[gender] = QIcon(QString(":/icons/gender-%1.png").arg(gender));
+    }
+    return icons[gender];
+}
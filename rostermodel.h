@@ -0,0 +1,101 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ROSTERMODEL_H
+#define ROSTERMODEL_H
+
+#include <QAbstractListModel>
+#include <QColor>
+#include <QHash>
+#include <QIcon>
+#include <QVector>
+
+#include "chatevent.h"
+#include "rosterindex.h"
+
+// Список пользователей чата.
+// Пользователи лежат в непрерывном массиве, а хэш userId -> строка
+// позволяет добавлять и удалять их за O(1). Иконки пола и цвета имён
+// создаются один раз и разделяются всеми строками и всеми сессиями.
+// Вместе со списком пополняется индекс имён для поиска.
+class RosterModel : public QAbstractListModel
+{
+    Q_OBJECT
+
+public:
+    enum Role {
+        UserIdRole = Qt::UserRole + 1,
+        UserNameRole,
+        GenderRole,
+        UserColorRole
+    };
+
+    explicit RosterModel(QObject *parent = nullptr);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+
+    bool contains(int userId) const;
+    int rowOf(int userId) const;
+
+    void addUser(const ChatUser &user);
+    void addUsers(const QVector<ChatUser> &users);
+    bool removeUser(int userId);
+    int removeUsers(const QVector<int> &userIds);
+    void clear();
+
+    const RosterIndex &nameIndex() const;
+
+    // Оценка памяти списка вместе с индексом имён, байт
+    qint64 bytes() const;
+
+signals:
+    void usersAdded(const QVector<int> &userIds);
+    void userRemoved(int userId);
+
+private:
+    struct Entry
+    {
+        int userId;
+        QString userName;
+        int gender;
+        QString userColor;
+        QColor color;
+    };
+
+    Entry makeEntry(const ChatUser &user);
+    static qint64 entryBytes(const Entry &entry);
+    static QIcon genderIcon(int gender);
+
+    QVector<Entry> m_users;
+    QHash<int, int> m_rows; // userId -> номер строки
+    RosterIndex m_nameIndex;
+    qint64 m_stringBytes; // имена и цвета пользователей
+
+};
+
+#endif // ROSTERMODEL_H
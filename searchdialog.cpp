@@ -0,0 +1,99 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "searchdialog.h"
+#include "ui_searchdialog.h"
+#include "messagelogmodel.h"
+
+#include <QDateTime>
+
+#include <limits>
+
+SearchDialog::SearchDialog(QWidget *parent) :
+    QDialog(parent),
+    ui(new Ui::SearchDialog),
+    m_results(new MessageLogModel(ResultLimit, this))
+{
+    ui->setupUi(this);
+    ui->listView_results->setModel(m_results);
+
+    // Период задаётся числом секунд до текущего момента, 0 - вся история
+    ui->comboBox_period->addItem("За всё время", 0);
+    ui->comboBox_period->addItem("За час", 60 * 60);
+    ui->comboBox_period->addItem("За сутки", 24 * 60 * 60);
+    ui->comboBox_period->addItem("За неделю", 7 * 24 * 60 * 60);
+    ui->comboBox_period->addItem("За месяц", 30 * 24 * 60 * 60);
+
+    connect(ui->pushButton_search, &QPushButton::clicked,
+            this, &SearchDialog::startSearch);
+    connect(ui->lineEdit_query, &QLineEdit::returnPressed,
+            this, &SearchDialog::startSearch);
+    connect(ui->lineEdit_userName, &QLineEdit::returnPressed,
+            this, &SearchDialog::startSearch);
+}
+
+SearchDialog::~SearchDialog()
+{
+    delete ui;
+}
+
+void SearchDialog::setResults(const QString &query, const QStringList &lines, qint64 elapsed)
+{
+    // Ответ на устаревший запрос не показываем
+    if (query != m_query) {
+        return;
+    }
+
+    m_results->clear();
+    m_results->append(lines);
+
+    ui->label_result->setText(QString("Найдено: %1%2 (%3 мс)")
+                              .arg(lines.size())
+                              .arg(lines.size() >= ResultLimit ? "+" : "")
+                              .arg(elapsed / 1000.0, 0, 'f', 1));
+}
+
+void SearchDialog::startSearch()
+{
+    QString query = ui->lineEdit_query->text().trimmed();
+    QString userName = ui->lineEdit_userName->text().trimmed();
+    if (query.isEmpty() && userName.isEmpty()) {
+        return;
+    }
+
+    qint64 to = std::numeric_limits<qint64>::max();
+    qint64 from = 0;
+    int period = ui->comboBox_period->currentData().toInt();
+    if (period > 0) {
+        from = QDateTime::currentMSecsSinceEpoch() - qint64(period) * 1000;
+    }
+
+    m_query = query;
+    ui->label_result->setText("Поиск...");
+
+    emit searchRequested(query, userName, from, to, ResultLimit);
+}
@@ -0,0 +1,610 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "searchindex.h"
+#include "historystore.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QSaveFile>
+#include <QtEndian>
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <limits>
+
+namespace {
+
+// Запись таблицы документов: время, хэш автора, сегмент, смещение
+const int DocumentEntrySize = 8 + 4 + 4 + 4;
+
+// Заголовок куска: сигнатура, число слов, первый документ, конец диапазона
+const char ChunkMagic[4] = { 'S', 'C', 'I', '1' };
+const int ChunkHeaderSize = 4 + 4 + 4 + 4;
+
+// Запись словаря куска: смещение и длина слова, смещение и длина списка
+const int TermEntrySize = 4 + 4 + 4 + 4;
+
+const int MaxTermLength = 32;
+
+QString documentsPath(const QString &path)
+{
+    return path + "/search.docs";
+}
+
+QString chunkName(quint32 firstDocument)
+{
+    return QString("search-%1.chunk").arg(firstDocument, 10, 10, QChar('0'));
+}
+
+void putVarint(QByteArray &data, quint32 value)
+{
+    while (value >= 0x80) {
+        data.append(char((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    data.append(char(value));
+}
+
+bool takeVarint(const uchar *&p, const uchar *limit, quint32 &value)
+{
+    value = 0;
+    for (int shift = 0; p < limit && shift < 35; shift += 7) {
+        uchar byte = *p++;
+        value |= quint32(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Побайтовое сравнение слов: так же отсортирован словарь куска
+int compareTerms(const uchar *a, int aLength, const uchar *b, int bLength)
+{
+    int result = memcmp(a, b, size_t(qMin(aLength, bLength)));
+    return result != 0 ? result : aLength - bLength;
+}
+
+bool termLess(const QByteArray &a, const QByteArray &b)
+{
+    return compareTerms(reinterpret_cast<const uchar *>(a.constData()), a.size(),
+                        reinterpret_cast<const uchar *>(b.constData()), b.size()) < 0;
+}
+
+} // namespace
+
+SearchIndex::SearchIndex(const QString &path) :
+    m_path(path),
+    m_savedDocuments(0),
+    m_committed(0),
+    m_indexed(0)
+{
+    QDir().mkpath(m_path);
+
+    loadDocuments();
+    loadChunks();
+}
+
+SearchIndex::~SearchIndex()
+{
+    qDeleteAll(m_chunks);
+}
+
+quint32 SearchIndex::documentCount() const
+{
+    return quint32(m_documents.size());
+}
+
+quint32 SearchIndex::indexedCount() const
+{
+    return m_indexed;
+}
+
+SearchIndex::Location SearchIndex::location(quint32 document) const
+{
+    const Document &entry = m_documents.at(int(document));
+
+    Location result;
+    result.segment = int(entry.segment);
+    result.offset = entry.offset;
+    return result;
+}
+
+void SearchIndex::addDocument(const HistoryRecord &record, int segment, quint32 offset)
+{
+    Document entry;
+    entry.timestamp = record.timestamp;
+    entry.userHash = userHash(record.userName);
+    entry.segment = quint32(segment);
+    entry.offset = offset;
+    m_documents.append(entry);
+
+    indexDocument(quint32(m_documents.size() - 1), record);
+}
+
+void SearchIndex::indexDocument(quint32 document, const HistoryRecord &record)
+{
+    foreach (const QString &token, tokenize(record.text)) {
+        Postings &postings = m_delta[token.toUtf8()];
+
+        if (postings.data.isEmpty()) {
+            putVarint(postings.data, document - m_committed);
+        }
+        else if (postings.lastDocument != document) {
+            putVarint(postings.data, document - postings.lastDocument);
+        }
+        else {
+            continue; // слово уже встречалось в этом сообщении
+        }
+
+        postings.lastDocument = document;
+    }
+}
+
+void SearchIndex::flush(bool commitAll)
+{
+    if (m_savedDocuments < m_documents.size() && m_documentsFile.isOpen()) {
+        int count = m_documents.size() - m_savedDocuments;
+        QByteArray data(count * DocumentEntrySize, Qt::Uninitialized);
+        uchar *p = reinterpret_cast<uchar *>(data.data());
+
+        for (int i = m_savedDocuments; i < m_documents.size(); i++) {
+            const Document &entry = m_documents.at(i);
+            qToLittleEndian<qint64>(entry.timestamp, p);
+            qToLittleEndian<quint32>(entry.userHash, p + 8);
+            qToLittleEndian<quint32>(entry.segment, p + 12);
+            qToLittleEndian<quint32>(entry.offset, p + 16);
+            p += DocumentEntrySize;
+        }
+
+        m_documentsFile.write(data);
+        m_documentsFile.flush();
+        m_savedDocuments = m_documents.size();
+    }
+
+    // При завершении кусок пишется, только если с открытия что-то
+    // добавилось или в памяти несколько прежних кусков, которые надо слить
+    quint32 pending = documentCount() - m_committed;
+    bool changed = documentCount() > m_indexed || m_absorbed.size() > 1;
+    if (pending >= quint32(ChunkDocuments) || (commitAll && pending > 0 && changed)) {
+        commit();
+    }
+}
+
+QVector<SearchIndex::Location> SearchIndex::search(const QString &query,
+                                                   const QString &userName,
+                                                   qint64 from,
+                                                   qint64 to,
+                                                   int limit) const
+{
+    QVector<Location> result;
+
+    QStringList tokens = tokenize(query);
+    if (tokens.isEmpty() && userName.isEmpty()) {
+        return result;
+    }
+
+    // Документы пронумерованы по времени, поэтому интервал времени
+    // превращается в интервал номеров двумя двоичными поисками
+    auto lowerBound = [this](qint64 timestamp) {
+        int lo = 0;
+        int hi = m_documents.size();
+        while (lo < hi) {
+            int mid = (lo + hi) / 2;
+            if (m_documents.at(mid).timestamp < timestamp) {
+                lo = mid + 1;
+            }
+            else {
+                hi = mid;
+            }
+        }
+        return quint32(lo);
+    };
+
+    quint32 first = lowerBound(from);
+    quint32 end = to == std::numeric_limits<qint64>::max() ? documentCount()
+                                                          : lowerBound(to + 1);
+    if (first >= end) {
+        return result;
+    }
+
+    // Пересекаем списки документов всех слов запроса
+    QVector<quint32> documents;
+    bool filtered = false;
+    foreach (const QString &token, tokens) {
+        QVector<quint32> matches;
+        collect(token.toUtf8(), first, end, matches);
+
+        if (filtered) {
+            QVector<quint32> intersection;
+            intersection.reserve(qMin(matches.size(), documents.size()));
+            std::set_intersection(documents.constBegin(), documents.constEnd(),
+                                  matches.constBegin(), matches.constEnd(),
+                                  std::back_inserter(intersection));
+            documents.swap(intersection);
+        }
+        else {
+            documents.swap(matches);
+            filtered = true;
+        }
+
+        if (documents.isEmpty()) {
+            return result;
+        }
+    }
+
+    // Отбираем самые новые совпадения с нужным автором
+    bool byUser = !userName.isEmpty();
+    quint32 hash = byUser ? userHash(userName) : 0;
+
+    auto accept = [&](quint32 document) {
+        if (byUser && m_documents.at(int(document)).userHash != hash) {
+            return;
+        }
+        result.append(location(document));
+    };
+
+    if (filtered) {
+        for (int i = documents.size() - 1; i >= 0 && result.size() < limit; i--) {
+            accept(documents.at(i));
+        }
+    }
+    else {
+        for (quint32 document = end; document > first && result.size() < limit; document--) {
+            accept(document - 1);
+        }
+    }
+
+    std::reverse(result.begin(), result.end());
+    return result;
+}
+
+QStringList SearchIndex::tokenize(const QString &text)
+{
+    QStringList tokens;
+
+    const QChar *p = text.constData();
+    const QChar *end = p + text.size();
+
+    while (p < end) {
+        // Теги и HTML-сущности словами не считаются
+        if (*p == QLatin1Char('<')) {
+            while (p < end && *p != QLatin1Char('>')) {
+                p++;
+            }
+            if (p < end) {
+                p++;
+            }
+            continue;
+        }
+
+        if (*p == QLatin1Char('&')) {
+            const QChar *q = p + 1;
+            while (q < end && q - p <= 8 && q->isLetterOrNumber()) {
+                q++;
+            }
+            if (q < end && *q == QLatin1Char(';')) {
+                p = q + 1;
+                continue;
+            }
+        }
+
+        if (!p->isLetterOrNumber()) {
+            p++;
+            continue;
+        }
+
+        const QChar *start = p;
+        while (p < end && p->isLetterOrNumber()) {
+            p++;
+        }
+
+        int length = qMin(int(p - start), MaxTermLength);
+        tokens.append(QString(start, length).toLower());
+    }
+
+    return tokens;
+}
+
+quint32 SearchIndex::userHash(const QString &userName)
+{
+    // FNV-1a: значение хранится на диске и не должно зависеть от версии Qt
+    QString folded = userName.toCaseFolded();
+    quint32 hash = 2166136261u;
+    for (int i = 0; i < folded.size(); i++) {
+        ushort c = folded.at(i).unicode();
+        hash = (hash ^ (c & 0xff)) * 16777619u;
+        hash = (hash ^ (c >> 8)) * 16777619u;
+    }
+    return hash;
+}
+
+void SearchIndex::loadDocuments()
+{
+    m_documentsFile.setFileName(documentsPath(m_path));
+    if (!m_documentsFile.open(QIODevice::ReadWrite)) {
+        qWarning() << "cannot open search index" << m_documentsFile.fileName();
+        return;
+    }
+
+    QByteArray data = m_documentsFile.readAll();
+    int count = data.size() / DocumentEntrySize;
+    const uchar *p = reinterpret_cast<const uchar *>(data.constData());
+
+    m_documents.reserve(count);
+    for (int i = 0; i < count; i++, p += DocumentEntrySize) {
+        Document entry;
+        entry.timestamp = qFromLittleEndian<qint64>(p);
+        entry.userHash = qFromLittleEndian<quint32>(p + 8);
+        entry.segment = qFromLittleEndian<quint32>(p + 12);
+        entry.offset = qFromLittleEndian<quint32>(p + 16);
+        m_documents.append(entry);
+    }
+
+    // Недописанная запись таблицы отбрасывается
+    m_documentsFile.resize(qint64(count) * DocumentEntrySize);
+    m_documentsFile.seek(qint64(count) * DocumentEntrySize);
+    m_savedDocuments = count;
+}
+
+void SearchIndex::loadChunks()
+{
+    QStringList names = QDir(m_path).entryList(QStringList() << "search-*.chunk",
+                                               QDir::Files, QDir::Name);
+
+    // Куски должны идти подряд: всё после разрыва будет проиндексировано заново
+    foreach (const QString &name, names) {
+        if (!openChunk(name)) {
+            break;
+        }
+    }
+    m_indexed = m_committed;
+
+    // Маленькие куски в конце остаются от сброса при каждом завершении.
+    // Их списки забираются в память, а следующий сброс запишет их одним
+    // куском вместе с новыми документами: иначе открытые файлы, отображения
+    // и число просматриваемых при поиске кусков росли бы с каждым запуском.
+    int absorbed = m_chunks.size();
+    while (absorbed > 0
+           && m_indexed - m_chunks.at(absorbed - 1)->firstDocument < quint32(ChunkDocuments)) {
+        absorbed--;
+    }
+
+    if (absorbed < m_chunks.size()) {
+        m_committed = m_chunks.at(absorbed)->firstDocument;
+        while (m_chunks.size() > absorbed) {
+            absorbChunk(m_chunks.takeAt(absorbed));
+        }
+    }
+}
+
+bool SearchIndex::openChunk(const QString &fileName)
+{
+    Chunk *chunk = new Chunk;
+    chunk->file.setFileName(m_path + "/" + fileName);
+    chunk->data = nullptr;
+    chunk->size = 0;
+
+    if (chunk->file.open(QIODevice::ReadOnly) && chunk->file.size() >= ChunkHeaderSize) {
+        chunk->size = chunk->file.size();
+        chunk->data = chunk->file.map(0, chunk->size);
+    }
+
+    if (!chunk->data || memcmp(chunk->data, ChunkMagic, 4) != 0) {
+        qWarning() << "broken search index chunk" << fileName;
+        delete chunk;
+        return false;
+    }
+
+    chunk->termCount = qFromLittleEndian<quint32>(chunk->data + 4);
+    chunk->firstDocument = qFromLittleEndian<quint32>(chunk->data + 8);
+    chunk->endDocument = qFromLittleEndian<quint32>(chunk->data + 12);
+
+    // Кусок, уже слитый в предыдущий, но не удалённый из-за аварийного
+    // завершения, больше не нужен
+    if (chunk->firstDocument < m_committed && chunk->endDocument <= m_committed) {
+        delete chunk;
+        QFile::remove(m_path + "/" + fileName);
+        return true;
+    }
+
+    if (chunk->firstDocument != m_committed
+            || chunk->endDocument > documentCount()
+            || ChunkHeaderSize + qint64(chunk->termCount) * TermEntrySize > chunk->size) {
+        delete chunk;
+        return false;
+    }
+
+    m_chunks.append(chunk);
+    m_committed = chunk->endDocument;
+    return true;
+}
+
+void SearchIndex::absorbChunk(Chunk *chunk)
+{
+    // Списки куска перекодируются от общего начала свежих документов
+    const uchar *directory = chunk->data + ChunkHeaderSize;
+    QVector<quint32> documents;
+
+    for (quint32 i = 0; i < chunk->termCount; i++) {
+        const uchar *entry = directory + i * TermEntrySize;
+        quint32 termOffset = qFromLittleEndian<quint32>(entry);
+        quint32 termLength = qFromLittleEndian<quint32>(entry + 4);
+        quint32 offset = qFromLittleEndian<quint32>(entry + 8);
+        quint32 length = qFromLittleEndian<quint32>(entry + 12);
+        if (qint64(termOffset) + termLength > chunk->size
+                || qint64(offset) + length > chunk->size) {
+            continue;
+        }
+
+        documents.clear();
+        decodePostings(chunk->data + offset, chunk->data + offset + length,
+                       chunk->firstDocument, chunk->firstDocument, chunk->endDocument,
+                       documents);
+        if (documents.isEmpty()) {
+            continue;
+        }
+
+        Postings &postings = m_delta[QByteArray(reinterpret_cast<const char *>(chunk->data + termOffset),
+                                                int(termLength))];
+        foreach (quint32 document, documents) {
+            putVarint(postings.data, postings.data.isEmpty() ? document - m_committed
+                                                             : document - postings.lastDocument);
+            postings.lastDocument = document;
+        }
+    }
+
+    m_absorbed.append(chunk->file.fileName());
+    delete chunk;
+}
+
+void SearchIndex::commit()
+{
+    QList<QByteArray> terms = m_delta.keys();
+    std::sort(terms.begin(), terms.end(), termLess);
+
+    quint32 dataOffset = quint32(ChunkHeaderSize + terms.size() * TermEntrySize);
+
+    QByteArray directory(terms.size() * TermEntrySize, Qt::Uninitialized);
+    QByteArray blob;
+    uchar *p = reinterpret_cast<uchar *>(directory.data());
+
+    foreach (const QByteArray &term, terms) {
+        const Postings &postings = m_delta.value(term);
+
+        qToLittleEndian<quint32>(dataOffset + quint32(blob.size()), p);
+        qToLittleEndian<quint32>(quint32(term.size()), p + 4);
+        blob.append(term);
+
+        qToLittleEndian<quint32>(dataOffset + quint32(blob.size()), p + 8);
+        qToLittleEndian<quint32>(quint32(postings.data.size()), p + 12);
+        blob.append(postings.data);
+
+        p += TermEntrySize;
+    }
+
+    uchar header[ChunkHeaderSize];
+    memcpy(header, ChunkMagic, 4);
+    qToLittleEndian<quint32>(quint32(terms.size()), header + 4);
+    qToLittleEndian<quint32>(m_committed, header + 8);
+    qToLittleEndian<quint32>(documentCount(), header + 12);
+
+    QString name = chunkName(m_committed);
+    QSaveFile file(m_path + "/" + name);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "cannot write search index chunk" << file.fileName();
+        return;
+    }
+
+    file.write(reinterpret_cast<const char *>(header), ChunkHeaderSize);
+    file.write(directory);
+    file.write(blob);
+
+    if (!file.commit() || !openChunk(name)) {
+        qWarning() << "cannot write search index chunk" << file.fileName();
+        return;
+    }
+
+    // Забранные в память куски теперь лежат в новом, первый из них он и заменил
+    foreach (const QString &fileName, m_absorbed) {
+        if (fileName != file.fileName()) {
+            QFile::remove(fileName);
+        }
+    }
+    m_absorbed.clear();
+    m_delta.clear();
+}
+
+void SearchIndex::collect(const QByteArray &term, quint32 first, quint32 end,
+                          QVector<quint32> &documents) const
+{
+    const uchar *key = reinterpret_cast<const uchar *>(term.constData());
+
+    foreach (const Chunk *chunk, m_chunks) {
+        if (chunk->endDocument <= first || chunk->firstDocument >= end) {
+            continue;
+        }
+
+        // Двоичный поиск по отсортированному словарю куска
+        const uchar *directory = chunk->data + ChunkHeaderSize;
+        int lo = 0;
+        int hi = int(chunk->termCount) - 1;
+        while (lo <= hi) {
+            int mid = (lo + hi) / 2;
+            const uchar *entry = directory + mid * TermEntrySize;
+            quint32 termOffset = qFromLittleEndian<quint32>(entry);
+            quint32 termLength = qFromLittleEndian<quint32>(entry + 4);
+            if (qint64(termOffset) + termLength > chunk->size) {
+                break;
+            }
+
+            int cmp = compareTerms(chunk->data + termOffset, int(termLength), key, term.size());
+            if (cmp == 0) {
+                quint32 offset = qFromLittleEndian<quint32>(entry + 8);
+                quint32 length = qFromLittleEndian<quint32>(entry + 12);
+                if (qint64(offset) + length <= chunk->size) {
+                    decodePostings(chunk->data + offset, chunk->data + offset + length,
+                                   chunk->firstDocument, first, end, documents);
+                }
+                break;
+            }
+
+            if (cmp < 0) {
+                lo = mid + 1;
+            }
+            else {
+                hi = mid - 1;
+            }
+        }
+    }
+
+    auto it = m_delta.constFind(term);
+    if (it != m_delta.constEnd()) {
+        const uchar *data = reinterpret_cast<const uchar *>(it->data.constData());
+        decodePostings(data, data + it->data.size(), m_committed, first, end, documents);
+    }
+}
+
+void SearchIndex::decodePostings(const uchar *p, const uchar *limit, quint32 base,
+                                 quint32 first, quint32 end,
+                                 QVector<quint32> &documents)
+{
+    quint32 document = base;
+    quint32 delta;
+
+    while (p < limit && takeVarint(p, limit, delta)) {
+        document += delta;
+        if (document >= end) {
+            break;
+        }
+        if (document >= first) {
+            documents.append(document);
+        }
+    }
+}
@@ -0,0 +1,141 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef SEARCHINDEX_H
+#define SEARCHINDEX_H
+
+#include <QFile>
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+struct HistoryRecord;
+
+// Инвертированный индекс по истории сообщений.
+// Каждое сообщение истории - документ с последовательным номером.
+// Для каждого слова хранится список номеров документов, закодированный
+// разностями в varint. Свежие документы индексируются в памяти, а по
+// накоплении сбрасываются в неизменяемый файл-кусок search-NNNNNN.chunk,
+// поэтому индекс растёт вместе с историей и никогда не перестраивается.
+// Маленький кусок, сброшенный при завершении программы, при следующем
+// открытии забирается обратно в память и потом записывается заново
+// вместе с новыми документами, так что число кусков не растёт с запусками.
+// Таблица документов search.docs хранит время, хэш автора и положение
+// записи в сегментах истории.
+class SearchIndex
+{
+public:
+    struct Location
+    {
+        int segment;
+        quint32 offset;
+    };
+
+    explicit SearchIndex(const QString &path);
+    ~SearchIndex();
+
+    quint32 documentCount() const;
+
+    // Документы с этого номера есть в таблице, но не попали ни в куски,
+    // ни в память (например, после аварийного завершения) и должны быть
+    // проиндексированы заново
+    quint32 indexedCount() const;
+    Location location(quint32 document) const;
+
+    void addDocument(const HistoryRecord &record, int segment, quint32 offset);
+    void indexDocument(quint32 document, const HistoryRecord &record);
+
+    // Дописывает таблицу документов и при необходимости сбрасывает кусок
+    void flush(bool commitAll = false);
+
+    // Автор отбирается только по хэшу имени: при совпадении хэшей
+    // вызывающий должен сверить имя в самой записи
+    QVector<Location> search(const QString &query,
+                             const QString &userName,
+                             qint64 from,
+                             qint64 to,
+                             int limit) const;
+
+    static QStringList tokenize(const QString &text);
+    static quint32 userHash(const QString &userName);
+
+    static const int ChunkDocuments = 20000;
+
+private:
+    struct Document
+    {
+        qint64 timestamp;
+        quint32 userHash;
+        quint32 segment;
+        quint32 offset;
+    };
+
+    struct Postings
+    {
+        QByteArray data; // номера документов разностями в varint
+        quint32 lastDocument;
+    };
+
+    struct Chunk
+    {
+        QFile file;
+        const uchar *data;
+        qint64 size;
+        quint32 termCount;
+        quint32 firstDocument;
+        quint32 endDocument;
+    };
+
+    void loadDocuments();
+    void loadChunks();
+    bool openChunk(const QString &fileName);
+    void absorbChunk(Chunk *chunk);
+    void commit();
+
+    void collect(const QByteArray &term, quint32 first, quint32 end,
+                 QVector<quint32> &documents) const;
+    static void decodePostings(const uchar *p, const uchar *limit, quint32 base,
+                               quint32 first, quint32 end,
+                               QVector<quint32> &documents);
+
+    QString m_path;
+
+    QVector<Document> m_documents;
+    int m_savedDocuments; // сколько документов уже лежит в search.docs
+    QFile m_documentsFile;
+
+    QList<Chunk *> m_chunks;
+    quint32 m_committed; // документов в открытых кусках на диске
+    quint32 m_indexed; // документов в кусках при открытии, вместе с забранными в память
+    QStringList m_absorbed; // файлы кусков, забранных в память до следующего сброса
+
+    QHash<QByteArray, Postings> m_delta; // слова свежих документов
+};
+
+#endif // SEARCHINDEX_H
@@ -0,0 +1,73 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef SENDQUEUE_H
+#define SENDQUEUE_H
+
+#include <QQueue>
+#include <QString>
+
+// Исходящее сообщение, ещё не упакованное в кадр.
+// Упаковка откладывается до отправки, потому что формат обмена
+// может смениться, пока сообщение ждёт в очереди.
+struct OutgoingMessage
+{
+    enum Kind {
+        Pong,
+        Chat
+    };
+
+    Kind kind;
+    int toUserId;
+    QString text;
+    qint64 queued; // мкс по ChatEvent::now(); для Pong - когда пришёл Ping
+};
+
+// Очередь исходящих сообщений с двумя полосами.
+// Служебные кадры (Pong) всегда уходят раньше обычных сообщений чата,
+// а сообщения чата ждут, пока объём неподтверждённых данных не опустится
+// ниже верхней отметки. Сообщения чата переживают разрыв соединения.
+class SendQueue
+{
+public:
+    SendQueue();
+
+    void enqueue(const OutgoingMessage &message);
+    bool takeNext(OutgoingMessage &message, bool allowChat);
+
+    // При разрыве служебные кадры теряют смысл, а сообщения чата остаются
+    void dropControl();
+
+    bool isEmpty() const;
+    int depth() const;
+
+private:
+    QQueue<OutgoingMessage> m_control;
+    QQueue<OutgoingMessage> m_chat;
+};
+
+#endif // SENDQUEUE_H
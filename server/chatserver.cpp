@@ -0,0 +1,654 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "chatserver.h"
+
+#include <QCborMap>
+#include <QCborValue>
+#include <QDateTime>
+#include <QDebug>
+#include <QHostAddress>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRandomGenerator>
+#include <QTimer>
+#include <QUrlQuery>
+#include <QWebSocket>
+#include <QWebSocketServer>
+
+namespace {
+
+const int TickInterval = 10; // мс между тактами имитации
+const int FirstBotId = 1000000; // id имитируемых пользователей не пересекаются с настоящими
+const int PongTimeouts = 3; // сколько интервалов Ping ждём ответа
+
+const char *const BotColors[] = {
+    "#34495e", "#16a085", "#27ae60", "#2980b9", "#8e44ad",
+    "#f39c12", "#d35400", "#c0392b", "#7f8c8d", "#2c3e50"
+};
+
+const char *const BotPhrases[] = {
+    "Всем привет!",
+    "Кто-нибудь видел вчерашний матч?",
+    "Проверка связи",
+    "Сегодня отличная погода, а у вас?",
+    "Ссылку на документацию скиньте, пожалуйста",
+    "Ок, понял",
+    "Через пять минут буду"
+};
+
+} // namespace
+
+ChatServer::ChatServer(const ServerOptions &options, QObject *parent) :
+    QObject(parent),
+    m_options(options),
+    m_server(new QWebSocketServer("SimpleChat stand-in", QWebSocketServer::NonSecureMode, this)),
+    m_nextUserId(1),
+    m_nextBotId(FirstBotId),
+    m_botMessages(0),
+    m_fanoutTimer(new QTimer(this)),
+    m_burstTimer(new QTimer(this)),
+    m_presenceTimer(new QTimer(this)),
+    m_pingTimer(new QTimer(this)),
+    m_dropTimer(new QTimer(this)),
+    m_delayTimer(new QTimer(this)),
+    m_reportTimer(new QTimer(this)),
+    m_lastFanout(0),
+    m_fanoutCredit(0),
+    m_lastPresence(0),
+    m_presenceCredit(0),
+    // Номера начинаются от текущего времени: после перезапуска сервера
+    // они больше любого выданного раньше, и старый since не совпадёт
+    // с чужим событием, а даст полный список
+    m_sequence(quint64(QDateTime::currentMSecsSinceEpoch()) * 1000),
+    m_resyncDrops(options.resyncDrops),
+    m_framesSent(0),
+    m_bytesSent(0),
+    m_framesReceived(0),
+    m_snapshots(0),
+    m_resyncs(0)
+{
+    m_clock.start();
+
+    connect(m_server, &QWebSocketServer::newConnection,
+            this, &ChatServer::onNewConnection);
+
+    m_bots.reserve(m_options.rosterSize);
+    for (int i = 0; i < m_options.rosterSize; i++) {
+        m_bots.append(makeBot());
+    }
+
+    m_fanoutTimer->setInterval(TickInterval);
+    m_fanoutTimer->setTimerType(Qt::PreciseTimer);
+    connect(m_fanoutTimer, &QTimer::timeout,
+            this, &ChatServer::fanoutTick);
+
+    m_burstTimer->setInterval(m_options.burstInterval);
+    connect(m_burstTimer, &QTimer::timeout,
+            this, &ChatServer::burst);
+
+    m_presenceTimer->setInterval(TickInterval);
+    connect(m_presenceTimer, &QTimer::timeout,
+            this, &ChatServer::presenceTick);
+
+    m_pingTimer->setInterval(m_options.pingInterval * 1000);
+    connect(m_pingTimer, &QTimer::timeout,
+            this, &ChatServer::ping);
+
+    m_dropTimer->setInterval(m_options.dropInterval * 1000);
+    connect(m_dropTimer, &QTimer::timeout,
+            this, &ChatServer::dropAll);
+
+    m_delayTimer->setSingleShot(true);
+    m_delayTimer->setTimerType(Qt::PreciseTimer);
+    connect(m_delayTimer, &QTimer::timeout,
+            this, &ChatServer::flushDelayed);
+
+    m_reportTimer->setInterval(5000);
+    connect(m_reportTimer, &QTimer::timeout,
+            this, &ChatServer::report);
+}
+
+ChatServer::~ChatServer()
+{
+    qDeleteAll(m_sockets);
+}
+
+bool ChatServer::listen()
+{
+    QHostAddress address = m_options.anyAddress ? QHostAddress::Any : QHostAddress::LocalHost;
+    if (!m_server->listen(address, m_options.port)) {
+        qWarning() << "cannot listen on port" << m_options.port << m_server->errorString();
+        return false;
+    }
+
+    qInfo() << "listening on" << m_server->serverUrl().toString()
+            << "roster" << m_bots.size()
+            << "fanout" << m_options.fanoutRate << "msg/s";
+
+    if (m_options.fanoutRate > 0) {
+        m_fanoutTimer->start();
+    }
+    if (m_options.burstInterval > 0 && m_options.burstSize > 0) {
+        m_burstTimer->start();
+    }
+    if (m_options.presenceRate > 0) {
+        m_presenceTimer->start();
+    }
+    if (m_options.pingInterval > 0) {
+        m_pingTimer->start();
+    }
+    if (m_options.dropInterval > 0) {
+        m_dropTimer->start();
+    }
+    m_reportTimer->start();
+
+    return true;
+}
+
+quint16 ChatServer::serverPort() const
+{
+    return m_server->serverPort();
+}
+
+void ChatServer::onNewConnection()
+{
+    while (QWebSocket *socket = m_server->nextPendingConnection()) {
+        QUrlQuery query(socket->requestUrl());
+
+        QString userName = query.queryItemValue("userName", QUrl::FullyDecoded).trimmed();
+        if (userName.isEmpty()) {
+            socket->close(QWebSocketProtocol::CloseCodePolicyViolated, "userName is required");
+            socket->deleteLater();
+            continue;
+        }
+
+        Session *session = new Session;
+        session->socket = socket;
+        session->user.userId = m_nextUserId++;
+        session->user.userName = userName.toHtmlEscaped();
+        session->user.userColor = query.queryItemValue("userColor", QUrl::FullyDecoded);
+        session->user.gender = qBound(0, query.queryItemValue("gender").toInt(), 2);
+        session->format = query.queryItemValue("format") == "cbor" ? Protocol::CborFormat
+                                                                   : Protocol::JsonFormat;
+        session->lastPong = m_clock.elapsed();
+
+        m_sockets.insert(socket, session);
+        m_sessions.insert(session->user.userId, session);
+
+        connect(socket, &QWebSocket::disconnected,
+                this, &ChatServer::onDisconnected);
+        connect(socket, &QWebSocket::textMessageReceived,
+                this, &ChatServer::onTextMessageReceived);
+        connect(socket, &QWebSocket::binaryMessageReceived,
+                this, &ChatServer::onBinaryMessageReceived);
+
+        // Новому пользователю - список всех остальных или, если он
+        // переподключился, только пропущенное; остальным - о нём
+        bool resumed = false;
+        quint64 since = query.queryItemValue("since").toULongLong(&resumed);
+        if (!resumed || !resync(session, since)) {
+            authorize(session);
+        }
+
+        ChatEvent connected;
+        connected.type = ChatEvent::Connected;
+        connected.userId = session->user.userId;
+        connected.userName = session->user.userName;
+        connected.gender = session->user.gender;
+        connected.userColor = session->user.userColor;
+        broadcast(connected, session->user.userId);
+    }
+}
+
+void ChatServer::onDisconnected()
+{
+    QWebSocket *socket = qobject_cast<QWebSocket *>(sender());
+    Session *session = m_sockets.value(socket);
+    if (session) {
+        removeSession(session, ChatEvent::Disconnected);
+    }
+}
+
+void ChatServer::onTextMessageReceived(const QString &message)
+{
+    Session *session = m_sockets.value(qobject_cast<QWebSocket *>(sender()));
+    if (!session) {
+        return;
+    }
+    m_framesReceived++;
+
+    // Кадры клиента: {"action":"Pong"} или {"toUserId":N,"text":"..."}
+    QJsonObject object = QJsonDocument::fromJson(message.toUtf8()).object();
+    if (object.value("action").toString() == "Pong") {
+        handlePong(session);
+    }
+    else if (object.contains("text")) {
+        handleMessage(session, object.value("toUserId").toInt(), object.value("text").toString());
+    }
+}
+
+void ChatServer::onBinaryMessageReceived(const QByteArray &message)
+{
+    Session *session = m_sockets.value(qobject_cast<QWebSocket *>(sender()));
+    if (!session) {
+        return;
+    }
+    m_framesReceived++;
+
+    QCborMap map = QCborValue::fromCbor(message).toMap();
+    if (map.value(qint64(Protocol::KeyAction)).toInteger() == Protocol::ActionPong) {
+        handlePong(session);
+    }
+    else if (map.contains(qint64(Protocol::KeyText))) {
+        handleMessage(session,
+                      int(map.value(qint64(Protocol::KeyToUserId)).toInteger()),
+                      map.value(qint64(Protocol::KeyText)).toString());
+    }
+}
+
+void ChatServer::fanoutTick()
+{
+    qint64 now = m_clock.elapsed();
+    m_fanoutCredit += m_options.fanoutRate * (now - m_lastFanout) / 1000.0;
+    m_fanoutCredit = qMin(m_fanoutCredit, qMax(1.0, m_options.fanoutRate));
+    m_lastFanout = now;
+
+    while (m_fanoutCredit >= 1.0) {
+        sendBotMessage();
+        m_fanoutCredit -= 1.0;
+    }
+}
+
+void ChatServer::burst()
+{
+    for (int i = 0; i < m_options.burstSize; i++) {
+        sendBotMessage();
+    }
+}
+
+void ChatServer::presenceTick()
+{
+    qint64 now = m_clock.elapsed();
+    m_presenceCredit += m_options.presenceRate * (now - m_lastPresence) / 1000.0;
+    m_presenceCredit = qMin(m_presenceCredit, qMax(1.0, m_options.presenceRate));
+    m_lastPresence = now;
+
+    QRandomGenerator *random = QRandomGenerator::global();
+
+    // Каждый шаг один имитируемый пользователь уходит, а другой приходит,
+    // так что размер списка остаётся примерно постоянным
+    while (m_presenceCredit >= 1.0) {
+        m_presenceCredit -= 1.0;
+
+        if (!m_bots.isEmpty()) {
+            int index = random->bounded(m_bots.size());
+            ChatUser bot = m_bots.at(index);
+            m_bots[index] = m_bots.last();
+            m_bots.removeLast();
+
+            ChatEvent left;
+            left.type = random->bounded(4) == 0 ? ChatEvent::ConnectionLost
+                                                 : ChatEvent::Disconnected;
+            left.userId = bot.userId;
+            left.userName = bot.userName;
+            left.gender = bot.gender;
+            left.userColor = bot.userColor;
+            broadcast(left);
+        }
+
+        ChatUser bot = makeBot();
+        m_bots.append(bot);
+
+        ChatEvent joined;
+        joined.type = ChatEvent::Connected;
+        joined.userId = bot.userId;
+        joined.userName = bot.userName;
+        joined.gender = bot.gender;
+        joined.userColor = bot.userColor;
+        broadcast(joined);
+    }
+}
+
+void ChatServer::ping()
+{
+    qint64 now = m_clock.elapsed();
+    qint64 timeout = qint64(m_options.pingInterval) * 1000 * PongTimeouts;
+
+    ChatEvent event;
+    event.type = ChatEvent::Ping;
+
+    foreach (Session *session, m_sessions.values()) {
+        if (now - session->lastPong > timeout) {
+            removeSession(session, ChatEvent::ConnectionLost);
+        }
+        else {
+            send(session, event);
+        }
+    }
+}
+
+void ChatServer::dropAll()
+{
+    // Имитация обрыва сети: клиенты переподключаются и догоняют пропущенное
+    qInfo() << "dropping" << m_sessions.size() << "sessions";
+
+    foreach (Session *session, m_sessions.values()) {
+        removeSession(session, ChatEvent::ConnectionLost);
+    }
+}
+
+void ChatServer::flushDelayed()
+{
+    qint64 now = m_clock.elapsed();
+
+    // Очередь общая и FIFO: кадр с меньшей случайной задержкой не обгоняет
+    // предыдущий, поэтому порядок кадров для каждого клиента сохраняется
+    while (!m_delayed.isEmpty() && m_delayed.head().due <= now) {
+        DelayedFrame delayed = m_delayed.dequeue();
+        if (delayed.frame.isEmpty()) {
+            drop(delayed.userId);
+            continue;
+        }
+
+        Session *session = m_sessions.value(delayed.userId);
+        if (session) {
+            write(session, delayed.frame);
+        }
+    }
+
+    if (!m_delayed.isEmpty()) {
+        m_delayTimer->start(int(qMax<qint64>(0, m_delayed.head().due - now)));
+    }
+}
+
+void ChatServer::report()
+{
+    qInfo().noquote() << QString("sessions %1 roster %2 | sent %3 frames %4 KiB | received %5 frames | delayed %6"
+                                 " | authorized %7 resynced %8")
+                         .arg(m_sessions.size())
+                         .arg(m_sessions.size() + m_bots.size())
+                         .arg(m_framesSent)
+                         .arg(m_bytesSent / 1024)
+                         .arg(m_framesReceived)
+                         .arg(m_delayed.size())
+                         .arg(m_snapshots)
+                         .arg(m_resyncs);
+}
+
+void ChatServer::authorize(Session *session)
+{
+    ChatEvent authorized;
+    authorized.type = ChatEvent::Authorized;
+    authorized.userId = session->user.userId;
+    authorized.userName = session->user.userName;
+    authorized.gender = session->user.gender;
+    authorized.users = roster(session->user.userId);
+    authorized.sequence = m_sequence;
+    send(session, authorized);
+
+    m_snapshots++;
+}
+
+bool ChatServer::resync(Session *session, quint64 since)
+{
+    // Журнал хранит события подряд, поэтому первое пропущенное
+    // находится по разности номеров
+    quint64 first = m_eventLog.isEmpty() ? m_sequence + 1 : m_eventLog.head().sequence;
+    if (m_options.resyncLog <= 0 || since > m_sequence || since + 1 < first) {
+        return false;
+    }
+
+    ChatEvent resynced;
+    resynced.type = ChatEvent::Resynced;
+    resynced.userId = session->user.userId;
+    resynced.userName = session->user.userName;
+    resynced.gender = session->user.gender;
+    resynced.sequence = m_sequence;
+    send(session, resynced);
+
+    // Имитация обрыва посреди догона: клиент получает Resynced
+    // и только первую половину пропущенного
+    int from = int(since + 1 - first);
+    int to = m_eventLog.size();
+    bool cut = m_resyncDrops > 0 && to - from >= 2;
+    if (cut) {
+        to = from + (to - from) / 2;
+        m_resyncDrops--;
+    }
+
+    for (int i = from; i < to; i++) {
+        send(session, m_eventLog.at(i));
+    }
+
+    if (cut) {
+        dropLater(session);
+    }
+
+    m_resyncs++;
+    return true;
+}
+
+void ChatServer::handleMessage(Session *session, int toUserId, const QString &text)
+{
+    QString trimmed = text.trimmed();
+    if (trimmed.isEmpty()) {
+        return;
+    }
+
+    ChatEvent event;
+    event.userId = session->user.userId;
+    event.userName = session->user.userName;
+    event.gender = session->user.gender;
+    event.userColor = session->user.userColor;
+    event.text = trimmed.toHtmlEscaped();
+
+    if (toUserId == 0) {
+        event.type = ChatEvent::PublicMessage;
+        broadcast(event);
+        return;
+    }
+
+    // Приватное сообщение получают адресат и, как эхо, отправитель
+    event.type = ChatEvent::PrivateMessage;
+    if (Session *recipient = m_sessions.value(toUserId)) {
+        send(recipient, event);
+    }
+    send(session, event);
+}
+
+void ChatServer::handlePong(Session *session)
+{
+    session->lastPong = m_clock.elapsed();
+}
+
+void ChatServer::removeSession(Session *session, ChatEvent::Type reason)
+{
+    m_sockets.remove(session->socket);
+    m_sessions.remove(session->user.userId);
+
+    disconnect(session->socket, nullptr, this, nullptr);
+    if (reason == ChatEvent::ConnectionLost) {
+        session->socket->abort();
+    }
+    session->socket->deleteLater();
+
+    ChatEvent event;
+    event.type = reason;
+    event.userId = session->user.userId;
+    event.userName = session->user.userName;
+    event.gender = session->user.gender;
+    event.userColor = session->user.userColor;
+    broadcast(event);
+
+    delete session;
+}
+
+void ChatServer::dropLater(Session *session)
+{
+    // Соединение обрывается после уже поставленных в очередь кадров
+    // и не раньше, чем вызывающий закончит работать с сессией
+    int userId = session->user.userId;
+    if (m_options.latency <= 0 && m_options.jitter <= 0) {
+        QTimer::singleShot(0, this, [this, userId]() {
+            drop(userId);
+        });
+        return;
+    }
+
+    DelayedFrame delayed;
+    delayed.due = m_delayed.isEmpty() ? m_clock.elapsed() : m_delayed.last().due;
+    delayed.userId = userId;
+
+    if (m_delayed.isEmpty()) {
+        m_delayTimer->start(0);
+    }
+    m_delayed.enqueue(delayed);
+}
+
+void ChatServer::drop(int userId)
+{
+    Session *session = m_sessions.value(userId);
+    if (session) {
+        session->socket->flush();
+        removeSession(session, ChatEvent::ConnectionLost);
+    }
+}
+
+void ChatServer::send(Session *session, const ChatEvent &event)
+{
+    deliver(session, Protocol::encodeEvent(event, session->format));
+}
+
+void ChatServer::broadcast(const ChatEvent &event, int exceptUserId)
+{
+    // Разосланное всем событие получает номер и попадает в журнал
+    ChatEvent numbered = event;
+    numbered.sequence = ++m_sequence;
+
+    if (m_options.resyncLog > 0) {
+        m_eventLog.enqueue(numbered);
+        while (m_eventLog.size() > m_options.resyncLog) {
+            m_eventLog.dequeue();
+        }
+    }
+
+    // Кадр упаковывается один раз на каждый формат, а не на каждого клиента
+    QByteArray frames[2];
+
+    foreach (Session *session, m_sessions) {
+        if (session->user.userId == exceptUserId) {
+            continue;
+        }
+
+        QByteArray &frame = frames[session->format];
+        if (frame.isEmpty()) {
+            frame = Protocol::encodeEvent(numbered, session->format);
+        }
+        deliver(session, frame);
+    }
+}
+
+void ChatServer::deliver(Session *session, const QByteArray &frame)
+{
+    if (m_options.latency <= 0 && m_options.jitter <= 0) {
+        write(session, frame);
+        return;
+    }
+
+    DelayedFrame delayed;
+    delayed.due = m_clock.elapsed() + m_options.latency;
+    if (m_options.jitter > 0) {
+        delayed.due += QRandomGenerator::global()->bounded(m_options.jitter + 1);
+    }
+    delayed.userId = session->user.userId;
+    delayed.frame = frame;
+
+    if (m_delayed.isEmpty()) {
+        m_delayTimer->start(int(delayed.due - m_clock.elapsed()));
+    }
+    m_delayed.enqueue(delayed);
+}
+
+void ChatServer::write(Session *session, const QByteArray &frame)
+{
+    if (session->format == Protocol::CborFormat) {
+        m_bytesSent += session->socket->sendBinaryMessage(frame);
+    }
+    else {
+        m_bytesSent += session->socket->sendTextMessage(QString::fromUtf8(frame));
+    }
+    m_framesSent++;
+}
+
+void ChatServer::sendBotMessage()
+{
+    if (m_bots.isEmpty() || m_sessions.isEmpty()) {
+        return;
+    }
+
+    QRandomGenerator *random = QRandomGenerator::global();
+    const ChatUser &bot = m_bots.at(random->bounded(m_bots.size()));
+
+    ChatEvent event;
+    event.type = ChatEvent::PublicMessage;
+    event.userId = bot.userId;
+    event.userName = bot.userName;
+    event.gender = bot.gender;
+    event.userColor = bot.userColor;
+    event.text = QString("%1 #%2")
+            .arg(BotPhrases[random->bounded(int(sizeof(BotPhrases) / sizeof(BotPhrases[0])))])
+            .arg(++m_botMessages);
+    broadcast(event);
+}
+
+ChatUser ChatServer::makeBot()
+{
+    QRandomGenerator *random = QRandomGenerator::global();
+
+    ChatUser bot;
+    bot.userId = m_nextBotId++;
+    bot.userName = QString("bot%1").arg(bot.userId - FirstBotId);
+    bot.gender = random->bounded(3);
+    bot.userColor = BotColors[random->bounded(int(sizeof(BotColors) / sizeof(BotColors[0])))];
+    return bot;
+}
+
+QVector<ChatUser> ChatServer::roster(int exceptUserId) const
+{
+    QVector<ChatUser> users;
+    users.reserve(m_sessions.size() + m_bots.size());
+
+    foreach (const Session *session, m_sessions) {
+        if (session->user.userId != exceptUserId) {
+            users.append(session->user);
+        }
+    }
+    users += m_bots;
+
+    return users;
+}
@@ -0,0 +1,166 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef CHATSERVER_H
+#define CHATSERVER_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMap>
+#include <QObject>
+#include <QQueue>
+#include <QVector>
+
+#include "protocol.h"
+
+class QTimer;
+class QWebSocket;
+class QWebSocketServer;
+
+struct ServerOptions
+{
+    quint16 port;
+    bool anyAddress; // слушать все интерфейсы, а не только loopback
+    int rosterSize; // имитируемых пользователей в списке
+    double fanoutRate; // сообщений в секунду от имитируемых пользователей
+    int burstSize; // сообщений в одном всплеске
+    int burstInterval; // мс между всплесками, 0 - без всплесков
+    double presenceRate; // входов и выходов имитируемых пользователей в секунду
+    int latency; // искусственная задержка исходящих кадров, мс
+    int jitter; // случайная добавка к задержке, мс
+    int pingInterval; // с между Ping, 0 - не пинговать
+    int resyncLog; // событий, которые помнятся для переподключений, 0 - всегда полный список
+    int dropInterval; // с между обрывами всех соединений, 0 - не обрывать
+    int resyncDrops; // сколько первых догонов оборвать на середине
+};
+
+// Тестовый сервер чата.
+// Принимает клиентов с параметрами userName/userColor/gender/format,
+// отвечает Authorized со списком пользователей, рассылает Connected,
+// Disconnected, ConnectionLost, сообщения и Ping. Имитируемые
+// пользователи существуют только в списке и в рассылке, поэтому нагрузку
+// на клиент можно поднять, не открывая тысячи соединений.
+//
+// Разосланные события нумеруются и хранятся в ограниченном журнале.
+// Клиент, переподключившийся с параметром since, получает Resynced
+// и события после since вместо полного списка пользователей.
+class ChatServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ChatServer(const ServerOptions &options, QObject *parent = nullptr);
+    ~ChatServer();
+
+    bool listen();
+    quint16 serverPort() const; // порт после listen(), если в настройках 0
+
+private slots:
+    void onNewConnection();
+    void onDisconnected();
+    void onTextMessageReceived(const QString &message);
+    void onBinaryMessageReceived(const QByteArray &message);
+    void fanoutTick();
+    void burst();
+    void presenceTick();
+    void ping();
+    void dropAll();
+    void flushDelayed();
+    void report();
+
+private:
+    struct Session
+    {
+        QWebSocket *socket;
+        ChatUser user;
+        Protocol::WireFormat format;
+        qint64 lastPong; // мс по часам сервера
+    };
+
+    // Кадр, ожидающий искусственной задержки
+    struct DelayedFrame
+    {
+        qint64 due; // мс по часам сервера
+        int userId;
+        QByteArray frame; // пустой - оборвать соединение
+    };
+
+    void authorize(Session *session);
+    bool resync(Session *session, quint64 since);
+    void handleMessage(Session *session, int toUserId, const QString &text);
+    void handlePong(Session *session);
+    void removeSession(Session *session, ChatEvent::Type reason);
+    void dropLater(Session *session);
+    void drop(int userId);
+
+    void send(Session *session, const ChatEvent &event);
+    void broadcast(const ChatEvent &event, int exceptUserId = 0);
+    void deliver(Session *session, const QByteArray &frame);
+    void write(Session *session, const QByteArray &frame);
+
+    void sendBotMessage();
+    ChatUser makeBot();
+    QVector<ChatUser> roster(int exceptUserId) const;
+
+    ServerOptions m_options;
+    QWebSocketServer *m_server;
+    QElapsedTimer m_clock;
+
+    QHash<QWebSocket *, Session *> m_sockets;
+    QMap<int, Session *> m_sessions; // по userId
+    int m_nextUserId;
+
+    QVector<ChatUser> m_bots; // имитируемые пользователи
+    int m_nextBotId;
+    qint64 m_botMessages; // номер следующего сообщения имитируемых пользователей
+
+    QTimer *m_fanoutTimer;
+    QTimer *m_burstTimer;
+    QTimer *m_presenceTimer;
+    QTimer *m_pingTimer;
+    QTimer *m_dropTimer;
+    QTimer *m_delayTimer;
+    QTimer *m_reportTimer;
+    qint64 m_lastFanout; // мс
+    double m_fanoutCredit;
+    qint64 m_lastPresence; // мс
+    double m_presenceCredit;
+
+    QQueue<DelayedFrame> m_delayed;
+
+    quint64 m_sequence; // номер последнего разосланного события
+    QQueue<ChatEvent> m_eventLog; // последние разосланные события подряд по номерам
+    int m_resyncDrops; // сколько догонов ещё оборвать
+
+    qint64 m_framesSent;
+    qint64 m_bytesSent;
+    qint64 m_framesReceived;
+    qint64 m_snapshots; // ответов полным списком
+    qint64 m_resyncs; // ответов пропущенными событиями
+};
+
+#endif // CHATSERVER_H
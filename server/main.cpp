@@ -0,0 +1,82 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "chatserver.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    a.setApplicationName("simplechat-server");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("SimpleChat stand-in server for local benchmarks");
+    parser.addHelpOption();
+
+    QCommandLineOption portOption("port", "Port to listen on.", "port", "27800");
+    QCommandLineOption anyOption("any", "Listen on all interfaces instead of loopback.");
+    QCommandLineOption rosterOption("roster", "Simulated users in the roster.", "count", "0");
+    QCommandLineOption fanoutOption("fanout", "Messages per second from simulated users.", "rate", "0");
+    QCommandLineOption burstSizeOption("burst-size", "Messages in one burst.", "count", "0");
+    QCommandLineOption burstIntervalOption("burst-interval", "Milliseconds between bursts.", "ms", "0");
+    QCommandLineOption presenceOption("presence", "Simulated joins and leaves per second.", "rate", "0");
+    QCommandLineOption latencyOption("latency", "Artificial delay of outgoing frames.", "ms", "0");
+    QCommandLineOption jitterOption("jitter", "Random extra delay of outgoing frames.", "ms", "0");
+    QCommandLineOption pingOption("ping-interval", "Seconds between Ping frames, 0 to disable.", "seconds", "10");
+    QCommandLineOption resyncOption("resync-log", "Broadcast events kept for reconnecting clients, 0 to always send the full roster.", "count", "10000");
+    QCommandLineOption dropOption("drop-interval", "Seconds between dropping all connections, 0 to disable.", "seconds", "0");
+    QCommandLineOption resyncDropsOption("resync-drops", "Catch-ups to cut off halfway by dropping the connection.", "count", "0");
+    parser.addOptions({ portOption, anyOption, rosterOption, fanoutOption,
+                        burstSizeOption, burstIntervalOption, presenceOption,
+                        latencyOption, jitterOption, pingOption,
+                        resyncOption, dropOption, resyncDropsOption });
+    parser.process(a);
+
+    ServerOptions options;
+    options.port = quint16(parser.value(portOption).toUInt());
+    options.anyAddress = parser.isSet(anyOption);
+    options.rosterSize = qMax(0, parser.value(rosterOption).toInt());
+    options.fanoutRate = qMax(0.0, parser.value(fanoutOption).toDouble());
+    options.burstSize = qMax(0, parser.value(burstSizeOption).toInt());
+    options.burstInterval = qMax(0, parser.value(burstIntervalOption).toInt());
+    options.presenceRate = qMax(0.0, parser.value(presenceOption).toDouble());
+    options.latency = qMax(0, parser.value(latencyOption).toInt());
+    options.jitter = qMax(0, parser.value(jitterOption).toInt());
+    options.pingInterval = qMax(0, parser.value(pingOption).toInt());
+    options.resyncLog = qMax(0, parser.value(resyncOption).toInt());
+    options.dropInterval = qMax(0, parser.value(dropOption).toInt());
+    options.resyncDrops = qMax(0, parser.value(resyncDropsOption).toInt());
+
+    ChatServer server(options);
+    if (!server.listen()) {
+        return 1;
+    }
+
+    return a.exec();
+}
@@ -0,0 +1,15 @@
+# Тестовый сервер чата для локальных замеров.
+# Говорит на том же протоколе, что ожидает клиент, и умеет
+# имитировать большой список пользователей и поток сообщений.
+QT += core websockets
+QT -= gui
+
+TARGET = simplechat-server
+TEMPLATE = app
+DEFINES += QT_DEPRECATED_WARNINGS
+CONFIG += c++11 console
+CONFIG -= app_bundle
+SOURCES += main.cpp chatserver.cpp
+HEADERS += chatserver.h
+
+include(../protocol.pri)
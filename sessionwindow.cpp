@@ -0,0 +1,348 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "sessionwindow.h"
+#include "widget.h"
+#include "memorydialog.h"
+#include "trace.h"
+
+#include <QApplication>
+#include <QColor>
+#include <QHBoxLayout>
+#include <QSettings>
+#include <QShortcut>
+#include <QTabBar>
+#include <QTabWidget>
+#include <QThread>
+#include <QTimer>
+#include <QToolButton>
+#include <QVBoxLayout>
+
+SessionWindow::SessionWindow(QThread *networkThread,
+                             ConnectionWorker *worker,
+                             QWidget *parent) :
+    QWidget(parent),
+    m_tabs(new QTabWidget(this)),
+    m_networkThread(networkThread ? networkThread : new QThread(this)),
+    m_historyThread(new QThread(this)),
+    m_memoryTrimmed(0),
+    m_memoryTimer(new QTimer(this)),
+    m_memoryDialog(nullptr)
+{
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->setContentsMargins(0, 0, 0, 0);
+    layout->addWidget(m_tabs);
+
+    m_tabs->setDocumentMode(true);
+    m_tabs->setTabsClosable(true);
+    m_tabs->setMovable(true);
+    connect(m_tabs, &QTabWidget::currentChanged,
+            this, &SessionWindow::onCurrentChanged);
+    connect(m_tabs, &QTabWidget::tabCloseRequested,
+            this, &SessionWindow::closeSession);
+
+    // Новая сессия - кнопкой в углу панели вкладок или Ctrl+T.
+    // Рядом - диагностика памяти.
+    QWidget *corner = new QWidget(m_tabs);
+    QHBoxLayout *cornerLayout = new QHBoxLayout(corner);
+    cornerLayout->setContentsMargins(0, 0, 0, 0);
+    cornerLayout->setSpacing(0);
+
+    QToolButton *memoryButton = new QToolButton(corner);
+    memoryButton->setText("Память");
+    memoryButton->setToolTip("Сколько памяти занимают сессии");
+    memoryButton->setAutoRaise(true);
+    cornerLayout->addWidget(memoryButton);
+    connect(memoryButton, &QToolButton::clicked,
+            this, &SessionWindow::showMemory);
+
+    QToolButton *newButton = new QToolButton(corner);
+    newButton->setText("+");
+    newButton->setToolTip("Новое подключение (Ctrl+T)");
+    newButton->setAutoRaise(true);
+    cornerLayout->addWidget(newButton);
+    connect(newButton, &QToolButton::clicked,
+            this, &SessionWindow::newSession);
+
+    m_tabs->setCornerWidget(corner, Qt::TopRightCorner);
+    QShortcut *newShortcut = new QShortcut(QKeySequence::AddTab, this);
+    connect(newShortcut, &QShortcut::activated,
+            this, &SessionWindow::newSession);
+
+    // Все соединения обслуживает один сетевой поток, вся история - один поток записи
+    m_networkThread->setParent(this);
+    m_networkThread->setObjectName("network");
+    if (!m_networkThread->isRunning()) {
+        m_networkThread->start();
+    }
+    m_historyThread->setObjectName("history");
+    m_historyThread->start();
+
+    // Бюджет памяти на все сессии, МБ; 0 - без ограничения.
+    // Проверяется после каждого сброса событий и раз в секунду.
+    QSettings settings(qApp->applicationDirPath() + "/settings.ini",
+                       QSettings::IniFormat);
+    m_memoryBudget = settings.value("memoryBudget", 256).toLongLong() * 1024 * 1024;
+
+    m_memoryTimer->setInterval(1000);
+    connect(m_memoryTimer, &QTimer::timeout,
+            this, &SessionWindow::updateMemory);
+    m_memoryTimer->start();
+
+    // Трассировку можно включить сразу при запуске переменной окружения SIMPLECHAT_TRACE
+    if (qEnvironmentVariableIsSet("SIMPLECHAT_TRACE")) {
+        Trace::setEnabled(true);
+    }
+
+    // Основная сессия пишет историю туда же, где она лежала всегда,
+    // и только она сохраняет данные подключения
+    addSession("history", worker)->setPrimary(true);
+}
+
+SessionWindow::~SessionWindow()
+{
+    // Сессии закрывают соединения и дописывают историю,
+    // пока их потоки ещё работают
+    while (m_tabs->count() > 0) {
+        delete m_tabs->widget(0);
+    }
+
+    m_networkThread->quit();
+    m_networkThread->wait();
+    m_historyThread->quit();
+    m_historyThread->wait();
+
+    if (Trace::isEnabled()) {
+        Trace::setEnabled(false);
+        Widget::dumpTrace();
+    }
+
+    QSettings settings(qApp->applicationDirPath() + "/settings.ini",
+                       QSettings::IniFormat);
+    settings.setValue("memoryBudget", m_memoryBudget / (1024 * 1024));
+}
+
+Widget *SessionWindow::addSession(const QString &historyName, ConnectionWorker *worker)
+{
+    Widget *session = new Widget(m_networkThread, m_historyThread, historyName, worker);
+
+    SessionTab tab;
+    tab.title = "Новое подключение";
+    tab.unread = 0;
+    tab.highlighted = false;
+    m_sessions.insert(session, tab);
+
+    connect(session, &Widget::titleChanged,
+            this, &SessionWindow::onTitleChanged);
+    connect(session, &Widget::activity,
+            this, &SessionWindow::onActivity);
+    connect(session, &Widget::connectionCanceled,
+            this, &SessionWindow::onConnectionCanceled);
+
+    m_tabs->addTab(session, tab.title);
+    m_tabs->setCurrentWidget(session);
+
+    return session;
+}
+
+Widget *SessionWindow::currentSession() const
+{
+    return qobject_cast<Widget *>(m_tabs->currentWidget());
+}
+
+void SessionWindow::connectToServer()
+{
+    if (Widget *session = currentSession()) {
+        session->connectToServer();
+    }
+}
+
+void SessionWindow::newSession()
+{
+    addSession()->connectToServer();
+}
+
+void SessionWindow::closeSession(int index)
+{
+    Widget *session = qobject_cast<Widget *>(m_tabs->widget(index));
+    if (!session) {
+        return;
+    }
+
+    // С закрытием последней сессии закрывается и программа
+    if (m_tabs->count() == 1) {
+        close();
+        qApp->quit();
+        return;
+    }
+
+    // Сессия может закрываться из собственного обработчика (отказ от
+    // подключения), поэтому удаляется после возврата в цикл событий
+    m_sessions.remove(session);
+    m_tabs->removeTab(index);
+    session->setParent(nullptr);
+    session->deleteLater();
+}
+
+void SessionWindow::onCurrentChanged(int index)
+{
+    Widget *session = qobject_cast<Widget *>(m_tabs->widget(index));
+    if (!session || !m_sessions.contains(session)) {
+        return;
+    }
+
+    // Вкладка стала активной - всё пришедшее в ней прочитано
+    SessionTab &tab = m_sessions[session];
+    tab.unread = 0;
+    tab.highlighted = false;
+    updateTab(session);
+}
+
+void SessionWindow::onTitleChanged(const QString &title)
+{
+    Widget *session = qobject_cast<Widget *>(sender());
+    if (!session || !m_sessions.contains(session)) {
+        return;
+    }
+
+    m_sessions[session].title = title;
+    updateTab(session);
+}
+
+void SessionWindow::onActivity(int lines, bool highlighted)
+{
+    enforceMemoryBudget();
+
+    Widget *session = qobject_cast<Widget *>(sender());
+    if (!session || session == currentSession() || !m_sessions.contains(session)) {
+        return;
+    }
+
+    SessionTab &tab = m_sessions[session];
+    tab.unread += lines;
+    tab.highlighted = tab.highlighted || highlighted;
+    updateTab(session);
+}
+
+void SessionWindow::onConnectionCanceled()
+{
+    Widget *session = qobject_cast<Widget *>(sender());
+    int index = m_tabs->indexOf(session);
+    if (index >= 0) {
+        closeSession(index);
+    }
+}
+
+void SessionWindow::showMemory()
+{
+    if (!m_memoryDialog) {
+        m_memoryDialog = new MemoryDialog(this);
+    }
+
+    updateMemory();
+    m_memoryDialog->show();
+    m_memoryDialog->raise();
+    m_memoryDialog->activateWindow();
+}
+
+void SessionWindow::enforceMemoryBudget()
+{
+    if (m_memoryBudget <= 0) {
+        return;
+    }
+
+    qint64 total = 0;
+    for (int i = 0; i < m_tabs->count(); i++) {
+        Widget *session = qobject_cast<Widget *>(m_tabs->widget(i));
+        Widget::MemoryUsage usage = session->memoryUsage();
+        total += usage.log + usage.roster + usage.cache + usage.pending;
+    }
+
+    if (total <= m_memoryBudget) {
+        return;
+    }
+
+    // Сначала освобождаем неактивные вкладки, текущую - в последнюю очередь.
+    // Освобождаем с запасом, чтобы не вытеснять по строке на каждое сообщение.
+    qint64 excess = total - m_memoryBudget + m_memoryBudget / 16;
+    QVector<Widget *> order;
+    for (int i = 0; i < m_tabs->count(); i++) {
+        if (i != m_tabs->currentIndex()) {
+            order.append(qobject_cast<Widget *>(m_tabs->widget(i)));
+        }
+    }
+    if (currentSession()) {
+        order.append(currentSession());
+    }
+
+    foreach (Widget *session, order) {
+        qint64 freed = session->trimMemory(excess);
+        m_memoryTrimmed += quint64(freed);
+        excess -= freed;
+        if (excess <= 0) {
+            break;
+        }
+    }
+}
+
+void SessionWindow::updateMemory()
+{
+    // Список пользователей растёт и без новых строк журнала
+    enforceMemoryBudget();
+
+    if (!m_memoryDialog || !m_memoryDialog->isVisible()) {
+        return;
+    }
+
+    QVector<MemoryDialog::Row> rows;
+    for (int i = 0; i < m_tabs->count(); i++) {
+        Widget *session = qobject_cast<Widget *>(m_tabs->widget(i));
+
+        MemoryDialog::Row row;
+        row.session = m_sessions.value(session).title;
+        row.usage = session->memoryUsage();
+        rows.append(row);
+    }
+
+    m_memoryDialog->setUsage(rows, m_memoryBudget, m_memoryTrimmed);
+}
+
+void SessionWindow::updateTab(Widget *session)
+{
+    int index = m_tabs->indexOf(session);
+    if (index < 0) {
+        return;
+    }
+
+    const SessionTab &tab = m_sessions.value(session);
+    m_tabs->setTabText(index, tab.unread > 0
+                       ? QString("%1 (%2)").arg(tab.title).arg(tab.unread)
+                       : tab.title);
+    m_tabs->tabBar()->setTabTextColor(index, tab.highlighted
+                                      ? QColor("#c0392b")
+                                      : QColor());
+}
@@ -0,0 +1,98 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef SESSIONWINDOW_H
+#define SESSIONWINDOW_H
+
+#include <QHash>
+#include <QWidget>
+
+class Widget;
+class ConnectionWorker;
+class MemoryDialog;
+class QTabWidget;
+class QThread;
+class QTimer;
+
+// Главное окно: несколько независимых сессий чата во вкладках.
+// Сетевой поток и поток истории одни на все сессии, поэтому новая вкладка
+// стоит лишь её соединения, журнала и списка пользователей. Неактивные
+// вкладки скрыты и не рисуются, а о новых строках в них сообщает заголовок.
+// Окно же следит за общим бюджетом памяти всех сессий.
+class SessionWindow : public QWidget
+{
+    Q_OBJECT
+
+public:
+    // networkThread и worker - уже запущенные сетевой поток и обработчик
+    // основной сессии, если соединение открыто до построения окна.
+    // Окно забирает их себе; без них создаёт свои.
+    explicit SessionWindow(QThread *networkThread = nullptr,
+                           ConnectionWorker *worker = nullptr,
+                           QWidget *parent = nullptr);
+    ~SessionWindow();
+
+    Widget *addSession(const QString &historyName = QString(),
+                       ConnectionWorker *worker = nullptr);
+    Widget *currentSession() const;
+
+public slots:
+    void connectToServer();
+    void newSession();
+    void closeSession(int index);
+    void showMemory();
+
+private slots:
+    void onCurrentChanged(int index);
+    void onTitleChanged(const QString &title);
+    void onActivity(int lines, bool highlighted);
+    void onConnectionCanceled();
+    void enforceMemoryBudget();
+    void updateMemory();
+
+private:
+    struct SessionTab
+    {
+        QString title;
+        int unread; // строк, пришедших, пока вкладка была неактивна
+        bool highlighted;
+    };
+
+    void updateTab(Widget *session);
+
+    QTabWidget *m_tabs;
+    QThread *m_networkThread;
+    QThread *m_historyThread;
+    QHash<Widget *, SessionTab> m_sessions;
+
+    qint64 m_memoryBudget; // байт на все сессии, 0 - без ограничения
+    quint64 m_memoryTrimmed; // сколько освобождено по бюджету
+    QTimer *m_memoryTimer;
+    MemoryDialog *m_memoryDialog; // создаётся при первом открытии
+};
+
+#endif // SESSIONWINDOW_H
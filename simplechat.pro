@@ -1,11 +1,26 @@
-QT += core gui widgets websockets
+QT += core gui widgets network websockets
 
 TARGET = simplechat
 TEMPLATE = app
 DEFINES += QT_DEPRECATED_WARNINGS
 CONFIG += c++11
-SOURCES += main.cpp widget.cpp authdialog.cpp
-HEADERS += widget.h authdialog.h
-FORMS += widget.ui authdialog.ui
+SOURCES += main.cpp sessionwindow.cpp memorydialog.cpp widget.cpp authdialog.cpp \
+    messagelogmodel.cpp messagelogdelegate.cpp messagelogview.cpp \
+    connectionworker.cpp framecapture.cpp rostermodel.cpp rosterindex.cpp rosterfiltermodel.cpp \
+    presenceaggregator.cpp sendqueue.cpp \
+    historystore.cpp searchindex.cpp searchdialog.cpp \
+    latencyhistogram.cpp trace.cpp startup.cpp messagetemplate.cpp \
+    highlightmatcher.cpp markuprenderer.cpp
+HEADERS += sessionwindow.h memorydialog.h widget.h authdialog.h \
+    messagelogmodel.h messagelogdelegate.h messagelogview.h \
+    connectionworker.h framecapture.h spscqueue.h \
+    rostermodel.h rosterindex.h rosterfiltermodel.h presenceaggregator.h sendqueue.h \
+    historystore.h searchindex.h searchdialog.h \
+    latencyhistogram.h trace.h startup.h messagetemplate.h \
+    highlightmatcher.h markuprenderer.h
+
+include(protocol.pri)
+
+FORMS += widget.ui authdialog.ui searchdialog.ui memorydialog.ui
 
 RESOURCES += icons.qrc
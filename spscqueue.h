@@ -0,0 +1,103 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <QAtomicInteger>
+#include <QVector>
+
+// Очередь без блокировок для одного производителя и одного потребителя.
+// Производитель вызывает только push(), потребитель - только pop().
+// Ёмкость фиксирована и округляется вверх до степени двойки.
+template <typename T>
+class SpscQueue
+{
+public:
+    explicit SpscQueue(int capacity = 4096) :
+        m_head(0),
+        m_tail(0)
+    {
+        int size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+
+        m_buffer.resize(size);
+        m_mask = quint32(size - 1);
+    }
+
+    bool push(const T &value)
+    {
+        quint32 tail = m_tail.loadAcquire();
+        if (tail - m_head.loadAcquire() > m_mask) {
+            return false; // очередь заполнена
+        }
+
+        m_buffer[int(tail & m_mask)] = value;
+        m_tail.storeRelease(tail + 1);
+        return true;
+    }
+
+    bool pop(T &value)
+    {
+        quint32 head = m_head.loadAcquire();
+        if (head == m_tail.loadAcquire()) {
+            return false; // очередь пуста
+        }
+
+        T &slot = m_buffer[int(head & m_mask)];
+        value = slot;
+        slot = T(); // не держим данные в буфере дольше необходимого
+        m_head.storeRelease(head + 1);
+        return true;
+    }
+
+    bool isEmpty() const
+    {
+        return m_head.loadAcquire() == m_tail.loadAcquire();
+    }
+
+    int size() const
+    {
+        return int(m_tail.loadAcquire() - m_head.loadAcquire());
+    }
+
+private:
+    Q_DISABLE_COPY(SpscQueue)
+
+    QVector<T> m_buffer;
+    quint32 m_mask;
+
+    // Индексы разнесены по разным кэш-линиям, чтобы потоки
+    // не мешали друг другу при записи
+    QAtomicInteger<quint32> m_head; // следующий элемент для чтения
+    char m_padding[64];
+    QAtomicInteger<quint32> m_tail; // следующий свободный слот
+};
+
+#endif // SPSCQUEUE_H
@@ -0,0 +1,88 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "startup.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QSet>
+#include <QTimer>
+
+#include <cstdio>
+
+namespace {
+
+// Вехи отмечаются только в потоке GUI
+QElapsedTimer startTimer;
+QSet<QByteArray> marked;
+bool reportEnabled = false;
+QByteArray exitMilestone;
+
+} // namespace
+
+void Startup::start()
+{
+    startTimer.start();
+}
+
+qint64 Startup::elapsed()
+{
+    return startTimer.isValid() ? startTimer.elapsed() : 0;
+}
+
+void Startup::setReportEnabled(bool enabled)
+{
+    reportEnabled = enabled;
+}
+
+void Startup::setExitMilestone(const char *milestone)
+{
+    exitMilestone = milestone;
+}
+
+void Startup::mark(const char *milestone)
+{
+    QByteArray name(milestone);
+    if (marked.contains(name)) {
+        return;
+    }
+    marked.insert(name);
+
+    if (reportEnabled) {
+        fprintf(stderr, "startup: %-24s %6lld ms\n", milestone, elapsed());
+        fflush(stderr);
+    }
+
+    if (!exitMilestone.isEmpty() && name == exitMilestone) {
+        QTimer::singleShot(0, qApp, &QCoreApplication::quit);
+    }
+}
+
+bool Startup::isMarked(const char *milestone)
+{
+    return marked.contains(QByteArray(milestone));
+}
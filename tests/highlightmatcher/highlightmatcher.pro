@@ -0,0 +1,12 @@
+# Поиск упоминаний: пересечения, границы слов, регистр, разметка
+QT += core testlib
+QT -= gui
+
+TARGET = tst_highlightmatcher
+TEMPLATE = app
+DEFINES += QT_DEPRECATED_WARNINGS
+CONFIG += c++11 console testcase
+CONFIG -= app_bundle
+INCLUDEPATH += ../..
+SOURCES += tst_highlightmatcher.cpp ../../highlightmatcher.cpp
+HEADERS += ../../highlightmatcher.h
@@ -0,0 +1,219 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "highlightmatcher.h"
+
+#include <QtTest>
+
+// Поиск упоминаний и ключевых слов. Замер показывает, что проход по
+// сообщению почти не дорожает с ростом числа слов:
+// ./tst_highlightmatcher benchmarkScan
+class TestHighlightMatcher : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void overlappingPatterns();
+    void nestedPatterns();
+    void wordBoundaries();
+    void cyrillicCaseFolding();
+    void markupSkipped();
+    void rebuildOnChange();
+
+    void benchmarkScan();
+    void benchmarkScan_data();
+
+private:
+    static QStringList found(const HighlightMatcher &matcher, const QString &text);
+    static QStringList words(int count);
+};
+
+// Находки в виде "текст@позиция" в порядке, в котором их отдал автомат
+QStringList TestHighlightMatcher::found(const HighlightMatcher &matcher, const QString &text)
+{
+    QStringList result;
+    foreach (const HighlightMatcher::Match &match, matcher.findAll(text)) {
+        result << QString("%1@%2").arg(text.mid(match.position, match.length)).arg(match.position);
+    }
+    return result;
+}
+
+// Разные слова из слогов: начинаются с разных букв, как настоящие правила
+QStringList TestHighlightMatcher::words(int count)
+{
+    static const char *const syllables[] = {
+        "ка", "ро", "ми", "ле", "ту", "на", "зо", "пе", "ви", "ша"
+    };
+
+    QStringList result;
+    for (int i = 0; i < count; i++) {
+        result << QString::fromUtf8(syllables[i % 10])
+                  + QString::fromUtf8(syllables[i / 10 % 10])
+                  + QString::fromUtf8(syllables[i / 100 % 10]);
+    }
+    return result;
+}
+
+void TestHighlightMatcher::overlappingPatterns()
+{
+    // Слова делят середину текста: находятся оба
+    HighlightMatcher matcher;
+    matcher.setPatterns(QStringList() << "анна мария" << "мария петровна");
+    QCOMPARE(found(matcher, "анна мария петровна"),
+             QStringList() << "анна мария@0" << "мария петровна@5");
+
+    // Суффикс одного слова - внутри другого слова и целым не считается
+    matcher.setPatterns(QStringList() << "he" << "she" << "hers");
+    QCOMPARE(found(matcher, "she hers"), QStringList() << "she@0" << "hers@4");
+    QCOMPARE(found(matcher, "he"), QStringList() << "he@0");
+}
+
+void TestHighlightMatcher::nestedPatterns()
+{
+    // Слово целиком внутри другого: оба на одной позиции конца
+    HighlightMatcher matcher;
+    matcher.setPatterns(QStringList() << "new york" << "york");
+    QCOMPARE(found(matcher, "new york"), QStringList() << "new york@0" << "york@4");
+    QCOMPARE(found(matcher, "york"), QStringList() << "york@0");
+
+    // Повтор в другом регистре не добавляет второе слово
+    matcher.setPatterns(QStringList() << "Анна" << "анна" << " " << "АННА");
+    QCOMPARE(matcher.patterns(), QStringList() << "Анна");
+    QCOMPARE(found(matcher, "анна"), QStringList() << "анна@0");
+}
+
+void TestHighlightMatcher::wordBoundaries()
+{
+    HighlightMatcher matcher;
+    matcher.setPatterns(QStringList() << "cat");
+    QCOMPARE(found(matcher, "cat, concat cats _cat cat_ cat."),
+             QStringList() << "cat@0" << "cat@27");
+    QVERIFY(!matcher.matches("concatenate"));
+    QVERIFY(!matcher.matches("cat1"));
+    QVERIFY(matcher.matches("(cat)"));
+
+    // Кириллица - тоже буквы слова
+    matcher.setPatterns(QStringList() << "анна");
+    QVERIFY(!matcher.matches("аннаграмма"));
+    QVERIFY(!matcher.matches("жанна"));
+    QVERIFY(matcher.matches("привет, анна!"));
+}
+
+void TestHighlightMatcher::cyrillicCaseFolding()
+{
+    HighlightMatcher matcher;
+    matcher.setPatterns(QStringList() << "Ёлка" << "пётр");
+    QCOMPARE(found(matcher, "ЁЛКА и ПЁТР"), QStringList() << "ЁЛКА@0" << "ПЁТР@7");
+    QCOMPARE(found(matcher, "ёлка, Пётр"), QStringList() << "ёлка@0" << "Пётр@6");
+
+    // Ё и Е - разные буквы
+    QVERIFY(!matcher.matches("елка"));
+}
+
+void TestHighlightMatcher::markupSkipped()
+{
+    HighlightMatcher matcher;
+    matcher.setPatterns(QStringList() << "анна" << "amp" << "39" << "href");
+
+    // Внутри <b>...</b> слово находится, а тег словом не считается
+    QCOMPARE(found(matcher, "<b>анна</b>"), QStringList() << "анна@3");
+    QCOMPARE(found(matcher, "<a href='анна'>x</a>"), QStringList());
+
+    // Тег разрывает слово
+    QCOMPARE(found(matcher, "ан<b>на</b>"), QStringList());
+
+    // Сущности пропускаются целиком, а соседние слова находятся
+    QCOMPARE(found(matcher, "анна&amp;анна"), QStringList() << "анна@0" << "анна@9");
+    QCOMPARE(found(matcher, "Tom &amp; amp"), QStringList() << "amp@10");
+    QCOMPARE(found(matcher, "анна&#39;s"), QStringList() << "анна@0");
+    QVERIFY(!matcher.matches("&#39;"));
+
+    // Одинокий амперсанд - обычный символ
+    QCOMPARE(found(matcher, "анна & amp"), QStringList() << "анна@0" << "amp@7");
+}
+
+void TestHighlightMatcher::rebuildOnChange()
+{
+    HighlightMatcher matcher;
+    QVERIFY(matcher.isEmpty());
+    QVERIFY(!matcher.matches("анна"));
+
+    matcher.setPatterns(QStringList() << "анна");
+    QVERIFY(matcher.matches("анна"));
+
+    // Новый набор заменяет старый полностью, включая карту начальных букв
+    matcher.setPatterns(QStringList() << "пётр");
+    QVERIFY(!matcher.matches("анна"));
+    QVERIFY(matcher.matches("Пётр"));
+
+    // Тот же набор ещё раз - автомат прежний
+    matcher.setPatterns(QStringList() << "пётр");
+    QCOMPARE(found(matcher, "пётр"), QStringList() << "пётр@0");
+
+    matcher.setPatterns(QStringList());
+    QVERIFY(matcher.isEmpty());
+    QVERIFY(!matcher.matches("пётр"));
+}
+
+void TestHighlightMatcher::benchmarkScan_data()
+{
+    QTest::addColumn<int>("patterns");
+    QTest::newRow("1 pattern") << 1;
+    QTest::newRow("10 patterns") << 10;
+    QTest::newRow("500 patterns") << 500;
+}
+
+void TestHighlightMatcher::benchmarkScan()
+{
+    QFETCH(int, patterns);
+
+    HighlightMatcher matcher;
+    matcher.setPatterns(words(patterns));
+    QCOMPARE(matcher.patterns().size(), patterns);
+
+    // Около 64 КБ обычной переписки с разметкой журнала
+    static const char *const phrases[] = {
+        "<b>анна:</b> Всем привет! Кто-нибудь видел вчерашний матч?",
+        "<b>пётр:</b> Ссылку на документацию скиньте, пожалуйста &amp; спасибо",
+        "<b>мария:</b> Сегодня отличная погода, а у вас? Через пять минут буду",
+        "<b>олег:</b> Ок, понял. Проверка связи &#39;раз-два&#39;"
+    };
+    QString text;
+    for (int i = 0; text.size() < 64 * 1024; i++) {
+        text += QString::fromUtf8(phrases[i % 4]) + QLatin1Char(' ');
+    }
+
+    int count = 0;
+    QBENCHMARK {
+        count = matcher.findAll(text).size();
+    }
+    QVERIFY(count >= 0);
+}
+
+QTEST_APPLESS_MAIN(TestHighlightMatcher)
+
+#include "tst_highlightmatcher.moc"
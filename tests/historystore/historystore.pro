@@ -0,0 +1,12 @@
+# История и поисковый индекс: слияние кусков, автор, восстановление, каталоги сессий
+QT += core testlib
+QT -= gui
+
+TARGET = tst_historystore
+TEMPLATE = app
+DEFINES += QT_DEPRECATED_WARNINGS
+CONFIG += c++11 console testcase
+CONFIG -= app_bundle
+INCLUDEPATH += ../..
+SOURCES += tst_historystore.cpp ../../historystore.cpp ../../searchindex.cpp
+HEADERS += ../../historystore.h ../../searchindex.h
@@ -0,0 +1,216 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "historystore.h"
+
+#include <QDir>
+#include <QTemporaryDir>
+#include <QtEndian>
+#include <QtTest>
+
+#include <limits>
+
+class TestHistoryStore : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void chunksDoNotGrowWithRestarts();
+    void authorHashCollision();
+    void recoverySkipsBrokenRecord();
+    void twoSessionsOneServer();
+
+private:
+    static HistoryRecord record(qint64 timestamp, const QString &userName, const QString &text);
+    static QVector<HistoryRecord> search(HistoryStore &store, const QString &query,
+                                         const QString &userName = QString());
+    static QStringList texts(const QVector<HistoryRecord> &records);
+};
+
+HistoryRecord TestHistoryStore::record(qint64 timestamp, const QString &userName, const QString &text)
+{
+    HistoryRecord record;
+    record.timestamp = timestamp;
+    record.type = HistoryRecord::PublicMessage;
+    record.flags = 0;
+    record.userId = 1;
+    record.gender = 0;
+    record.userName = userName;
+    record.userColor = "#34495e";
+    record.text = text;
+    return record;
+}
+
+QVector<HistoryRecord> TestHistoryStore::search(HistoryStore &store, const QString &query,
+                                                const QString &userName)
+{
+    QVector<HistoryRecord> result;
+    QMetaObject::Connection connection =
+            connect(&store, &HistoryStore::searchFinished,
+                    [&result](const QString &, const QVector<HistoryRecord> &records, qint64) {
+                        result = records;
+                    });
+    store.search(query, userName, 0, std::numeric_limits<qint64>::max(), 100);
+    disconnect(connection);
+    return result;
+}
+
+QStringList TestHistoryStore::texts(const QVector<HistoryRecord> &records)
+{
+    QStringList result;
+    foreach (const HistoryRecord &record, records) {
+        result << record.text;
+    }
+    return result;
+}
+
+void TestHistoryStore::chunksDoNotGrowWithRestarts()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    // Каждый запуск дописывает пару сообщений и при завершении сбрасывает индекс
+    qint64 timestamp = 1000;
+    QStringList expected;
+    for (int run = 0; run < 5; run++) {
+        HistoryStore store(dir.path());
+        QVector<HistoryRecord> records;
+        for (int i = 0; i < 2; i++) {
+            QString text = QString("запуск %1 сообщение %2").arg(run).arg(i);
+            records << record(timestamp++, "анна", text);
+            expected << text;
+        }
+        store.append(records);
+    }
+
+    QStringList chunks = QDir(dir.path()).entryList(QStringList() << "search-*.chunk", QDir::Files);
+    QCOMPARE(chunks.size(), 1);
+
+    HistoryStore store(dir.path());
+    QCOMPARE(texts(search(store, "сообщение")), expected);
+    QCOMPARE(texts(search(store, "запуск 3")).size(), 2);
+}
+
+void TestHistoryStore::authorHashCollision()
+{
+    // Имена с одинаковым хэшем FNV-1a
+    const QString author = "user489817";
+    const QString other = "user1667140";
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    HistoryStore store(dir.path());
+    store.append(QVector<HistoryRecord>()
+                 << record(1000, author, "первое")
+                 << record(1001, other, "чужое")
+                 << record(1002, author, "второе"));
+
+    QCOMPARE(texts(search(store, QString(), author)), QStringList() << "первое" << "второе");
+    QCOMPARE(texts(search(store, QString(), other)), QStringList() << "чужое");
+    QVERIFY(search(store, "первое", other).isEmpty());
+}
+
+void TestHistoryStore::recoverySkipsBrokenRecord()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    QVector<HistoryRecord> records;
+    records << record(1000, "анна", "альфа один")
+            << record(1001, "анна", "альфа два")
+            << record(1002, "анна", "альфа три");
+
+    // Аварийное завершение: таблица документов записана, а кусков нет.
+    // Хранилище намеренно не удаляется, иначе оно сбросило бы индекс.
+    HistoryStore *crashed = new HistoryStore(dir.path());
+    crashed->append(records);
+    QVERIFY(QDir(dir.path()).entryList(QStringList() << "search-*.chunk", QDir::Files).isEmpty());
+
+    // Портим вторую запись: длина имени выходит за конец записи
+    QFile segment(dir.path() + "/" + HistoryReader::segmentName(1));
+    QVERIFY(segment.open(QIODevice::ReadWrite));
+    qint64 offset = HistoryStore::encode(records.at(0)).size();
+    const int userNameLength = 4 + 8 + 1 + 1 + 4 + 1;
+    uchar broken[2];
+    qToLittleEndian<quint16>(0xffff, broken);
+    QVERIFY(segment.seek(offset + userNameLength));
+    QCOMPARE(segment.write(reinterpret_cast<const char *>(broken), 2), qint64(2));
+    segment.close();
+
+    HistoryStore store(dir.path());
+    QCOMPARE(texts(search(store, "альфа")), QStringList() << "альфа один" << "альфа три");
+    QCOMPARE(texts(search(store, "три")), QStringList() << "альфа три");
+    QVERIFY(search(store, "два").isEmpty());
+}
+
+void TestHistoryStore::twoSessionsOneServer()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    // Две вкладки к одному серверу просят один и тот же каталог
+    const QString path = dir.path() + "/history-127.0.0.1-27800";
+    QString first = HistoryStore::claimPath(path);
+    QString second = HistoryStore::claimPath(path);
+    QCOMPARE(first, path);
+    QCOMPARE(second, path + "-2");
+
+    // Записи вперемешку не попадают в чужой каталог и чужой индекс
+    {
+        HistoryStore firstStore(first);
+        HistoryStore secondStore(second);
+        for (int i = 0; i < 3; i++) {
+            firstStore.append(QVector<HistoryRecord>()
+                              << record(1000 + i, "анна", QString("первая %1").arg(i)));
+            secondStore.append(QVector<HistoryRecord>()
+                               << record(1000 + i, "пётр", QString("вторая %1 длиннее").arg(i)));
+        }
+
+        QCOMPARE(texts(search(firstStore, "первая")),
+                 QStringList() << "первая 0" << "первая 1" << "первая 2");
+        QVERIFY(search(firstStore, "вторая").isEmpty());
+        QCOMPARE(texts(search(secondStore, "вторая")),
+                 QStringList() << "вторая 0 длиннее" << "вторая 1 длиннее" << "вторая 2 длиннее");
+        QVERIFY(search(secondStore, "первая").isEmpty());
+    }
+
+    QCOMPARE(texts(HistoryReader(first).recent(10)),
+             QStringList() << "первая 0" << "первая 1" << "первая 2");
+    QCOMPARE(texts(HistoryReader(second).recent(10)),
+             QStringList() << "вторая 0 длиннее" << "вторая 1 длиннее" << "вторая 2 длиннее");
+
+    // Освобождённый каталог достаётся следующей сессии
+    HistoryStore::releasePath(first);
+    QCOMPARE(HistoryStore::claimPath(path), path);
+    HistoryStore::releasePath(path);
+    HistoryStore::releasePath(second);
+}
+
+QTEST_GUILESS_MAIN(TestHistoryStore)
+
+#include "tst_historystore.moc"
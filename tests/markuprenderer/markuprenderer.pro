@@ -0,0 +1,12 @@
+# Экранирование и разметка сообщений: спецсимволы, теги, упоминания, ссылки
+QT += core testlib
+QT -= gui
+
+TARGET = tst_markuprenderer
+TEMPLATE = app
+DEFINES += QT_DEPRECATED_WARNINGS
+CONFIG += c++11 console testcase
+CONFIG -= app_bundle
+INCLUDEPATH += ../..
+SOURCES += tst_markuprenderer.cpp ../../markuprenderer.cpp
+HEADERS += ../../markuprenderer.h
@@ -0,0 +1,182 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "markuprenderer.h"
+
+#include <QtTest>
+
+// Экранирование и разметка текста сообщений. Текст от сервера недоверенный,
+// поэтому главное здесь - что никакой ввод не даёт в журнале чужих тегов
+// и атрибутов. Замер на сообщениях в несколько мегабайт показывает, что
+// время растёт линейно с длиной: ./tst_markuprenderer benchmarkRender
+class TestMarkupRenderer : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void escape();
+    void escape_data();
+    void render();
+    void render_data();
+
+    void benchmarkRender();
+    void benchmarkRender_data();
+};
+
+void TestMarkupRenderer::escape_data()
+{
+    QTest::addColumn<QString>("text");
+    QTest::addColumn<QString>("html");
+
+    QTest::newRow("plain") << "привет" << "привет";
+    QTest::newRow("specials") << "a < b > c & d" << "a &lt; b &gt; c &amp; d";
+    QTest::newRow("quotes") << "\"кавычки\" и 'апостроф'"
+                            << "&quot;кавычки&quot; и &#39;апостроф&#39;";
+    QTest::newRow("entities") << "&lt;b&gt; &#39; &#x27; &amp;amp;"
+                              << "&lt;b&gt; &#39; &#x27; &amp;amp;";
+    QTest::newRow("broken entities") << "&foo &a; &#; &#xZ;"
+                                     << "&amp;foo &amp;a; &amp;#; &amp;#xZ;";
+    QTest::newRow("no markup") << "<b>**{анна}**</b><br>"
+                               << "&lt;b&gt;**{анна}**&lt;/b&gt;&lt;br&gt;";
+}
+
+void TestMarkupRenderer::escape()
+{
+    QFETCH(QString, text);
+    QFETCH(QString, html);
+    QCOMPARE(MarkupRenderer::escape(text), html);
+}
+
+void TestMarkupRenderer::render_data()
+{
+    QTest::addColumn<QString>("text");
+    QTest::addColumn<QString>("html");
+
+    // Экранирование
+    QTest::newRow("specials") << "a < b > c & d" << "a &lt; b &gt; c &amp; d";
+    QTest::newRow("quotes") << "\"кавычки\" и 'апостроф'"
+                            << "&quot;кавычки&quot; и &#39;апостроф&#39;";
+    QTest::newRow("entities") << "&lt;b&gt; &#39; &#x27; &amp;amp; &foo"
+                              << "&lt;b&gt; &#39; &#x27; &amp;amp; &amp;foo";
+    QTest::newRow("script") << "<script>alert(1)</script>"
+                            << "&lt;script&gt;alert(1)&lt;/script&gt;";
+    QTest::newRow("tag with attribute") << "<b onclick=x>" << "&lt;b onclick=x&gt;";
+
+    // Жирный текст: теги всегда сбалансированы
+    QTest::newRow("bold") << "<B>жирный</b> текст" << "<b>жирный</b> текст";
+    QTest::newRow("unclosed bold") << "<b>жирный" << "<b>жирный</b>";
+    QTest::newRow("stray close") << "</b>текст" << "&lt;/b&gt;текст";
+    QTest::newRow("extra close") << "<b>a</b></b>" << "<b>a</b>&lt;/b&gt;";
+    QTest::newRow("stars") << "**жирный** текст" << "<b>жирный</b> текст";
+    QTest::newRow("unclosed stars") << "**жирный" << "<b>жирный</b>";
+    QTest::newRow("single star") << "a*b ***" << "a*b <b>*</b>";
+    QTest::newRow("stars and close") << "**a</b>**" << "<b>a&lt;/b&gt;</b>";
+    QTest::newRow("tags and stars") << "<b>a**b</b>c**" << "<b>a<b>b</b>c</b>";
+
+    // Упоминания
+    QTest::newRow("mention") << "{анна}, привет" << "<b>анна</b>, привет";
+    QTest::newRow("mention in escaped") << "a<{анна}>b" << "a&lt;<b>анна</b>&gt;b";
+    QTest::newRow("mention escaped") << "{a&b} {\"x\"}" << "<b>a&amp;b</b> <b>&quot;x&quot;</b>";
+    QTest::newRow("empty mention") << "{} { }" << "{} { }";
+    QTest::newRow("mention with tag") << "{<i>}" << "{&lt;i&gt;}";
+
+    // Ссылки
+    QTest::newRow("link") << "см. https://пример.рф/путь."
+                          << "см. <a href=\"https://пример.рф/путь\">https://пример.рф/путь</a>.";
+    QTest::newRow("link with amp") << "http://x.com/?a=1&b=2"
+                                   << "<a href=\"http://x.com/?a=1&amp;b=2\">http://x.com/?a=1&amp;b=2</a>";
+    QTest::newRow("link with escaped amp") << "http://x.com/?a=1&amp;b=2"
+                                           << "<a href=\"http://x.com/?a=1&amp;b=2\">http://x.com/?a=1&amp;b=2</a>";
+    QTest::newRow("link with quote") << "http://x.com/?q=\"x\" хвост"
+                                     << "<a href=\"http://x.com/?q=\">http://x.com/?q=</a>&quot;x&quot; хвост";
+    QTest::newRow("link with escaped quote") << "http://x.com/&#39;onmouseover=&#39;"
+                                             << "<a href=\"http://x.com/\">http://x.com/</a>&#39;onmouseover=&#39;";
+    QTest::newRow("link in quotes") << "'http://a.b'" << "&#39;<a href=\"http://a.b\">http://a.b</a>&#39;";
+    QTest::newRow("scheme inside word") << "xhttp://a" << "xhttp://a";
+    QTest::newRow("scheme only") << "http://" << "http://";
+    QTest::newRow("other scheme") << "javascript://x" << "javascript://x";
+
+    // Перевод строки
+    QTest::newRow("br") << "a<br>b<BR/>c<br />d" << "a<br>b<br>c<br>d";
+    QTest::newRow("unclosed br") << "a<br" << "a&lt;br";
+}
+
+void TestMarkupRenderer::render()
+{
+    QFETCH(QString, text);
+    QFETCH(QString, html);
+    QCOMPARE(MarkupRenderer::render(text), html);
+}
+
+void TestMarkupRenderer::benchmarkRender_data()
+{
+    QTest::addColumn<QString>("kind");
+    QTest::addColumn<int>("size");
+
+    QTest::newRow("plain 1 MB") << "plain" << 1024 * 1024;
+    QTest::newRow("plain 4 MB") << "plain" << 4 * 1024 * 1024;
+    QTest::newRow("markup 1 MB") << "markup" << 1024 * 1024;
+    QTest::newRow("markup 4 MB") << "markup" << 4 * 1024 * 1024;
+    QTest::newRow("specials 4 MB") << "specials" << 4 * 1024 * 1024;
+}
+
+void TestMarkupRenderer::benchmarkRender()
+{
+    QFETCH(QString, kind);
+    QFETCH(int, size);
+
+    // Одно сообщение заданной длины: обычный текст, текст с разметкой
+    // и ссылками или сплошь символы, требующие экранирования
+    QString piece;
+    if (kind == "plain") {
+        piece = "Сегодня отличная погода, а у вас? Через пять минут буду. ";
+    }
+    else if (kind == "markup") {
+        piece = "**{анна}**, смотри <b>тут</b>: https://example.com/?a=1&b=2 &amp; "
+                "<br>{незакрытое <b>и ещё ";
+    }
+    else {
+        piece = "<>&\"'{*:";
+    }
+
+    QString text;
+    text.reserve(size + piece.size());
+    while (text.size() < size) {
+        text += piece;
+    }
+
+    QString html;
+    QBENCHMARK {
+        html.clear();
+        MarkupRenderer::render(text, html);
+    }
+    QVERIFY(html.size() >= text.size() / 2);
+}
+
+QTEST_APPLESS_MAIN(TestMarkupRenderer)
+
+#include "tst_markuprenderer.moc"
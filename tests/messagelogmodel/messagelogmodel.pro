@@ -0,0 +1,12 @@
+# Журнал сообщений: кольцо, вытеснение по лимиту и по бюджету памяти
+QT += core testlib
+QT -= gui
+
+TARGET = tst_messagelogmodel
+TEMPLATE = app
+DEFINES += QT_DEPRECATED_WARNINGS
+CONFIG += c++11 console testcase
+CONFIG -= app_bundle
+INCLUDEPATH += ../..
+SOURCES += tst_messagelogmodel.cpp ../../messagelogmodel.cpp
+HEADERS += ../../messagelogmodel.h
@@ -0,0 +1,127 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "messagelogmodel.h"
+
+#include <QtTest>
+
+class TestMessageLogModel : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void appendWithinCapacity();
+    void appendOverCapacity();
+    void appendAfterEvictBytes();
+    void appendAfterEvictBytes_data();
+
+private:
+    static QStringList rows(const MessageLogModel &model);
+    static QStringList lines(int from, int count);
+};
+
+QStringList TestMessageLogModel::rows(const MessageLogModel &model)
+{
+    QStringList result;
+    for (int row = 0; row < model.rowCount(); row++) {
+        result << model.data(model.index(row), MessageLogModel::HtmlRole).toString();
+    }
+    return result;
+}
+
+QStringList TestMessageLogModel::lines(int from, int count)
+{
+    QStringList result;
+    for (int i = from; i < from + count; i++) {
+        result << QString("line %1").arg(i);
+    }
+    return result;
+}
+
+void TestMessageLogModel::appendWithinCapacity()
+{
+    MessageLogModel model(10);
+    model.append(lines(0, 3));
+    model.append(lines(3, 4));
+
+    QCOMPARE(rows(model), lines(0, 7));
+}
+
+void TestMessageLogModel::appendOverCapacity()
+{
+    MessageLogModel model(5);
+    model.append(lines(0, 4));
+    model.append(lines(4, 4));
+
+    QCOMPARE(rows(model), lines(3, 5));
+    QCOMPARE(model.evictedCount(), quint64(3));
+}
+
+void TestMessageLogModel::appendAfterEvictBytes_data()
+{
+    QTest::addColumn<int>("capacity");
+    QTest::addColumn<int>("before");
+    QTest::addColumn<int>("keep");
+    QTest::addColumn<int>("after");
+
+    // Кольцо не заполнено, начало сдвинуто вытеснением
+    QTest::newRow("grow") << 100 << 10 << 4 << 20;
+    QTest::newRow("grow small") << 100 << 10 << 4 << 2;
+    // Добавление доводит кольцо до лимита и вытесняет дальше
+    QTest::newRow("fill") << 16 << 10 << 4 << 20;
+    QTest::newRow("fill exact") << 12 << 10 << 3 << 9;
+}
+
+void TestMessageLogModel::appendAfterEvictBytes()
+{
+    QFETCH(int, capacity);
+    QFETCH(int, before);
+    QFETCH(int, keep);
+    QFETCH(int, after);
+
+    MessageLogModel model(capacity);
+    model.append(lines(0, before));
+
+    // Бюджет памяти вытесняет всё, кроме последних keep строк
+    model.evictBytes(model.bytes(), keep);
+    QCOMPARE(rows(model), lines(before - keep, keep));
+
+    model.append(lines(before, after));
+
+    int total = keep + after;
+    int kept = qMin(capacity, total);
+    QCOMPARE(rows(model), lines(before + after - kept, kept));
+
+    // И ещё раз, уже по развёрнутому кольцу
+    model.evictBytes(model.bytes(), 1);
+    model.append(lines(before + after, 3));
+    QCOMPARE(rows(model), lines(before + after - 1, 4));
+}
+
+QTEST_APPLESS_MAIN(TestMessageLogModel)
+
+#include "tst_messagelogmodel.moc"
@@ -0,0 +1,12 @@
+# Шаблоны строк журнала: подстановка и замер против цепочки arg()
+QT += core testlib
+QT -= gui
+
+TARGET = tst_messagetemplate
+TEMPLATE = app
+DEFINES += QT_DEPRECATED_WARNINGS
+CONFIG += c++11 console testcase
+CONFIG -= app_bundle
+INCLUDEPATH += ../..
+SOURCES += tst_messagetemplate.cpp ../../messagetemplate.cpp
+HEADERS += ../../messagetemplate.h
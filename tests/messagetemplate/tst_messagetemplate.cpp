@@ -0,0 +1,169 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "messagetemplate.h"
+
+#include <QDateTime>
+#include <QtTest>
+
+// Шаблоны строк журнала. Замеры сравнивают заполнение заранее
+// разобранного шаблона с прежней цепочкой QString::arg() на строке
+// сообщения чата, а кэш отметки времени - с QDateTime::toString().
+class TestMessageTemplate : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void render();
+    void placeholderInValue();
+    void missingArgument();
+    void timestampCache();
+
+    void benchmarkMessage();
+    void benchmarkMessage_data();
+    void benchmarkTimestamp();
+    void benchmarkTimestamp_data();
+
+private:
+    static const char *messagePattern();
+};
+
+const char *TestMessageTemplate::messagePattern()
+{
+    return "%1 <b><a style='color:%2' href='action://putUserName?userName=%6&amp;userId=%5'>%3:</a></b>"
+           " <span style='color:#34495e'>%4</span>";
+}
+
+void TestMessageTemplate::render()
+{
+    MessageTemplate html(QStringLiteral("<b>%1</b> %2, %1!%12"));
+    QCOMPARE(html.slotCount(), 12);
+    QCOMPARE(html.render({ u"a", u"bc" }), QString("<b>a</b> bc, a!"));
+    QCOMPARE(MessageTemplate("100% %").render({ u"x" }), QString("100% %"));
+}
+
+void TestMessageTemplate::placeholderInValue()
+{
+    // Цепочка arg() подставила бы второй аргумент внутрь первого
+    MessageTemplate html(QStringLiteral("%1: %2"));
+    QCOMPARE(html.render({ u"скидка %2", u"текст" }), QString("скидка %2: текст"));
+    QCOMPARE(QString("%1: %2").arg("скидка %2").arg("текст"), QString("скидка текст: текст"));
+}
+
+void TestMessageTemplate::missingArgument()
+{
+    MessageTemplate html(QStringLiteral("[%1|%3]"));
+    QCOMPARE(html.render({ u"a" }), QString("[a|]"));
+}
+
+void TestMessageTemplate::timestampCache()
+{
+    QDateTime time(QDate(2024, 3, 8), QTime(12, 30, 15, 250));
+    QString expected = QString("<span style='color:#34495e'><b>[%1]</b></span>")
+            .arg(time.toString("dd.MM.yyyy HH:mm:ss"));
+
+    TimestampCache cache;
+    QCOMPARE(cache.format(time.toMSecsSinceEpoch()), expected);
+    QCOMPARE(cache.format(time.toMSecsSinceEpoch() + 500), expected);
+    QVERIFY(cache.format(time.toMSecsSinceEpoch() + 1000) != expected);
+}
+
+void TestMessageTemplate::benchmarkMessage_data()
+{
+    QTest::addColumn<bool>("precompiled");
+    QTest::newRow("arg chain") << false;
+    QTest::newRow("template") << true;
+}
+
+void TestMessageTemplate::benchmarkMessage()
+{
+    QFETCH(bool, precompiled);
+
+    QString timestamp = "<span style='color:#34495e'><b>[08.03.2024 12:30:15]</b></span>";
+    QString color = "#16a085";
+    QString userName = "Пользователь";
+    QString text = QString("Обычное сообщение чата средней длины, ").repeated(2);
+    QString userId = "4242";
+    QString userQuery = "%D0%9F%D0%BE%D0%BB%D1%8C%D0%B7%D0%BE%D0%B2%D0%B0%D1%82%D0%B5%D0%BB%D1%8C";
+
+    QString html;
+    if (precompiled) {
+        MessageTemplate pattern((QString(messagePattern())));
+        QBENCHMARK {
+            html = pattern.render({ timestamp, color, userName, text, userId, userQuery });
+        }
+    }
+    else {
+        QBENCHMARK {
+            html = QString(messagePattern())
+                    .arg(timestamp)
+                    .arg(color)
+                    .arg(userName)
+                    .arg(text)
+                    .arg(userId)
+                    .arg(userQuery);
+        }
+    }
+
+    QVERIFY(html.contains(text));
+    QVERIFY(html.contains(userQuery));
+}
+
+void TestMessageTemplate::benchmarkTimestamp_data()
+{
+    QTest::addColumn<bool>("cached");
+    QTest::newRow("toString") << false;
+    QTest::newRow("cache") << true;
+}
+
+void TestMessageTemplate::benchmarkTimestamp()
+{
+    QFETCH(bool, cached);
+
+    // Всплеск сообщений: все в пределах одной секунды
+    qint64 msecs = QDateTime(QDate(2024, 3, 8), QTime(12, 30, 15)).toMSecsSinceEpoch();
+    TimestampCache cache;
+
+    QString html;
+    if (cached) {
+        QBENCHMARK {
+            html = cache.format(msecs);
+        }
+    }
+    else {
+        QBENCHMARK {
+            html = QString("<span style='color:#34495e'><b>[%1]</b></span>")
+                    .arg(QDateTime::fromMSecsSinceEpoch(msecs).toString("dd.MM.yyyy HH:mm:ss"));
+        }
+    }
+
+    QVERIFY(html.contains("08.03.2024"));
+}
+
+QTEST_APPLESS_MAIN(TestMessageTemplate)
+
+#include "tst_messagetemplate.moc"
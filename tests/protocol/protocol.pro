@@ -0,0 +1,13 @@
+# Разбор кадров протокола: нестрогие поля и замер скорости разбора
+QT += core testlib
+QT -= gui
+
+TARGET = tst_protocol
+TEMPLATE = app
+DEFINES += QT_DEPRECATED_WARNINGS
+CONFIG += c++11 console testcase
+CONFIG -= app_bundle
+INCLUDEPATH += ../..
+SOURCES += tst_protocol.cpp
+
+include(../../protocol.pri)
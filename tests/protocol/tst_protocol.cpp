@@ -0,0 +1,303 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "protocol.h"
+
+#include <QCborMap>
+#include <QCborValue>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QtTest>
+
+// Разбор кадров протокола. Замеры сравнивают курсор по UTF-16 строке
+// и CBOR с прежним разбором через QJsonDocument:
+// ./tst_protocol -callgrind или ./tst_protocol benchmarkDecode
+class TestProtocol : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void nullStringFields();
+    void badRosterEntry();
+    void integerOverflow();
+    void cborNonIntegerKey();
+    void roundTrip();
+    void roundTrip_data();
+
+    void benchmarkDecode();
+    void benchmarkDecode_data();
+
+private:
+    static ChatEvent message(int length);
+    static ChatEvent authorized(int users);
+    static bool decodeJsonDocument(const QString &frame, ChatEvent &event);
+};
+
+ChatEvent TestProtocol::message(int length)
+{
+    ChatEvent event;
+    event.type = ChatEvent::PublicMessage;
+    event.userId = 42;
+    event.userName = "Пользователь";
+    event.userColor = "#34495e";
+    event.gender = 1;
+    event.text = QString(length, QChar('x'));
+    event.sequence = 1000;
+    return event;
+}
+
+ChatEvent TestProtocol::authorized(int users)
+{
+    ChatEvent event;
+    event.type = ChatEvent::Authorized;
+    event.userId = 1;
+    event.userName = "я";
+    event.sequence = 1000;
+    for (int i = 0; i < users; i++) {
+        ChatUser user;
+        user.userId = i + 2;
+        user.userName = QString("user %1").arg(i);
+        user.gender = i % 3;
+        user.userColor = "#16a085";
+        event.users.append(user);
+    }
+    return event;
+}
+
+// Разбор, каким он был до курсора: документ, объект, поиск полей по имени
+bool TestProtocol::decodeJsonDocument(const QString &frame, ChatEvent &event)
+{
+    QJsonDocument document = QJsonDocument::fromJson(frame.toUtf8());
+    if (!document.isObject()) {
+        return false;
+    }
+
+    QJsonObject object = document.object();
+    QString action = object.value("action").toString();
+    event.type = Protocol::actionType(action.constData(), action.size());
+    event.userId = object.value("userId").toInt();
+    event.userName = object.value("userName").toString();
+    event.userColor = object.value("userColor").toString();
+    event.gender = object.value("gender").toInt();
+    event.text = object.value("text").toString();
+
+    foreach (const QJsonValue &value, object.value("users").toArray()) {
+        QJsonObject userObject = value.toObject();
+        ChatUser user;
+        user.userId = userObject.value("userId").toInt();
+        user.userName = userObject.value("userName").toString();
+        user.gender = userObject.value("gender").toInt();
+        user.userColor = userObject.value("userColor").toString();
+        event.users.append(user);
+    }
+
+    return true;
+}
+
+void TestProtocol::nullStringFields()
+{
+    // Ping с пустыми полями должен остаться Ping, чтобы клиент ответил Pong
+    ChatEvent event;
+    QVERIFY(Protocol::decode(QString("{\"action\":\"Ping\",\"userName\":null,\"text\":5}"), event));
+    QCOMPARE(event.type, ChatEvent::Ping);
+
+    ChatEvent message;
+    QVERIFY(Protocol::decode(QString("{\"action\":\"PublicMessage\",\"userId\":3,"
+                                     "\"userName\":null,\"userColor\":{\"a\":[1]},"
+                                     "\"text\":\"привет\"}"), message));
+    QCOMPARE(message.type, ChatEvent::PublicMessage);
+    QCOMPARE(message.userId, 3);
+    QVERIFY(message.userName.isEmpty());
+    QVERIFY(message.userColor.isEmpty());
+    QCOMPARE(message.text, QString("привет"));
+}
+
+void TestProtocol::badRosterEntry()
+{
+    // Одна испорченная запись не должна стоить всего списка
+    ChatEvent event;
+    QVERIFY(Protocol::decode(QString("{\"action\":\"Authorized\",\"userId\":1,\"userName\":\"я\","
+                                     "\"users\":[{\"userId\":2,\"userName\":\"анна\"},"
+                                     "{\"userId\":3,\"userName\":null,\"userColor\":7},"
+                                     "{\"userId\":4,\"userName\":\"пётр\"}]}"), event));
+    QCOMPARE(event.type, ChatEvent::Authorized);
+    QCOMPARE(event.users.size(), 3);
+    QCOMPARE(event.users.at(0).userName, QString("анна"));
+    QCOMPARE(event.users.at(1).userId, 3);
+    QVERIFY(event.users.at(1).userName.isEmpty());
+    QVERIFY(event.users.at(1).userColor.isEmpty());
+    QCOMPARE(event.users.at(2).userName, QString("пётр"));
+}
+
+void TestProtocol::integerOverflow()
+{
+    // Число длиннее qint64 портит только своё поле, а не весь кадр
+    ChatEvent event;
+    QVERIFY(Protocol::decode(QString("{\"action\":\"PublicMessage\","
+                                     "\"userId\":123456789012345678901234567890,"
+                                     "\"seq\":-99999999999999999999,"
+                                     "\"text\":\"привет\"}"), event));
+    QCOMPARE(event.type, ChatEvent::PublicMessage);
+    QCOMPARE(event.userId, 0);
+    QCOMPARE(event.sequence, quint64(0));
+    QCOMPARE(event.text, QString("привет"));
+
+    // Число вне int не урезается: 4294967297 не должно стать userId 1
+    ChatEvent wide;
+    QVERIFY(Protocol::decode(QString("{\"action\":\"PublicMessage\",\"userId\":4294967297,"
+                                     "\"text\":\"привет\"}"), wide));
+    QCOMPARE(wide.userId, 0);
+    QCOMPARE(wide.text, QString("привет"));
+
+    ChatEvent roster;
+    QVERIFY(Protocol::decode(QString("{\"action\":\"Authorized\",\"userId\":1,"
+                                     "\"users\":[{\"userId\":-2147483649,\"gender\":1},"
+                                     "{\"userId\":2147483647}]}"), roster));
+    QCOMPARE(roster.users.size(), 2);
+    QCOMPARE(roster.users.at(0).userId, 0);
+    QCOMPARE(roster.users.at(0).gender, 1);
+    QCOMPARE(roster.users.at(1).userId, 2147483647);
+
+    QCborMap map;
+    map.insert(qint64(Protocol::KeyAction), int(Protocol::ActionPublicMessage));
+    map.insert(qint64(Protocol::KeyUserId), qint64(4294967297LL));
+    ChatEvent cbor;
+    QVERIFY(Protocol::decode(map.toCborValue().toCbor(), cbor));
+    QCOMPARE(cbor.userId, 0);
+
+    // Наибольшее qint64 ещё читается целиком
+    ChatEvent last;
+    QVERIFY(Protocol::decode(QString("{\"action\":\"PublicMessage\","
+                                     "\"seq\":9223372036854775807}"), last));
+    QCOMPARE(last.sequence, quint64(9223372036854775807LL));
+}
+
+void TestProtocol::cborNonIntegerKey()
+{
+    // Строковый ключ не должен читаться как KeyAction
+    QCborMap map;
+    map.insert(qint64(Protocol::KeyAction), int(Protocol::ActionPublicMessage));
+    map.insert(QString("action"), int(Protocol::ActionAuthorized));
+    map.insert(QCborValue(2.5), QString("мусор"));
+    map.insert(qint64(Protocol::KeyText), QString("привет"));
+
+    ChatEvent event;
+    QVERIFY(Protocol::decode(map.toCborValue().toCbor(), event));
+    QCOMPARE(event.type, ChatEvent::PublicMessage);
+    QCOMPARE(event.text, QString("привет"));
+}
+
+void TestProtocol::roundTrip_data()
+{
+    QTest::addColumn<int>("format");
+    QTest::newRow("json") << int(Protocol::JsonFormat);
+    QTest::newRow("cbor") << int(Protocol::CborFormat);
+}
+
+void TestProtocol::roundTrip()
+{
+    QFETCH(int, format);
+
+    ChatEvent source = authorized(3);
+    QByteArray frame = Protocol::encodeEvent(source, Protocol::WireFormat(format));
+
+    ChatEvent event;
+    if (format == Protocol::JsonFormat) {
+        QVERIFY(Protocol::decode(QString::fromUtf8(frame), event));
+    }
+    else {
+        QVERIFY(Protocol::decode(frame, event));
+    }
+
+    QCOMPARE(event.type, source.type);
+    QCOMPARE(event.userId, source.userId);
+    QCOMPARE(event.userName, source.userName);
+    QCOMPARE(event.sequence, source.sequence);
+    QCOMPARE(event.users.size(), source.users.size());
+    for (int i = 0; i < source.users.size(); i++) {
+        QCOMPARE(event.users.at(i).userId, source.users.at(i).userId);
+        QCOMPARE(event.users.at(i).userName, source.users.at(i).userName);
+        QCOMPARE(event.users.at(i).gender, source.users.at(i).gender);
+        QCOMPARE(event.users.at(i).userColor, source.users.at(i).userColor);
+    }
+}
+
+void TestProtocol::benchmarkDecode_data()
+{
+    QTest::addColumn<QString>("decoder");
+    QTest::addColumn<int>("format");
+    QTest::addColumn<bool>("roster");
+
+    QTest::newRow("message jsondocument") << "document" << int(Protocol::JsonFormat) << false;
+    QTest::newRow("message cursor") << "cursor" << int(Protocol::JsonFormat) << false;
+    QTest::newRow("message cbor") << "cursor" << int(Protocol::CborFormat) << false;
+    QTest::newRow("roster jsondocument") << "document" << int(Protocol::JsonFormat) << true;
+    QTest::newRow("roster cursor") << "cursor" << int(Protocol::JsonFormat) << true;
+    QTest::newRow("roster cbor") << "cursor" << int(Protocol::CborFormat) << true;
+}
+
+void TestProtocol::benchmarkDecode()
+{
+    QFETCH(QString, decoder);
+    QFETCH(int, format);
+    QFETCH(bool, roster);
+
+    // Обычное сообщение чата и список на 5000 пользователей
+    ChatEvent source = roster ? authorized(5000) : message(80);
+    QByteArray frame = Protocol::encodeEvent(source, Protocol::WireFormat(format));
+    QString text = QString::fromUtf8(frame);
+
+    ChatEvent event;
+    bool ok = true;
+    if (format == Protocol::CborFormat) {
+        QBENCHMARK {
+            event = ChatEvent();
+            ok = Protocol::decode(frame, event) && ok;
+        }
+    }
+    else if (decoder == "document") {
+        QBENCHMARK {
+            event = ChatEvent();
+            ok = decodeJsonDocument(text, event) && ok;
+        }
+    }
+    else {
+        QBENCHMARK {
+            event = ChatEvent();
+            ok = Protocol::decode(text, event) && ok;
+        }
+    }
+
+    QVERIFY(ok);
+    QCOMPARE(event.type, source.type);
+    QCOMPARE(event.users.size(), source.users.size());
+}
+
+QTEST_APPLESS_MAIN(TestProtocol)
+
+#include "tst_protocol.moc"
@@ -0,0 +1,18 @@
+# Запись кадров и воспроизведение: те же события в том же порядке
+# без ограничения скорости и в N раз быстрее записи
+QT += core network websockets testlib
+QT -= gui
+
+TARGET = tst_replay
+TEMPLATE = app
+DEFINES += QT_DEPRECATED_WARNINGS SIMPLECHAT_NO_TRACE
+CONFIG += c++11 console testcase
+CONFIG -= app_bundle
+INCLUDEPATH += ../.. ../../server
+SOURCES += tst_replay.cpp \
+    ../../connectionworker.cpp ../../framecapture.cpp ../../sendqueue.cpp \
+    ../../server/chatserver.cpp
+HEADERS += ../../connectionworker.h ../../framecapture.h ../../sendqueue.h \
+    ../../spscqueue.h ../../server/chatserver.h
+
+include(../../protocol.pri)
@@ -0,0 +1,177 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "chatserver.h"
+#include "connectionworker.h"
+
+#include <QTemporaryDir>
+#include <QtTest>
+
+// Запись кадров живого соединения с тестовым сервером и её воспроизведение:
+// без ограничения скорости и в N раз быстрее клиент должен получить те же
+// события в том же порядке, что и по сети. Замер - время воспроизведения:
+// ./tst_replay roundTrip
+class TestReplay : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void roundTrip();
+    void roundTrip_data();
+
+private:
+    static QString describe(const ChatEvent &event);
+
+    QTemporaryDir m_dir;
+    QString m_capture;
+    QVector<ChatEvent> m_recorded;
+    qint64 m_recordedSpan; // мкс от первого события до последнего
+};
+
+// События обработчика в порядке прихода, как их вычитывает GUI
+class EventSink : public QObject
+{
+public:
+    explicit EventSink(ConnectionWorker *worker) :
+        m_worker(worker)
+    {
+        connect(worker, &ConnectionWorker::eventsAvailable, this, [this]() {
+            m_worker->acknowledgeEvents();
+            ChatEvent event;
+            while (m_worker->events()->pop(event)) {
+                events.append(event);
+            }
+        });
+    }
+
+    QVector<ChatEvent> events;
+
+private:
+    ConnectionWorker *m_worker;
+};
+
+void TestReplay::initTestCase()
+{
+    QVERIFY(m_dir.isValid());
+    m_capture = m_dir.path() + "/session.capture";
+
+    // Сообщения, входы и выходы имитируемых пользователей
+    ServerOptions options;
+    options.port = 0;
+    options.anyAddress = false;
+    options.rosterSize = 50;
+    options.fanoutRate = 300;
+    options.burstSize = 0;
+    options.burstInterval = 0;
+    options.presenceRate = 50;
+    options.latency = 0;
+    options.jitter = 0;
+    options.pingInterval = 0;
+    options.resyncLog = 0;
+    options.dropInterval = 0;
+    options.resyncDrops = 0;
+
+    ChatServer server(options);
+    QVERIFY(server.listen());
+
+    {
+        ConnectionWorker worker;
+        EventSink sink(&worker);
+        worker.startRecording(m_capture);
+        worker.open(QStringList() << QString("ws://127.0.0.1:%1?userName=tester").arg(server.serverPort()));
+
+        QTRY_VERIFY(!sink.events.isEmpty());
+        QCOMPARE(sink.events.first().type, ChatEvent::Authorized);
+        QTest::qWait(300);
+        worker.close();
+
+        // Запись закрывается вместе с обработчиком
+        m_recorded = sink.events;
+    }
+
+    QVERIFY(m_recorded.size() > 20);
+    m_recordedSpan = m_recorded.last().received - m_recorded.first().received;
+}
+
+QString TestReplay::describe(const ChatEvent &event)
+{
+    return QString("%1 #%2 %3 %4: %5")
+            .arg(int(event.type))
+            .arg(event.sequence)
+            .arg(event.userId)
+            .arg(event.userName)
+            .arg(event.text);
+}
+
+void TestReplay::roundTrip_data()
+{
+    QTest::addColumn<double>("speed");
+    QTest::newRow("unlimited") << 0.0;
+    QTest::newRow("x1") << 1.0;
+    QTest::newRow("x4") << 4.0;
+}
+
+void TestReplay::roundTrip()
+{
+    QFETCH(double, speed);
+
+    qint64 elapsed = 0;
+    QVector<ChatEvent> replayed;
+    QBENCHMARK_ONCE {
+        ConnectionWorker worker;
+        EventSink sink(&worker);
+
+        bool finished = false;
+        connect(&worker, &ConnectionWorker::replayFinished,
+                [&finished, &elapsed](qint64, qint64 replayElapsed) {
+                    finished = true;
+                    elapsed = replayElapsed;
+                });
+
+        worker.replay(m_capture, speed);
+        QTRY_VERIFY_WITH_TIMEOUT(finished, 10000);
+        replayed = sink.events;
+    }
+
+    QCOMPARE(replayed.size(), m_recorded.size());
+    for (int i = 0; i < replayed.size(); i++) {
+        QCOMPARE(describe(replayed.at(i)), describe(m_recorded.at(i)));
+        QCOMPARE(replayed.at(i).users.size(), m_recorded.at(i).users.size());
+    }
+
+    // Паузы между кадрами сохраняются с учётом скорости
+    if (speed > 0) {
+        QVERIFY2((elapsed + 1) * 1000 >= qint64(m_recordedSpan / speed),
+                 qPrintable(QString("%1 ms for %2 us at x%3")
+                            .arg(elapsed).arg(m_recordedSpan).arg(speed)));
+    }
+}
+
+QTEST_GUILESS_MAIN(TestReplay)
+
+#include "tst_replay.moc"
@@ -0,0 +1,18 @@
+# Переподключение с догоном пропущенного: настоящий обработчик
+# соединения клиента против тестового сервера в одном процессе
+QT += core network websockets testlib
+QT -= gui
+
+TARGET = tst_resync
+TEMPLATE = app
+DEFINES += QT_DEPRECATED_WARNINGS SIMPLECHAT_NO_TRACE
+CONFIG += c++11 console testcase
+CONFIG -= app_bundle
+INCLUDEPATH += ../.. ../../server
+SOURCES += tst_resync.cpp \
+    ../../connectionworker.cpp ../../framecapture.cpp ../../sendqueue.cpp \
+    ../../server/chatserver.cpp
+HEADERS += ../../connectionworker.h ../../framecapture.h ../../sendqueue.h \
+    ../../spscqueue.h ../../server/chatserver.h
+
+include(../../protocol.pri)
@@ -0,0 +1,234 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "chatserver.h"
+#include "connectionworker.h"
+
+#include <QWebSocket>
+#include <QtTest>
+
+// Обрыв и переподключение обработчика соединения клиента к тестовому
+// серверу: сервер, который помнит пропущенные события, отвечает Resynced
+// и присылает только их, а забывший - полным списком в Authorized.
+class TestResync : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void resyncAfterDrop();
+    void snapshotWhenLogExhausted();
+    void dropDuringCatchUp();
+
+private:
+    static ServerOptions options(int resyncLog, int resyncDrops = 0);
+    static QString url(quint16 port, const QString &userName);
+    static int indexOf(const QVector<ChatEvent> &events, ChatEvent::Type type, int from = 0);
+};
+
+// События обработчика в порядке прихода, как их вычитывает GUI
+class EventSink : public QObject
+{
+public:
+    explicit EventSink(ConnectionWorker *worker) :
+        m_worker(worker)
+    {
+        connect(worker, &ConnectionWorker::eventsAvailable, this, [this]() {
+            m_worker->acknowledgeEvents();
+            ChatEvent event;
+            while (m_worker->events()->pop(event)) {
+                events.append(event);
+            }
+        });
+    }
+
+    QVector<ChatEvent> events;
+
+private:
+    ConnectionWorker *m_worker;
+};
+
+ServerOptions TestResync::options(int resyncLog, int resyncDrops)
+{
+    ServerOptions options;
+    options.port = 0;
+    options.anyAddress = false;
+    options.rosterSize = 3;
+    options.fanoutRate = 0;
+    options.burstSize = 0;
+    options.burstInterval = 0;
+    options.presenceRate = 0;
+    options.latency = 0;
+    options.jitter = 0;
+    options.pingInterval = 0;
+    options.resyncLog = resyncLog;
+    options.dropInterval = 0;
+    options.resyncDrops = resyncDrops;
+    return options;
+}
+
+QString TestResync::url(quint16 port, const QString &userName)
+{
+    return QString("ws://127.0.0.1:%1?userName=%2").arg(port).arg(userName)
+            + "&userColor=%2334495e&gender=0";
+}
+
+int TestResync::indexOf(const QVector<ChatEvent> &events, ChatEvent::Type type, int from)
+{
+    for (int i = from; i < events.size(); i++) {
+        if (events.at(i).type == type) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void TestResync::resyncAfterDrop()
+{
+    ChatServer server(options(100));
+    QVERIFY(server.listen());
+
+    ConnectionWorker worker;
+    worker.setReconnectDelays(50, 100);
+    EventSink sink(&worker);
+    worker.open(QStringList() << url(server.serverPort(), "tester"));
+
+    QTRY_VERIFY(indexOf(sink.events, ChatEvent::Authorized) >= 0);
+    const ChatEvent authorized = sink.events.at(indexOf(sink.events, ChatEvent::Authorized));
+    QCOMPARE(authorized.users.size(), 3);
+    QVERIFY(authorized.sequence > 0);
+
+    // Второй участник: его вход - последнее событие, которое клиент увидит до обрыва
+    QWebSocket other;
+    other.open(QUrl(url(server.serverPort(), "other")));
+    QTRY_VERIFY(indexOf(sink.events, ChatEvent::Connected) >= 0);
+    const ChatEvent joined = sink.events.at(indexOf(sink.events, ChatEvent::Connected));
+    QVERIFY(joined.sequence > authorized.sequence);
+
+    // Обрыв всех соединений: уход обоих участников клиент пропускает
+    int before = sink.events.size();
+    QVERIFY(QMetaObject::invokeMethod(&server, "dropAll"));
+
+    QTRY_VERIFY(indexOf(sink.events, ChatEvent::Resynced, before) >= 0);
+    int resyncedAt = indexOf(sink.events, ChatEvent::Resynced, before);
+    QCOMPARE(sink.events.at(resyncedAt).sequence, joined.sequence + 2);
+    QCOMPARE(indexOf(sink.events, ChatEvent::Authorized, before), -1);
+
+    // Пропущенные события идут следом, по порядку и без дыр
+    QTRY_VERIFY(sink.events.size() >= resyncedAt + 3);
+    const ChatEvent lostSelf = sink.events.at(resyncedAt + 1);
+    const ChatEvent lostOther = sink.events.at(resyncedAt + 2);
+    QCOMPARE(lostSelf.type, ChatEvent::ConnectionLost);
+    QCOMPARE(lostSelf.userId, authorized.userId);
+    QCOMPARE(lostSelf.sequence, joined.sequence + 1);
+    QCOMPARE(lostOther.type, ChatEvent::ConnectionLost);
+    QCOMPARE(lostOther.userId, joined.userId);
+    QCOMPARE(lostOther.sequence, joined.sequence + 2);
+
+    worker.close();
+}
+
+void TestResync::snapshotWhenLogExhausted()
+{
+    // Сервер помнит одно событие, а клиент пропустит два
+    ChatServer server(options(1));
+    QVERIFY(server.listen());
+
+    ConnectionWorker worker;
+    worker.setReconnectDelays(50, 100);
+    EventSink sink(&worker);
+    worker.open(QStringList() << url(server.serverPort(), "tester"));
+
+    QWebSocket other;
+    other.open(QUrl(url(server.serverPort(), "other")));
+    QTRY_VERIFY(indexOf(sink.events, ChatEvent::Connected) >= 0);
+
+    int before = sink.events.size();
+    QVERIFY(QMetaObject::invokeMethod(&server, "dropAll"));
+
+    QTRY_VERIFY(indexOf(sink.events, ChatEvent::Authorized, before) >= 0);
+    QCOMPARE(indexOf(sink.events, ChatEvent::Resynced, before), -1);
+
+    // Полный список: имитируемые пользователи, ушедших участников в нём нет
+    const ChatEvent authorized = sink.events.at(indexOf(sink.events, ChatEvent::Authorized, before));
+    QCOMPARE(authorized.users.size(), 3);
+
+    worker.close();
+}
+
+void TestResync::dropDuringCatchUp()
+{
+    // Первый догон обрывается после половины пропущенного
+    ChatServer server(options(100, 1));
+    QVERIFY(server.listen());
+
+    ConnectionWorker worker;
+    worker.setReconnectDelays(50, 100);
+    EventSink sink(&worker);
+    worker.open(QStringList() << url(server.serverPort(), "tester"));
+
+    QWebSocket other;
+    other.open(QUrl(url(server.serverPort(), "other")));
+    QTRY_VERIFY(indexOf(sink.events, ChatEvent::Connected) >= 0);
+    const ChatEvent joined = sink.events.at(indexOf(sink.events, ChatEvent::Connected));
+
+    int before = sink.events.size();
+    QVERIFY(QMetaObject::invokeMethod(&server, "dropAll"));
+
+    // Первый Resynced обещает два события, а приходит одно: обрыв
+    QTRY_VERIFY(indexOf(sink.events, ChatEvent::Resynced, before) >= 0);
+    int firstAt = indexOf(sink.events, ChatEvent::Resynced, before);
+    QCOMPARE(sink.events.at(firstAt).sequence, joined.sequence + 2);
+
+    // Второй догон продолжает с полученного события, а не с номера
+    // из первого Resynced, и досылает уход второго участника
+    QTRY_VERIFY(indexOf(sink.events, ChatEvent::Resynced, firstAt + 1) >= 0);
+    int secondAt = indexOf(sink.events, ChatEvent::Resynced, firstAt + 1);
+    QTRY_VERIFY(sink.events.size() > secondAt + 1);
+    QCOMPARE(indexOf(sink.events, ChatEvent::Authorized, before), -1);
+
+    // Каждое пропущенное событие доставлено ровно один раз
+    QVector<quint64> delivered;
+    for (int i = before; i < sink.events.size(); i++) {
+        const ChatEvent &event = sink.events.at(i);
+        if (event.type != ChatEvent::Resynced && event.sequence != 0) {
+            delivered.append(event.sequence);
+        }
+    }
+    QCOMPARE(delivered.count(joined.sequence + 1), 1);
+    QCOMPARE(delivered.count(joined.sequence + 2), 1);
+
+    const ChatEvent lostOther = sink.events.at(secondAt + 1);
+    QCOMPARE(lostOther.type, ChatEvent::ConnectionLost);
+    QCOMPARE(lostOther.userId, joined.userId);
+    QCOMPARE(lostOther.sequence, joined.sequence + 2);
+
+    worker.close();
+}
+
+QTEST_GUILESS_MAIN(TestResync)
+
+#include "tst_resync.moc"
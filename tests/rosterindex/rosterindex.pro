@@ -0,0 +1,12 @@
+# Индекс имён списка пользователей: поиск после добавлений и удалений
+QT += core testlib
+QT -= gui
+
+TARGET = tst_rosterindex
+TEMPLATE = app
+DEFINES += QT_DEPRECATED_WARNINGS
+CONFIG += c++11 console testcase
+CONFIG -= app_bundle
+INCLUDEPATH += ../..
+SOURCES += tst_rosterindex.cpp ../../rosterindex.cpp
+HEADERS += ../../rosterindex.h
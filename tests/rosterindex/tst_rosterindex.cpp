@@ -0,0 +1,110 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "rosterindex.h"
+
+#include <QtTest>
+#include <algorithm>
+
+class TestRosterIndex : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void searchAfterRemove();
+    void leaveStorm();
+
+private:
+    static QVector<int> sorted(QVector<int> ids);
+};
+
+QVector<int> TestRosterIndex::sorted(QVector<int> ids)
+{
+    std::sort(ids.begin(), ids.end());
+    return ids;
+}
+
+void TestRosterIndex::searchAfterRemove()
+{
+    RosterIndex index;
+    index.add(1, "Анна Петрова");
+    index.add(2, "Антон");
+    index.add(3, "Пётр Анисимов");
+    index.add(4, "анна");
+
+    QCOMPARE(sorted(index.search("ан")), QVector<int>() << 1 << 2 << 3 << 4);
+    QCOMPARE(sorted(index.search("анн")), QVector<int>() << 1 << 4);
+
+    index.remove(1);
+    QCOMPARE(sorted(index.search("ан")), QVector<int>() << 2 << 3 << 4);
+    QCOMPARE(sorted(index.search("анн")), QVector<int>() << 4);
+    QVERIFY(!index.matches(1, "анн"));
+
+    index.remove(4);
+    index.remove(2);
+    QCOMPARE(index.search("ан"), QVector<int>() << 3);
+
+    index.remove(3);
+    QVERIFY(index.search("ан").isEmpty());
+    QCOMPARE(index.bytes(), qint64(0));
+}
+
+void TestRosterIndex::leaveStorm()
+{
+    // Общие префиксы и триграммы у всех: каждое удаление
+    // переставляет чужие позиции в одних и тех же списках
+    const int count = 2000;
+    RosterIndex index;
+    for (int userId = 1; userId <= count; userId++) {
+        index.add(userId, QString("user %1").arg(userId));
+    }
+
+    QVector<int> expected;
+    for (int userId = 1; userId <= count; userId++) {
+        if (userId % 3 == 0) {
+            expected << userId;
+        }
+        else {
+            index.remove(userId);
+        }
+    }
+
+    QCOMPARE(sorted(index.search("us")), expected);
+    QCOMPARE(sorted(index.search("user")), expected);
+    QCOMPARE(index.search("user 2000"), QVector<int>());
+    QCOMPARE(index.search("user 1998"), QVector<int>() << 1998);
+
+    foreach (int userId, expected) {
+        index.remove(userId);
+    }
+    QVERIFY(index.search("us").isEmpty());
+    QCOMPARE(index.bytes(), qint64(0));
+}
+
+QTEST_APPLESS_MAIN(TestRosterIndex)
+
+#include "tst_rosterindex.moc"
@@ -0,0 +1,4 @@
+# Автотесты и замеры производительности.
+# Сборка и запуск: qmake && make check
+TEMPLATE = subdirs
+SUBDIRS += messagelogmodel rosterindex protocol messagetemplate resync historystore replay highlightmatcher markuprenderer
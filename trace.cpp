@@ -0,0 +1,217 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "trace.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QList>
+#include <QMutex>
+#include <QThread>
+#include <QVector>
+
+namespace {
+
+struct TraceEvent
+{
+    const char *name;
+    const char *category;
+    qint64 start; // нс
+    qint64 duration; // нс
+    quint64 id;
+    char phase; // 'X' - стадия, 's'/'f' - начало и конец стрелки
+};
+
+// Буфер одного потока. Пишет в него только владелец, а номер следующей
+// записи публикуется с release, чтобы выгрузка видела готовые события.
+struct TraceBuffer
+{
+    QVector<TraceEvent> events;
+    std::atomic<quint64> written;
+    int threadId;
+    QString threadName;
+};
+
+QMutex buffersMutex;
+QList<TraceBuffer *> buffers; // живут до конца программы, как и их события
+
+thread_local TraceBuffer *threadBuffer = nullptr;
+
+QElapsedTimer &traceClock()
+{
+    static QElapsedTimer timer;
+    static bool started = (timer.start(), true);
+    Q_UNUSED(started)
+    return timer;
+}
+
+TraceBuffer *buffer()
+{
+    if (!threadBuffer) {
+        TraceBuffer *created = new TraceBuffer;
+        created->events.resize(Trace::BufferSize);
+        created->written.store(0);
+
+        QThread *thread = QThread::currentThread();
+        created->threadName = thread->objectName();
+        if (created->threadName.isEmpty()) {
+            created->threadName = thread == qApp->thread() ? "gui" : "thread";
+        }
+
+        QMutexLocker locker(&buffersMutex);
+        created->threadId = buffers.size() + 1;
+        buffers.append(created);
+        threadBuffer = created;
+    }
+    return threadBuffer;
+}
+
+void record(const TraceEvent &event)
+{
+    TraceBuffer *b = buffer();
+    quint64 n = b->written.load(std::memory_order_relaxed);
+    b->events[int(n % Trace::BufferSize)] = event;
+    b->written.store(n + 1, std::memory_order_release);
+}
+
+QByteArray escaped(const QString &text)
+{
+    QByteArray result = text.toUtf8();
+    result.replace('\\', "\\\\");
+    result.replace('"', "\\\"");
+    return result;
+}
+
+} // namespace
+
+std::atomic<bool> Trace::s_enabled(false);
+
+void Trace::setEnabled(bool enabled)
+{
+    traceClock();
+    s_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+qint64 Trace::now()
+{
+    return traceClock().nsecsElapsed();
+}
+
+void Trace::complete(const char *name, const char *category,
+                     qint64 start, qint64 end, quint64 id)
+{
+    TraceEvent event = { name, category, start, end - start, id, 'X' };
+    record(event);
+}
+
+void Trace::flowStart(const char *name, quint64 id)
+{
+    TraceEvent event = { name, "flow", now(), 0, id, 's' };
+    record(event);
+}
+
+void Trace::flowEnd(const char *name, quint64 id)
+{
+    TraceEvent event = { name, "flow", now(), 0, id, 'f' };
+    record(event);
+}
+
+bool Trace::dump(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+
+    qint64 pid = QCoreApplication::applicationPid();
+
+    QByteArray out;
+    out.reserve(1024 * 1024);
+    out += "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+    bool first = true;
+    auto separator = [&]() {
+        if (!first) {
+            out += ",\n";
+        }
+        first = false;
+    };
+
+    QMutexLocker locker(&buffersMutex);
+    foreach (TraceBuffer *b, buffers) {
+        separator();
+        out += QString("{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%1,\"tid\":%2,"
+                       "\"args\":{\"name\":\"").arg(pid).arg(b->threadId).toUtf8();
+        out += escaped(b->threadName);
+        out += "\"}}";
+
+        // Старые события могли быть перезаписаны: берём последние BufferSize
+        quint64 written = b->written.load(std::memory_order_acquire);
+        quint64 begin = written > quint64(BufferSize) ? written - BufferSize : 0;
+
+        for (quint64 n = begin; n < written; n++) {
+            const TraceEvent &event = b->events.at(int(n % BufferSize));
+            separator();
+
+            // Время в микросекундах с дробной частью
+            out += "{\"ph\":\"";
+            out += event.phase;
+            out += "\",\"name\":\"";
+            out += event.name;
+            out += "\",\"cat\":\"";
+            out += event.category;
+            out += "\",\"pid\":" + QByteArray::number(pid);
+            out += ",\"tid\":" + QByteArray::number(b->threadId);
+            out += ",\"ts\":" + QByteArray::number(event.start / 1000.0, 'f', 3);
+
+            if (event.phase == 'X') {
+                out += ",\"dur\":" + QByteArray::number(event.duration / 1000.0, 'f', 3);
+                if (event.id) {
+                    out += ",\"args\":{\"id\":" + QByteArray::number(event.id) + "}";
+                }
+            }
+            else {
+                out += ",\"id\":" + QByteArray::number(event.id);
+                if (event.phase == 'f') {
+                    out += ",\"bp\":\"e\"";
+                }
+            }
+            out += '}';
+        }
+
+        if (out.size() > 512 * 1024) {
+            file.write(out);
+            out.clear();
+        }
+    }
+
+    out += "\n]}\n";
+    file.write(out);
+
+    return file.error() == QFile::NoError;
+}
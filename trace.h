@@ -0,0 +1,128 @@
+/*******************************************************************************
+ * MIT License
+ *
+ * This file is part of the SimpleChat project:
+ * https://github.com/wxmaper/SimpleChat-client
+ *
+ * Copyright (c) 2019 Aleksandr Kazantsev (https://wxmaper.ru)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <QString>
+#include <QtGlobal>
+
+#include <atomic>
+
+// Трассировка горячего пути.
+// Каждый поток пишет события в свой кольцевой буфер без блокировок,
+// поэтому включённая трассировка почти не мешает замеряемому коду,
+// а выключенная стоит одной проверки флага на каждую стадию.
+// Снимок выгружается в формате Chrome trace-event JSON и открывается
+// в chrome://tracing или Perfetto.
+//
+// С определённым SIMPLECHAT_NO_TRACE макросы не порождают кода вовсе.
+class Trace
+{
+public:
+    static bool isEnabled()
+    {
+        return s_enabled.load(std::memory_order_relaxed);
+    }
+
+    static void setEnabled(bool enabled);
+
+    // Наносекунды монотонных часов, общих для всех потоков
+    static qint64 now();
+
+    // Законченная стадия: имя и категория - строковые литералы
+    static void complete(const char *name, const char *category,
+                         qint64 start, qint64 end, quint64 id);
+
+    // Стрелка между стадиями разных потоков с одним id
+    static void flowStart(const char *name, quint64 id);
+    static void flowEnd(const char *name, quint64 id);
+
+    // Новый id для стрелки, один счётчик на процесс: у сессий, делящих
+    // сетевой поток, id не совпадают, и стрелки не связывают чужие события
+    static quint64 nextId()
+    {
+        static std::atomic<quint64> counter(0);
+        return counter.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+    // Выгрузка всех буферов; трассировку лучше сначала выключить
+    static bool dump(const QString &fileName);
+
+    static const int BufferSize = 65536; // событий на поток
+
+private:
+    static std::atomic<bool> s_enabled;
+};
+
+// Замер стадии от объявления до конца области видимости
+class TraceScope
+{
+public:
+    TraceScope(const char *name, const char *category, quint64 id = 0) :
+        m_name(name),
+        m_category(category),
+        m_id(id),
+        m_start(Trace::isEnabled() ? Trace::now() : -1)
+    {
+    }
+
+    ~TraceScope()
+    {
+        if (m_start >= 0) {
+            Trace::complete(m_name, m_category, m_start, Trace::now(), m_id);
+        }
+    }
+
+private:
+    Q_DISABLE_COPY(TraceScope)
+
+    const char *m_name;
+    const char *m_category;
+    quint64 m_id;
+    qint64 m_start;
+};
+
+#ifdef SIMPLECHAT_NO_TRACE
+#define TRACE_SCOPE(name, category)
+#define TRACE_SCOPE_ID(name, category, id)
+#define TRACE_FLOW_START(name, id)
+#define TRACE_FLOW_END(name, id)
+#else
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name, category) \
+    TraceScope TRACE_CONCAT(traceScope, __LINE__)(name, category)
+#define TRACE_SCOPE_ID(name, category, id) \
+    TraceScope TRACE_CONCAT(traceScope, __LINE__)(name, category, id)
+#define TRACE_FLOW_START(name, id) \
+    do { if (Trace::isEnabled()) Trace::flowStart(name, id); } while (0)
+#define TRACE_FLOW_END(name, id) \
+    do { if (Trace::isEnabled()) Trace::flowEnd(name, id); } while (0)
+#endif
+
+#endif // TRACE_H
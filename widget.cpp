@@ -27,24 +27,83 @@
 
 #include "widget.h"
 #include "ui_widget.h"
+#include "messagelogmodel.h"
+#include "connectionworker.h"
+#include "rostermodel.h"
+#include "rosterfiltermodel.h"
+#include "historystore.h"
+#include "markuprenderer.h"
+#include "searchdialog.h"
+#include "trace.h"
+#include "startup.h"
 
-#include <QJsonDocument>
-#include <QJsonObject>
 #include <QTimer>
+#include <QShortcut>
+#include <QFile>
+#include <QFileInfo>
+#include <QFileDialog>
+#include <QMessageBox>
+#include <QTextStream>
 #include <QSettings>
 #include <QUrlQuery>
-#include <QJsonArray>
-
-Widget::Widget(QWidget *parent) :
+#include <QDesktopServices>
+#include <QThread>
+#include <QDateTime>
+#include <QDebug>
+
+// Обработчики событий по их типу. Ping обрабатывается сетевым потоком.
+const Widget::EventHandler Widget::eventHandlers[ChatEvent::TypeCount] = {
+    nullptr,                        // Unknown
+    nullptr,                        // Ping
+    &Widget::handleAuthorized,
+    &Widget::handleConnected,
+    &Widget::handleDisconnected,
+    &Widget::handleConnectionLost,
+    &Widget::handlePublicMessage,
+    &Widget::handlePrivateMessage,
+    &Widget::handleResynced
+};
+
+Widget::Widget(QThread *networkThread,
+               QThread *historyThread,
+               const QString &historyName,
+               ConnectionWorker *worker,
+               QWidget *parent) :
     QWidget(parent),
     ui(new Ui::Widget),
-    m_webSocket(new QWebSocket(QString("SimpleChatClient"),
-                               QWebSocketProtocol::Version13,
-                               this)),
-    m_pingTimer(new QTimer(this))
+    m_networkThread(networkThread),
+    m_worker(worker ? worker : new ConnectionWorker),
+    m_workerOpened(worker != nullptr),
+    m_events(m_worker->events()),
+    m_messageLog(new MessageLogModel(5000, this)),
+    m_roster(new RosterModel(this)),
+    m_rosterFilter(new RosterFilterModel(m_roster, this)),
+    m_rosterSnapshotPos(0),
+    m_rosterTimer(new QTimer(this)),
+    m_presenceTimer(new QTimer(this)),
+    m_presenceWindow(1000),
+    m_flushTimer(new QTimer(this)),
+    m_pendingHighlight(false),
+    m_messageShown(false),
+    m_lastFlushSize(0),
+    m_maxFlushSize(0),
+    m_sendQueueDepth(0),
+    m_bytesInFlight(0),
+    m_sendHighWaterMark(256 * 1024),
+    m_healthTimer(new QTimer(this)),
+    m_primary(false),
+    m_historyThread(historyThread),
+    m_historyName(historyName),
+    m_historyStore(nullptr),
+    m_searchDialog(nullptr),
+    m_sequence(0)
 {
     ui->setupUi(this);
-    ui->textBrowser->setContextMenuPolicy(Qt::NoContextMenu);
+    ui->listView_messages->setContextMenuPolicy(Qt::NoContextMenu);
+    ui->listView_messages->setModel(m_messageLog);
+    ui->listView_users->setModel(m_roster);
+    ui->listView_users->setUniformItemSizes(true);
+    ui->listView_users->setEditTriggers(QAbstractItemView::NoEditTriggers);
 
     // По умолчанию мы отправляем сообщения в общий чат
     closePrivateMessage();
@@ -53,52 +112,221 @@ Widget::Widget(QWidget *parent) :
     connect(ui->toolButton_closePrivateMessage, &QToolButton::clicked,
             this, &Widget::closePrivateMessage);
 
+    // Поиск по списку пользователей на каждое нажатие клавиши
+    connect(ui->lineEdit_userFilter, &QLineEdit::textChanged,
+            this, &Widget::filterUsers);
+
     // Обработка двойного клика по пользователю из списка.
     // При двойном клике мы активируем отправку приватного сообщения.
-    connect(ui->listWidget_users, &QListWidget::itemDoubleClicked,
-            this, &Widget::privateWithUserFromItem);
-
-    // Блокируем поле ввода сообщения до тех пор,
-    // пока соединение с сервером не будет установлено
-    ui->lineEdit_message->setEnabled(false);
+    connect(ui->listView_users, &QListView::doubleClicked,
+            this, &Widget::privateWithUserFromIndex);
 
     // Соединяем сигнал нажатия кнопки Return со слотом отправки сообщения
     connect(ui->lineEdit_message, &QLineEdit::returnPressed,
             this, &Widget::onReturnPressed);
 
     // Обработка клика по ссылкам
-    connect(ui->textBrowser, &QTextBrowser::anchorClicked,
+    connect(ui->listView_messages, &MessageLogView::anchorClicked,
             this, &Widget::onAnchorClicked);
 
-    // Таймер для пингования сервера, чтобы указать, что соединение все еще живо
-    connect(m_pingTimer, SIGNAL(timeout()), m_webSocket, SLOT(ping()));
+    // Замер запуска: до первого отрисованного сообщения чата
+    if (!Startup::isMarked("first message rendered")) {
+        connect(ui->listView_messages, &MessageLogView::painted,
+                this, &Widget::onLogPainted);
+    }
+
+    // Соединение с сервером обслуживается в сетевом потоке,
+    // одном на все сессии
+    if (!m_workerOpened) {
+        m_worker->moveToThread(m_networkThread);
+    }
+
+    connect(this, &Widget::openRequested,
+            m_worker, &ConnectionWorker::open);
+    connect(this, &Widget::sendRequested,
+            m_worker, &ConnectionWorker::sendMessage);
+    connect(this, &Widget::recordRequested,
+            m_worker, &ConnectionWorker::startRecording);
+    connect(this, &Widget::replayRequested,
+            m_worker, &ConnectionWorker::replay);
 
-    // Соединяем сигналы websocket-клиента
+    // Соединяем сигналы сетевого потока
     // Подключение к серверу
-    connect(m_webSocket, &QWebSocket::connected,
+    connect(m_worker, &ConnectionWorker::connected,
             this, &Widget::onConnected);
+    connect(m_worker, &ConnectionWorker::announced,
+            this, &Widget::onAnnounced);
+
+    // Переподключение выполняется сетевым потоком без участия пользователя
+    connect(m_worker, &ConnectionWorker::reconnectScheduled,
+            this, &Widget::onReconnectScheduled);
+    connect(m_worker, &ConnectionWorker::reconnected,
+            this, &Widget::onReconnected);
 
     // Отключение от сервера
-    connect(m_webSocket, &QWebSocket::disconnected,
+    connect(m_worker, &ConnectionWorker::disconnected,
             this, &Widget::onDisconnected);
 
     // Ошибки сокета
-    connect(m_webSocket, SIGNAL(error(QAbstractSocket::SocketError)),
-            this, SLOT(onError(QAbstractSocket::SocketError)));
-
-    // Получение сообщения с сервера
-    connect(m_webSocket, &QWebSocket::textMessageReceived,
-            this, &Widget::onTextMessageReceived);
+    connect(m_worker, &ConnectionWorker::error,
+            this, &Widget::onError);
+
+    // Запись и воспроизведение кадров
+    connect(m_worker, &ConnectionWorker::captureFailed,
+            this, &Widget::onCaptureFailed);
+    connect(m_worker, &ConnectionWorker::replayFinished,
+            this, &Widget::onReplayFinished);
+
+    // Получение событий с сервера
+    connect(m_worker, &ConnectionWorker::eventsAvailable,
+            this, &Widget::onEventsAvailable);
+
+    // Состояние очереди исходящих сообщений
+    connect(m_worker, &ConnectionWorker::sendQueueChanged,
+            this, &Widget::onSendQueueChanged);
+
+    // Замеры задержек сетевого потока
+    connect(m_worker, &ConnectionWorker::networkRttSampled,
+            this, &Widget::onNetworkRtt);
+    connect(m_worker, &ConnectionWorker::pingResponseSampled,
+            this, &Widget::onPingResponse);
+
+    // Входящие события копятся в очереди и применяются к журналу и списку
+    // пользователей пачкой, не чаще одного раза за кадр
+    m_flushTimer->setSingleShot(true);
+    m_flushTimer->setInterval(16);
+    connect(m_flushTimer, &QTimer::timeout,
+            this, &Widget::flushIngestQueue);
+
+    // Большой снимок списка пользователей вставляется порциями между
+    // итерациями цикла событий, чтобы окно оставалось отзывчивым
+    m_rosterTimer->setInterval(0);
+    connect(m_rosterTimer, &QTimer::timeout,
+            this, &Widget::ingestRosterSlice);
+
+    // Свёрнутые входы и выходы применяются по окончании окна
+    m_presenceTimer->setSingleShot(true);
+    connect(m_presenceTimer, &QTimer::timeout,
+            this, &Widget::flushPresence);
+
+    // Панель здоровья соединения обновляется раз в секунду, а не на каждый замер
+    m_healthTimer->setInterval(1000);
+    connect(m_healthTimer, &QTimer::timeout,
+            this, &Widget::updateHealth);
+    m_healthTimer->start();
+    connect(ui->toolButton_exportHealth, &QToolButton::clicked,
+            this, &Widget::exportHealth);
+    updateHealth();
 
     restoreConnectionData();
+
+    // История основной сессии открывается в первой итерации цикла событий,
+    // чтобы быстрый старт успел начать подключение раньше её чтения.
+    // История остальных - когда станет известен сервер.
+    if (!m_historyName.isEmpty()) {
+        QTimer::singleShot(0, this, &Widget::openHistory);
+    }
+
+    // Поиск по истории. Сочетания клавиш действуют только
+    // в текущей вкладке, иначе сессии перехватывали бы их друг у друга.
+    ui->toolButton_search->setEnabled(false);
+    connect(ui->toolButton_search, &QToolButton::clicked,
+            this, &Widget::openSearch);
+    QShortcut *searchShortcut = new QShortcut(QKeySequence::Find, this);
+    searchShortcut->setContext(Qt::WidgetWithChildrenShortcut);
+    connect(searchShortcut, &QShortcut::activated,
+            this, &Widget::openSearch);
+
+    // Трассировка горячего пути включается на ходу сочетанием клавиш
+    QShortcut *traceShortcut = new QShortcut(QKeySequence("Ctrl+Shift+T"), this);
+    traceShortcut->setContext(Qt::WidgetWithChildrenShortcut);
+    connect(traceShortcut, &QShortcut::activated,
+            this, &Widget::toggleTracing);
+
+    // Обработчик мог успеть подключиться, пока строилось окно:
+    // узнаём его состояние и забираем пришедшие события
+    if (m_workerOpened) {
+        QMetaObject::invokeMethod(m_worker, "announce", Qt::QueuedConnection);
+    }
 }
 
 Widget::~Widget()
 {
-    m_webSocket->close();
+    // Закрываем соединение; обработчик вместе со своей очередью событий
+    // удалится в сетевом потоке, который продолжает обслуживать остальные сессии
+    QMetaObject::invokeMethod(m_worker, "close", Qt::BlockingQueuedConnection);
+    m_worker->deleteLater();
+
+    // Дописываем в историю всё, что ещё не ушло
+    if (m_historyStore) {
+        QMetaObject::invokeMethod(m_historyStore, "append",
+                                  Qt::BlockingQueuedConnection,
+                                  Q_ARG(QVector<HistoryRecord>, m_historyPending));
+
+        // Каталог освобождается только после того, как хранилище закрыло
+        // файлы: новая сессия может сразу же занять его снова
+        HistoryStore *store = m_historyStore;
+        QMetaObject::invokeMethod(store, [store]() { delete store; },
+                                  Qt::BlockingQueuedConnection);
+        HistoryStore::releasePath(m_historyPath);
+    }
+
     delete ui;
 }
 
+Widget::MemoryUsage Widget::memoryUsage() const
+{
+    // Строки события и заголовки их буферов
+    auto eventBytes = [](const ChatEvent &event) {
+        return qint64(sizeof(ChatEvent))
+                + qint64(event.text.size() + event.userName.size() + event.userColor.size())
+                  * qint64(sizeof(QChar))
+                + qint64(event.users.size()) * qint64(sizeof(ChatUser) + 32);
+    };
+
+    MemoryUsage usage;
+    usage.log = m_messageLog->bytes();
+    usage.roster = m_roster->bytes();
+    usage.cache = ui->listView_messages->cacheBytes();
+    usage.lines = m_messageLog->rowCount();
+    usage.evicted = m_messageLog->evictedCount();
+    usage.history = m_historyStore != nullptr;
+
+    usage.pending = qint64(m_rosterSnapshot.size()) * qint64(sizeof(ChatUser) + 32);
+    foreach (const ChatEvent &event, m_ingestQueue) {
+        usage.pending += eventBytes(event);
+    }
+    foreach (const QString &line, m_pendingLines) {
+        usage.pending += qint64(line.size()) * qint64(sizeof(QChar));
+    }
+    foreach (const HistoryRecord &record, m_historyPending) {
+        usage.pending += qint64(sizeof(HistoryRecord))
+                + qint64(record.text.size() + record.userName.size() + record.userColor.size())
+                  * qint64(sizeof(QChar));
+    }
+
+    return usage;
+}
+
+qint64 Widget::trimMemory(qint64 bytes)
+{
+    // Сколько строк журнала остаётся при любом бюджете
+    static const int MinLogLines = 200;
+
+    // Сначала самые старые строки журнала: сообщения из них
+    // при включённой истории остаются на диске и находятся поиском
+    qint64 freed = m_messageLog->evictBytes(bytes, MinLogLines);
+
+    // Затем свёрстанные строки неактивной вкладки. Кэш видимого журнала
+    // и так ограничен, а его сброс заставил бы заново верстать экран.
+    if (freed < bytes && !isVisible()) {
+        freed += ui->listView_messages->cacheBytes();
+        ui->listView_messages->clearCache();
+    }
+
+    return freed;
+}
+
 void Widget::saveConnectionData()
 {
     QSettings settings(qApp->applicationDirPath() + "/settings.ini",
@@ -109,6 +337,48 @@ void Widget::saveConnectionData()
     settings.setValue("userName", m_connectionData.userName);
     settings.setValue("gender", m_connectionData.gender);
     settings.setValue("userColor", m_connectionData.userColor);
+    settings.setValue("logCapacity", m_messageLog->capacity());
+    settings.setValue("flushInterval", m_flushTimer->interval());
+    settings.setValue("wireFormat", m_wireFormat);
+    settings.setValue("sendHighWaterMark", m_sendHighWaterMark);
+    settings.setValue("endpoints", m_extraEndpoints);
+    settings.setValue("reconnectBaseDelay", m_reconnectBaseDelay);
+    settings.setValue("reconnectMaxDelay", m_reconnectMaxDelay);
+    settings.setValue("historyEnabled", m_historyEnabled);
+    settings.setValue("historyLoadCount", m_historyLoadCount);
+    settings.setValue("historySegmentSize", m_historySegmentSize);
+    settings.setValue("presenceWindow", m_presenceWindow);
+    settings.setValue("highlightAliases", m_highlightAliases);
+    settings.setValue("highlightKeywords", m_highlightKeywords);
+}
+
+void Widget::setPrimary(bool primary)
+{
+    m_primary = primary;
+}
+
+bool Widget::isPrimary() const
+{
+    return m_primary;
+}
+
+AuthDialog::ConnectionData Widget::savedConnectionData()
+{
+    QSettings settings(qApp->applicationDirPath() + "/settings.ini",
+                       QSettings::IniFormat);
+
+    AuthDialog::ConnectionData data;
+    data.server = settings.value("server", "127.0.0.1").toString();
+    data.port = settings.value("port", 27800).toInt();
+    data.userName = settings.value("userName", "Инкогнито").toString();
+    data.gender = settings.value("gender", 0).toInt();
+    data.userColor = settings.value("userColor", "#34495e").toString();
+    return data;
+}
+
+AuthDialog::ConnectionData Widget::connectionData() const
+{
+    return m_connectionData;
 }
 
 void Widget::restoreConnectionData()
@@ -116,11 +386,58 @@ void Widget::restoreConnectionData()
     QSettings settings(qApp->applicationDirPath() + "/settings.ini",
                        QSettings::IniFormat);
 
-    m_connectionData.server = settings.value("server", "127.0.0.1").toString();
-    m_connectionData.port = settings.value("port", 27800).toInt();
-    m_connectionData.userName = settings.value("userName", "Инкогнито").toString();
-    m_connectionData.gender = settings.value("gender", 0).toInt();
-    m_connectionData.userColor = settings.value("userColor", "#34495e").toString();
+    m_connectionData = savedConnectionData();
+
+    // Сколько последних строк хранит журнал сообщений
+    m_messageLog->setCapacity(settings.value("logCapacity", 5000).toInt());
+
+    // Как часто применяем накопленные события к интерфейсу, мс
+    m_flushTimer->setInterval(settings.value("flushInterval", 16).toInt());
+
+    // Формат обмена с сервером: json или cbor
+    m_wireFormat = settings.value("wireFormat", "json").toString();
+
+    // Сколько байт может ждать записи в сокет, прежде чем
+    // сообщения чата начнут копиться в очереди
+    m_sendHighWaterMark = settings.value("sendHighWaterMark", 256 * 1024).toLongLong();
+    QMetaObject::invokeMethod(m_worker, "setSendHighWaterMark",
+                              Qt::QueuedConnection,
+                              Q_ARG(qint64, m_sendHighWaterMark));
+
+    // Запасные адреса сервера в виде host:port
+    m_extraEndpoints = settings.value("endpoints").toStringList();
+
+    // Пауза перед переподключением растёт от базовой до предельной, мс
+    m_reconnectBaseDelay = settings.value("reconnectBaseDelay", 1000).toInt();
+    m_reconnectMaxDelay = settings.value("reconnectMaxDelay", 60 * 1000).toInt();
+    QMetaObject::invokeMethod(m_worker, "setReconnectDelays",
+                              Qt::QueuedConnection,
+                              Q_ARG(int, m_reconnectBaseDelay),
+                              Q_ARG(int, m_reconnectMaxDelay));
+
+    // Локальная история сообщений
+    m_historyEnabled = settings.value("historyEnabled", true).toBool();
+    m_historyLoadCount = settings.value("historyLoadCount", 2000).toInt();
+    m_historySegmentSize = settings.value("historySegmentSize", 4 * 1024 * 1024).toLongLong();
+
+    // Окно, в котором входы и выходы пользователей сворачиваются в одну строку, мс
+    m_presenceWindow = qMax(0, settings.value("presenceWindow", 1000).toInt());
+
+    // Другие имена, на которые мы откликаемся, и слова, при появлении
+    // которых в общем чате нужно привлечь внимание
+    m_highlightAliases = settings.value("highlightAliases").toStringList();
+    m_highlightKeywords = settings.value("highlightKeywords").toStringList();
+    updateHighlightRules();
+}
+
+void Widget::updateHighlightRules()
+{
+    QStringList patterns;
+    if (!m_userName.isEmpty()) {
+        patterns << m_userName;
+    }
+    patterns << m_highlightAliases << m_highlightKeywords;
+    m_highlighter.setPatterns(patterns);
 }
 
 void Widget::connectToServer()
@@ -131,28 +448,123 @@ void Widget::connectToServer()
     int result = authDialog.exec();
 
     if (result == AuthDialog::Accepted) {
-        m_connectionData = authDialog.connectionData();
-
-        QString html = QString("%1 <span style='color:#7f8c8d'>"
-                               "<i>Установка соединения с <b>%2:%3</b>...</span>")
-                .arg(datetime())
-                .arg(m_connectionData.server)
-                .arg(m_connectionData.port);
-        ui->textBrowser->append(html);
+        startConnection(authDialog.connectionData());
+    }
+    else {
+        emit connectionCanceled();
+    }
+}
 
-        m_webSocket->open(QUrl(QString("ws://%1:%2?userName=%3&userColor=%4&gender=%5")
-                               .arg(m_connectionData.server)
-                               .arg(m_connectionData.port)
-                               .arg(m_connectionData.userName)
-                               .arg(QString(m_connectionData.userColor).replace("#","%23"))
-                               .arg(m_connectionData.gender)));
+void Widget::startConnection(const AuthDialog::ConnectionData &data)
+{
+    m_connectionData = data;
+    m_sequence = 0;
+
+    // Рукопожатие идёт в сетевом потоке, пока здесь открывается
+    // история и строится остальной интерфейс. Обработчик быстрого
+    // старта уже открыт тем же адресом до построения окна.
+    if (m_workerOpened) {
+        m_workerOpened = false;
     }
     else {
-        close();
-        qApp->quit();
+        emit openRequested(endpointUrls());
+        Startup::mark("connection started");
+    }
+
+    emit titleChanged(QString("%1:%2").arg(m_connectionData.server).arg(m_connectionData.port));
+
+    QString html = QString("%1 <span style='color:#7f8c8d'>"
+                           "<i>Установка соединения с <b>%2:%3</b>...</span>")
+            .arg(datetime())
+            .arg(MarkupRenderer::escape(m_connectionData.server))
+            .arg(m_connectionData.port);
+    appendHtml(html);
+
+    // Каталог истории без имени зависит от сервера и становится известен
+    // только сейчас. История с именем откроется в первой итерации цикла
+    // событий, уже после показа окна
+    if (m_historyName.isEmpty()) {
+        openHistory();
     }
 }
 
+void Widget::startRecording(const QString &path)
+{
+    emit recordRequested(path);
+
+    QString html = QString("%1 <span style='color:#7f8c8d'>"
+                           "<i>Кадры соединения записываются в <b>%2</b></i></span>")
+            .arg(datetime())
+            .arg(MarkupRenderer::escape(path));
+    appendHtml(html);
+}
+
+void Widget::startReplay(const QString &path, double speed)
+{
+    // Воспроизведение не должно попадать в настоящую историю
+    m_historyEnabled = false;
+    m_sequence = 0;
+
+    emit replayRequested(path, speed);
+    emit titleChanged(QFileInfo(path).fileName());
+
+    QString html = QString("%1 <span style='color:#7f8c8d'>"
+                           "<i>Воспроизведение <b>%2</b>, скорость: %3</i></span>")
+            .arg(datetime())
+            .arg(MarkupRenderer::escape(path))
+            .arg(speed > 0 ? QString("x%1").arg(speed) : QString("без ограничения"));
+    appendHtml(html);
+}
+
+QStringList Widget::endpointUrls() const
+{
+    return endpointUrls(m_connectionData, m_extraEndpoints, m_wireFormat);
+}
+
+QStringList Widget::endpointUrls(const AuthDialog::ConnectionData &data,
+                                 const QStringList &extraEndpoints,
+                                 const QString &wireFormat)
+{
+    // Основной сервер из диалога плюс запасные адреса из настроек.
+    // Сетевой поток подключается ко всем сразу и оставляет самый быстрый.
+    QStringList endpoints;
+    endpoints << QString("%1:%2").arg(data.server).arg(data.port);
+    endpoints << extraEndpoints;
+
+    QStringList urls;
+    foreach (const QString &endpoint, endpoints) {
+        QString url = QString("ws://%1?userName=%2&userColor=%3&gender=%4")
+                .arg(endpoint)
+                .arg(data.userName)
+                .arg(QString(data.userColor).replace("#","%23"))
+                .arg(data.gender);
+
+        // Просим сервер перейти на двоичный формат CBOR.
+        // Старый сервер параметр проигнорирует, и обмен останется в JSON.
+        if (wireFormat == "cbor") {
+            url += "&format=cbor";
+        }
+
+        if (!urls.contains(url)) {
+            urls << url;
+        }
+    }
+
+    return urls;
+}
+
+QStringList Widget::savedEndpointUrls(const AuthDialog::ConnectionData &data)
+{
+    // Те же адреса, что соберёт основная сессия из settings.ini,
+    // но до её создания: быстрый старт открывает по ним соединение
+    QSettings settings(qApp->applicationDirPath() + "/settings.ini",
+                       QSettings::IniFormat);
+
+    return endpointUrls(data,
+                        settings.value("endpoints").toStringList(),
+                        settings.value("wireFormat", "json").toString());
+}
+
 void Widget::closePrivateMessage()
 {
     // "0" указывает на то, что отправляем сообщение в общий чат
@@ -162,21 +574,292 @@ void Widget::closePrivateMessage()
     ui->label_receiver->setText(QString("Отправить в общий чат"));
 }
 
-void Widget::privateWithUserFromItem(QListWidgetItem *item)
+void Widget::privateWithUserFromIndex(const QModelIndex &index)
 {
-    m_toUserId = item->data(UserIdRole).toInt();
+    m_toUserId = index.data(RosterModel::UserIdRole).toInt();
     ui->toolButton_closePrivateMessage->show();
 
-    QString toUserName = item->data(UserNameRole).toInt();
+    QString toUserName = index.data(RosterModel::UserNameRole).toString();
     ui->label_receiver->setText(QString("Отправить пользователю <b>%1</b>")
-                                .arg(toUserName));
+                                .arg(MarkupRenderer::escape(toUserName)));
+}
+
+void Widget::filterUsers(const QString &filter)
+{
+    TRACE_SCOPE("roster filter", "gui");
+
+    // Без фильтра вид показывает сам список, иначе - найденных по индексу имён
+    if (filter.trimmed().isEmpty()) {
+        m_rosterFilter->setFilter(QString());
+        ui->listView_users->setModel(m_roster);
+    }
+    else {
+        m_rosterFilter->setFilter(filter);
+        ui->listView_users->setModel(m_rosterFilter);
+    }
+}
+
+void Widget::appendHtml(const QString &html)
+{
+    // Строка попадёт в журнал при ближайшем сбросе очереди
+    m_pendingLines.append(html);
+    scheduleFlush();
+}
+
+void Widget::scheduleFlush()
+{
+    if (!m_flushTimer->isActive()) {
+        m_flushTimer->start();
+    }
+}
+
+void Widget::flushIngestQueue()
+{
+    TRACE_SCOPE("flush", "gui");
+
+    int coalesced = m_ingestQueue.size();
+
+    // Пока применяем пачку, список пользователей не перерисовывается
+    ui->listView_users->setUpdatesEnabled(false);
+
+    QVector<ChatEvent> events;
+    events.swap(m_ingestQueue);
+    foreach (const ChatEvent &event, events) {
+        dispatchEvent(event);
+    }
+
+    ui->listView_users->setUpdatesEnabled(true);
+
+    // Все строки пачки вставляются в журнал одной операцией
+    if (!m_pendingLines.isEmpty()) {
+        TRACE_SCOPE("log append", "gui");
+        m_messageLog->append(m_pendingLines);
+        emit activity(m_pendingLines.size(), m_pendingHighlight);
+        m_pendingLines.clear();
+        m_pendingHighlight = false;
+    }
+
+    // Самое старое событие пачки ждало дольше всех: его задержка
+    // и есть худший случай для этого кадра
+    if (!events.isEmpty() && events.first().received > 0) {
+        m_deliveryLag.add(ChatEvent::now() - events.first().received);
+    }
+
+    if (!m_historyPending.isEmpty()) {
+        emit historyBatchReady(m_historyPending);
+        m_historyPending.clear();
+    }
+
+    if (coalesced > 0) {
+        m_lastFlushSize = coalesced;
+        m_maxFlushSize = qMax(m_maxFlushSize, coalesced);
+        updateStatus();
+    }
+}
+
+void Widget::onSendQueueChanged(int depth, qint64 bytesInFlight)
+{
+    m_sendQueueDepth = depth;
+    m_bytesInFlight = bytesInFlight;
+    updateStatus();
+}
+
+void Widget::updateStatus()
+{
+    // Неактивные вкладки не перерисовываем, состояние обновится при показе
+    if (!isVisible()) {
+        return;
+    }
+
+    QString status = QString("Событий за кадр: %1 (макс. %2) | "
+                             "Очередь отправки: %3, в пути: %4 Б")
+            .arg(m_lastFlushSize)
+            .arg(m_maxFlushSize)
+            .arg(m_sendQueueDepth)
+            .arg(m_bytesInFlight);
+
+    if (m_rosterSnapshotPos < m_rosterSnapshot.size()) {
+        status += QString(" | Загрузка списка: %1 из %2")
+                .arg(m_rosterSnapshotPos)
+                .arg(m_rosterSnapshot.size());
+    }
+
+    ui->label_status->setText(status);
+}
+
+void Widget::onNetworkRtt(qint64 rtt)
+{
+    m_networkRtt.add(rtt);
+}
+
+void Widget::onPingResponse(qint64 response)
+{
+    m_pingResponse.add(response);
+}
+
+void Widget::updateHealth()
+{
+    if (!isVisible()) {
+        return;
+    }
+
+    QVector<double> points;
+    points << 0.50 << 0.95 << 0.99;
+
+    auto summary = [&points](const QString &title, const LatencyHistogram &histogram) {
+        if (histogram.count() == 0) {
+            return QString("%1: нет данных").arg(title);
+        }
+
+        QVector<qint64> values = histogram.percentiles(points);
+        return QString("%1: %2 / %3 / %4 мс")
+                .arg(title)
+                .arg(values.at(0) / 1000.0, 0, 'f', 1)
+                .arg(values.at(1) / 1000.0, 0, 'f', 1)
+                .arg(values.at(2) / 1000.0, 0, 'f', 1);
+    };
+
+    ui->label_health->setText(QString("p50/p95/p99 | %1 | %2 | %3")
+                              .arg(summary("Сеть", m_networkRtt))
+                              .arg(summary("Ответ на Ping", m_pingResponse))
+                              .arg(summary("Доставка в GUI", m_deliveryLag)));
 }
 
-QString Widget::datetime()
+void Widget::showEvent(QShowEvent *event)
 {
-    QString html = QString("<span style='color:#34495e'><b>[%1]</b></span>")
-            .arg(QDateTime::currentDateTime().toString("dd.MM.yyyy HH:mm:ss"));
-    return html;
+    QWidget::showEvent(event);
+
+    updateStatus();
+    updateHealth();
+}
+
+void Widget::exportHealth()
+{
+    QString fileName = QFileDialog::getSaveFileName(this, "Сохранить замеры задержек",
+                                                    "latency.csv", "CSV (*.csv)");
+    if (fileName.isEmpty()) {
+        return;
+    }
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        QMessageBox::warning(this, "Ошибка", file.errorString());
+        return;
+    }
+
+    QVector<double> points;
+    points << 0.50 << 0.95 << 0.99;
+
+    struct Metric
+    {
+        const char *name;
+        const LatencyHistogram *histogram;
+    };
+
+    const Metric metrics[] = {
+        { "network_rtt", &m_networkRtt },
+        { "ping_response", &m_pingResponse },
+        { "delivery_lag", &m_deliveryLag }
+    };
+
+    // Сначала сводка по окну, затем сами замеры
+    QTextStream out(&file);
+    out << "# metric,samples,total,p50_us,p95_us,p99_us\n";
+    for (const Metric &metric : metrics) {
+        QVector<qint64> values = metric.histogram->percentiles(points);
+        out << "# " << metric.name << ',' << metric.histogram->count()
+            << ',' << metric.histogram->total()
+            << ',' << values.at(0) << ',' << values.at(1) << ',' << values.at(2) << '\n';
+    }
+
+    out << "metric,time,value_us\n";
+    for (const Metric &metric : metrics) {
+        foreach (const LatencyHistogram::Sample &sample, metric.histogram->samples()) {
+            out << metric.name << ','
+                << QDateTime::fromMSecsSinceEpoch(sample.time).toString(Qt::ISODateWithMs) << ','
+                << sample.value << '\n';
+        }
+    }
+}
+
+void Widget::toggleTracing()
+{
+    QString html;
+    if (!Trace::isEnabled()) {
+        Trace::setEnabled(true);
+        html = QString("%1 <span style='color:#7f8c8d'><i>Трассировка включена</i></span>")
+                .arg(datetime());
+    }
+    else {
+        Trace::setEnabled(false);
+        QString fileName = dumpTrace();
+        html = fileName.isEmpty()
+                ? QString("%1 <span style='color:#c0392b'><i>Не удалось сохранить трассировку</i></span>")
+                  .arg(datetime())
+                : QString("%1 <span style='color:#7f8c8d'><i>Трассировка сохранена в <b>%2</b></i></span>")
+                  .arg(datetime())
+                  .arg(MarkupRenderer::escape(fileName));
+    }
+    appendHtml(html);
+}
+
+QString Widget::dumpTrace()
+{
+    QString fileName = QString("%1/trace-%2.json")
+            .arg(qApp->applicationDirPath())
+            .arg(QDateTime::currentDateTime().toString("yyyyMMdd-HHmmss"));
+    return Trace::dump(fileName) ? fileName : QString();
+}
+
+QString Widget::datetime(qint64 time)
+{
+    return m_timestamps.format(time);
+}
+
+// Частые строки журнала собираются по заранее разобранным шаблонам,
+// редкие служебные по-прежнему через arg()
+
+// Имя для ссылки action://putUserName. После процентного кодирования
+// в нём не остаётся символов, опасных для атрибута
+QString Widget::userNameQuery(const QString &userName)
+{
+    return QString::fromLatin1(QUrl::toPercentEncoding(userName));
+}
+
+QString Widget::publicMessageHtml(qint64 time,
+                                  int userId,
+                                  const QString &userName,
+                                  const QString &userColor,
+                                  const QString &text)
+{
+    TRACE_SCOPE("format html", "gui");
+
+    static const MessageTemplate html(QStringLiteral(
+            "%1 <b><a style='color:%2' href='action://putUserName?userName=%6&amp;userId=%5'>%3:</a></b>"
+            " <span style='color:#34495e'>%4</span>"));
+
+    return html.render({ datetime(time), MarkupRenderer::color(userColor),
+                         MarkupRenderer::escape(userName), MarkupRenderer::render(text),
+                         QString::number(userId), userNameQuery(userName) });
+}
+
+QString Widget::privateMessageHtml(qint64 time,
+                                   int userId,
+                                   const QString &userName,
+                                   const QString &userColor,
+                                   const QString &text,
+                                   bool outgoing)
+{
+    TRACE_SCOPE("format html", "gui");
+
+    static const MessageTemplate html(QStringLiteral(
+            "%1 <b>%7</b> <b><a style='color:%2' href='action://putUserName?userName=%6&amp;userId=%5'>%3:</a></b>"
+            " <span style='color:#34495e'>%4</span>"));
+
+    return html.render({ datetime(time), MarkupRenderer::color(userColor),
+                         MarkupRenderer::escape(userName), MarkupRenderer::render(text),
+                         QString::number(userId), userNameQuery(userName),
+                         outgoing ? QStringView(u"&lt;") : QStringView(u"&gt;") });
 }
 
 void Widget::onUserAuthorized(int userId,
@@ -187,12 +870,13 @@ void Widget::onUserAuthorized(int userId,
     m_userId = userId;
     m_userName = userName;
     m_gender = gender;
+    updateHighlightRules();
 
     QString html = QString("%1 <span style='color:#7f8c8d'>"
                            "<i>Вы авторизованы с именем <b>%2</b></span>")
             .arg(datetime())
-            .arg(userName);
-    ui->textBrowser->append(html);
+            .arg(MarkupRenderer::escape(userName));
+    appendHtml(html);
 }
 
 void Widget::onUserConnected(int userId,
@@ -204,16 +888,15 @@ void Widget::onUserConnected(int userId,
     addUser(userId, userName, gender, userColor);
 
     // Добавляем сообщение о входе
-    QString html = QString("%1 <span style='color:#7f8c8d'>"
-                           "<i><b><a style='color:%2' href='action://putUserName?userName=%3&userId=%5'>%3</a></b>"
-                           " %4 в чат</i></span>")
-            .arg(datetime())
-            .arg(userColor)
-            .arg(userName)
-            .arg(gender == 2 ? "вошла" : "вошёл")
-            .arg(userId);
-
-    ui->textBrowser->append(html);
+    static const MessageTemplate html(QStringLiteral(
+            "%1 <span style='color:#7f8c8d'>"
+            "<i><b><a style='color:%2' href='action://putUserName?userName=%6&amp;userId=%5'>%3</a></b>"
+            " %4 в чат</i></span>"));
+    static const QString entered[] = { QStringLiteral("вошёл"), QStringLiteral("вошла") };
+
+    appendHtml(html.render({ datetime(), MarkupRenderer::color(userColor),
+                             MarkupRenderer::escape(userName), entered[gender == 2],
+                             QString::number(userId), userNameQuery(userName) }));
 }
 
 void Widget::addUser(int userId,
@@ -221,33 +904,30 @@ void Widget::addUser(int userId,
                      Widget::Gender gender,
                      const QString &userColor)
 {
-    QListWidgetItem *item = new QListWidgetItem;
-    item->setData(UserIdRole, userId);
-    item->setData(UserNameRole, userName);
-    item->setData(GenderRole, gender);
-    item->setData(UserColorRole, userColor);
-    item->setData(Qt::TextColorRole, QColor(userColor));
-    item->setText(userName);
-    item->setIcon(QIcon(QString(":/icons/gender-%1.png").arg(gender)));
+    ChatUser user;
+    user.userId = userId;
+    user.userName = userName;
+    user.gender = gender;
+    user.userColor = userColor;
 
-    ui->listWidget_users->addItem(item);
+    m_roster->addUser(user);
 }
 
-void Widget::addUsers(const QJsonArray &users)
+void Widget::addUsers(const QVector<ChatUser> &users)
 {
-    foreach (QJsonValue v, users) {
-        QJsonObject user = v.toObject();
-        int userId = user.value("userId").toInt();
-        QString userName = user.value("userName").toString();
-        Gender gender = Gender(user.value("gender").toInt());
-        QString userColor = user.value("userColor").toString();
+    QVector<ChatUser> others;
+    others.reserve(users.size());
 
-        if (userId == m_userId) {
+    foreach (const ChatUser &user, users) {
+        if (user.userId == m_userId) {
             continue;
         }
 
-        addUser(userId, userName, gender, userColor);
+        others.append(user);
     }
+
+    // Весь список добавляется в модель одной вставкой
+    m_roster->addUsers(others);
 }
 
 void Widget::onUserDisconnected(int userId, const QString &userName, Widget::Gender gender, const QString &userColor)
@@ -256,27 +936,177 @@ void Widget::onUserDisconnected(int userId, const QString &userName, Widget::Gen
     removeUser(userId);
 
     // Добавляем сообщение о выходе
-    QString html = QString("%1 <span style='color:#7f8c8d'>"
-                           "<i><b><a style='color:%2' href='action://putUserName?userName=%3&userId=%5'>%3</a></b>"
-                           " %4 из чата</i></span>")
-            .arg(datetime())
-            .arg(userColor)
-            .arg(userName)
-            .arg(gender == 2 ? "вышла" : "вышел")
-            .arg(userId);
+    static const MessageTemplate html(QStringLiteral(
+            "%1 <span style='color:#7f8c8d'>"
+            "<i><b><a style='color:%2' href='action://putUserName?userName=%6&amp;userId=%5'>%3</a></b>"
+            " %4 из чата</i></span>"));
+    static const QString left[] = { QStringLiteral("вышел"), QStringLiteral("вышла") };
+
+    appendHtml(html.render({ datetime(), MarkupRenderer::color(userColor),
+                             MarkupRenderer::escape(userName), left[gender == 2],
+                             QString::number(userId), userNameQuery(userName) }));
+}
+
+void Widget::startRosterSnapshot(const QVector<ChatUser> &users)
+{
+    cancelRosterSnapshot();
+
+    m_rosterSnapshot = users;
+    m_rosterSnapshotTime.start();
+
+    // Первая порция вставляется сразу, и часть списка
+    // появляется уже в этом кадре
+    ingestRosterSlice();
+}
 
-    ui->textBrowser->append(html);
+void Widget::cancelRosterSnapshot()
+{
+    m_rosterTimer->stop();
+    m_rosterSnapshot.clear();
+    m_rosterSnapshotPos = 0;
+    m_rosterSnapshotRemoved.clear();
+}
+
+void Widget::ingestRosterSlice()
+{
+    TRACE_SCOPE("roster slice", "gui");
+
+    // Вставляем порции, пока не израсходован бюджет этой итерации
+    // цикла событий; остальное - в следующих итерациях
+    static const int RosterSliceSize = 500;
+    static const qint64 RosterSliceBudget = 4; // мс
+
+    QElapsedTimer budget;
+    budget.start();
+
+    int total = m_rosterSnapshot.size();
+    while (m_rosterSnapshotPos < total && budget.elapsed() < RosterSliceBudget) {
+        int end = qMin(m_rosterSnapshotPos + RosterSliceSize, total);
+
+        QVector<ChatUser> slice;
+        slice.reserve(end - m_rosterSnapshotPos);
+        for (int i = m_rosterSnapshotPos; i < end; i++) {
+            const ChatUser &user = m_rosterSnapshot.at(i);
+            if (!m_rosterSnapshotRemoved.contains(user.userId)) {
+                slice.append(user);
+            }
+        }
+
+        m_rosterSnapshotPos = end;
+        addUsers(slice);
+    }
+
+    if (m_rosterSnapshotPos < total) {
+        if (!m_rosterTimer->isActive()) {
+            m_rosterTimer->start();
+        }
+        updateStatus();
+        return;
+    }
+
+    // О загрузке сообщаем, только если она заметно растянулась
+    if (m_rosterTimer->isActive()) {
+        QString html = QString("%1 <span style='color:#7f8c8d'>"
+                               "<i>Список пользователей загружен: %2 за %3 мс</i></span>")
+                .arg(datetime())
+                .arg(m_roster->rowCount())
+                .arg(m_rosterSnapshotTime.elapsed());
+        appendHtml(html);
+    }
+
+    cancelRosterSnapshot();
+    updateStatus();
 }
 
 void Widget::removeUser(int userId)
 {
-    for (int i = 0; i < ui->listWidget_users->count(); i++) {
-        QListWidgetItem *item = ui->listWidget_users->item(i);
-        if (item->data(UserIdRole).toInt() == userId) {
-            delete item;
-            break;
+    // Пользователь из ещё не вставленной части снимка
+    // не должен появиться в списке после выхода
+    if (!m_roster->removeUser(userId) && m_rosterSnapshotPos < m_rosterSnapshot.size()) {
+        m_rosterSnapshotRemoved.insert(userId);
+    }
+}
+
+void Widget::removeUsers(const QVector<int> &userIds)
+{
+    if (m_rosterSnapshotPos < m_rosterSnapshot.size()) {
+        foreach (int userId, userIds) {
+            if (!m_roster->contains(userId)) {
+                m_rosterSnapshotRemoved.insert(userId);
+            }
         }
     }
+
+    m_roster->removeUsers(userIds);
+}
+
+void Widget::onPresence(const ChatEvent &event)
+{
+    // Окно скользит: событие после затишья показывается сразу, как раньше,
+    // а всё, что пришло вслед за ним, копится до конца окна
+    bool quiet = !m_presenceTime.isValid() || m_presenceTime.elapsed() >= m_presenceWindow;
+    m_presenceTime.start();
+
+    if (m_presenceWindow <= 0 || (quiet && m_presence.isEmpty())) {
+        applyPresence(event);
+        return;
+    }
+
+    m_presence.add(event);
+    if (!m_presenceTimer->isActive()) {
+        m_presenceTimer->start(m_presenceWindow);
+    }
+}
+
+void Widget::applyPresence(const ChatEvent &event)
+{
+    switch (event.type) {
+    case ChatEvent::Connected:
+        onUserConnected(event.userId, event.userName,
+                        Gender(event.gender), event.userColor);
+        break;
+    case ChatEvent::Disconnected:
+        onUserDisconnected(event.userId, event.userName,
+                           Gender(event.gender), event.userColor);
+        break;
+    case ChatEvent::ConnectionLost:
+        onConnectionLost(event.userId, event.userName,
+                         Gender(event.gender), event.userColor);
+        break;
+    default:
+        break;
+    }
+}
+
+void Widget::flushPresence()
+{
+    TRACE_SCOPE("presence", "gui");
+
+    m_presenceTimer->stop();
+    if (m_presence.isEmpty()) {
+        return;
+    }
+
+    if (m_presence.count() == 1) {
+        ChatEvent event = m_presence.first();
+        m_presence.clear();
+        applyPresence(event);
+        return;
+    }
+
+    // Сначала выходы: вышедший и снова вошедший пользователь остаётся в списке
+    ui->listView_users->setUpdatesEnabled(false);
+    removeUsers(m_presence.leaves());
+    addUsers(m_presence.joins());
+    ui->listView_users->setUpdatesEnabled(true);
+
+    QString html = QString("%1 <span style='color:#7f8c8d'><i>%2</i></span>")
+            .arg(datetime())
+            .arg(m_presence.summary());
+    appendHtml(html);
+
+    m_presence.clear();
+    updateStatus();
 }
 
 void Widget::onConnectionLost(int userId,
@@ -290,14 +1120,13 @@ void Widget::onConnectionLost(int userId,
     removeUser(userId);
 
     // Добавляем сообщение
-    QString html = QString("%1 <span style='color:#7f8c8d'>"
-                           "<i>Соединение с <b style='color:%2'>%3</b>"
-                           " потеряно</i></span>")
-            .arg(datetime())
-            .arg(userColor)
-            .arg(userName);
+    static const MessageTemplate html(QStringLiteral(
+            "%1 <span style='color:#7f8c8d'>"
+            "<i>Соединение с <b style='color:%2'>%3</b>"
+            " потеряно</i></span>"));
 
-    ui->textBrowser->append(html);
+    appendHtml(html.render({ datetime(), MarkupRenderer::color(userColor),
+                             MarkupRenderer::escape(userName) }));
 }
 
 void Widget::onPublicMessage(int userId,
@@ -305,20 +1134,18 @@ void Widget::onPublicMessage(int userId,
                              const QString &userColor,
                              const QString &text)
 {
-    if (text.contains("<b>" + m_userName + "</b>")) {
+    m_messageShown = true;
+
+    if (m_highlighter.matches(text)) {
+        m_pendingHighlight = true;
         qApp->beep();
         qApp->alert(this);
     }
 
-    QString html = QString("%1 <b><a style='color:%2' href='action://putUserName?userName=%3&userId=%5'>%3:</a></b>"
-                           " <span style='color:#34495e'>%4</span>")
-            .arg(datetime())
-            .arg(userColor)
-            .arg(userName)
-            .arg(text)
-            .arg(userId);
-
-    ui->textBrowser->append(html);
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    appendHtml(publicMessageHtml(now, userId, userName, userColor, text));
+    recordHistory(now, HistoryRecord::PublicMessage, 0,
+                  userId, userName, userColor, text);
 }
 
 void Widget::onPrivateMessage(int userId,
@@ -326,61 +1153,253 @@ void Widget::onPrivateMessage(int userId,
                               const QString &userColor,
                               const QString &text)
 {
+    m_pendingHighlight = true;
+    m_messageShown = true;
     qApp->beep();
     qApp->alert(this);
 
-    QString html = QString("%1 <b>%6</b> <b><a style='color:%2' href='action://putUserName?userName=%3&userId=%5'>%3:</a></b>"
-                           " <span style='color:#34495e'>%4</span>")
-            .arg(datetime())
-            .arg(userColor)
-            .arg(userName)
-            .arg(text)
-            .arg(userId)
-            .arg(userId == m_userId ? "&lt;" : "&gt;");
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    bool outgoing = userId == m_userId;
+    appendHtml(privateMessageHtml(now, userId, userName, userColor, text, outgoing));
+    recordHistory(now, HistoryRecord::PrivateMessage,
+                  outgoing ? HistoryRecord::Outgoing : 0,
+                  userId, userName, userColor, text);
+}
 
-    ui->textBrowser->append(html);
+void Widget::recordHistory(qint64 time,
+                           int type,
+                           int flags,
+                           int userId,
+                           const QString &userName,
+                           const QString &userColor,
+                           const QString &text)
+{
+    if (!m_historyStore) {
+        return;
+    }
+
+    HistoryRecord record;
+    record.timestamp = time;
+    record.type = quint8(type);
+    record.flags = quint8(flags);
+    record.userId = userId;
+    record.gender = 0;
+    record.userName = userName;
+    record.userColor = userColor;
+    record.text = text;
+
+    // Записи уходят в поток истории пачкой при сбросе очереди
+    m_historyPending.append(record);
 }
 
-void Widget::onConnected()
+void Widget::openHistory()
 {
-    m_pingTimer->start(15 * 1000); // пингуем сервер каждые 15 сек
+    if (!m_historyEnabled || m_historyStore) {
+        return;
+    }
 
-    QString html = QString("%1 <span style='color:#16a085'><i>Соединение установлено!</i></span>")
-            .arg(datetime());
-    ui->textBrowser->append(html);
-    ui->lineEdit_message->setEnabled(true);
-    saveConnectionData();
+    // Последние сообщения показываем сразу,
+    // а новые дописываются в потоке истории
+    m_historyPath = HistoryStore::claimPath(historyPath());
+    loadHistory(m_historyLoadCount);
+
+    qRegisterMetaType<QVector<HistoryRecord> >("QVector<HistoryRecord>");
+
+    m_historyStore = new HistoryStore(m_historyPath, m_historySegmentSize);
+    m_historyStore->moveToThread(m_historyThread);
+    connect(this, &Widget::historyBatchReady,
+            m_historyStore, &HistoryStore::append);
+    connect(m_historyStore, &HistoryStore::searchFinished,
+            this, &Widget::onSearchFinished);
+
+    ui->toolButton_search->setEnabled(true);
 }
 
-void Widget::onDisconnected()
+void Widget::loadHistory(int count)
 {
-    m_pingTimer->stop();
-    ui->listWidget_users->clear();
+    QVector<HistoryRecord> records = HistoryReader(m_historyPath).recent(count);
+    if (records.isEmpty()) {
+        return;
+    }
+
+    QStringList lines = historyHtml(records);
+    lines << QString("<span style='color:#7f8c8d'><i>&mdash; конец истории &mdash;</i></span>");
+    m_messageLog->append(lines);
+}
 
+QStringList Widget::historyHtml(const QVector<HistoryRecord> &records)
+{
+    QStringList lines;
+    lines.reserve(records.size() + 1);
+
+    foreach (const HistoryRecord &record, records) {
+        if (record.type == HistoryRecord::PrivateMessage) {
+            lines << privateMessageHtml(record.timestamp, record.userId, record.userName,
+                                        record.userColor, record.text,
+                                        record.flags & HistoryRecord::Outgoing);
+        }
+        else {
+            lines << publicMessageHtml(record.timestamp, record.userId, record.userName,
+                                       record.userColor, record.text);
+        }
+    }
+
+    return lines;
+}
+
+QString Widget::historyPath() const
+{
+    QString name = m_historyName;
+    if (name.isEmpty()) {
+        name = QString("history-%1-%2").arg(m_connectionData.server).arg(m_connectionData.port);
+        for (int i = 0; i < name.size(); i++) {
+            QChar c = name.at(i);
+            if (!c.isLetterOrNumber() && c != '-' && c != '.') {
+                name[i] = '_';
+            }
+        }
+    }
+
+    return qApp->applicationDirPath() + "/" + name;
+}
+
+void Widget::openSearch()
+{
+    if (!m_historyStore) {
+        return;
+    }
+
+    if (!m_searchDialog) {
+        m_searchDialog = new SearchDialog(this);
+        connect(m_searchDialog, &SearchDialog::searchRequested,
+                m_historyStore, &HistoryStore::search);
+    }
+
+    m_searchDialog->show();
+    m_searchDialog->raise();
+    m_searchDialog->activateWindow();
+}
+
+void Widget::onSearchFinished(const QString &query,
+                              const QVector<HistoryRecord> &records,
+                              qint64 elapsed)
+{
+    if (m_searchDialog) {
+        m_searchDialog->setResults(query, historyHtml(records), elapsed);
+    }
+}
+
+void Widget::onConnected(const QString &url)
+{
+    m_connectedUrl = url;
+    Startup::mark("connected");
+
+    emit titleChanged(QUrl(url).authority());
+
+    QString html = QString("%1 <span style='color:#16a085'><i>Соединение с <b>%2</b> установлено!</i></span>")
+            .arg(datetime())
+            .arg(QUrl(url).authority());
+    appendHtml(html);
+
+    // Дополнительные вкладки не подменяют сервер основной сессии:
+    // при следующем запуске она подключилась бы не туда, а её история
+    // смешала бы журналы двух серверов
+    if (m_primary) {
+        saveConnectionData();
+    }
+}
+
+void Widget::onAnnounced(bool online, const QString &url)
+{
+    // Сигнал connected мог уйти до того, как сессия к нему подключилась;
+    // если же он дошёл, повторно о соединении не сообщаем
+    if (online && m_connectedUrl.isEmpty()) {
+        onConnected(url);
+    }
+}
+
+void Widget::onDisconnected()
+{
+    // Список пользователей остаётся: после переподключения сервер
+    // пришлёт только изменения с последнего полученного события
+    m_connectedUrl.clear();
     QString html = QString("%1 <span style='color:#c0392b'><i>Соединение разорвано.</i></span>")
             .arg(datetime());
-    ui->textBrowser->append(html);
-    ui->lineEdit_message->setEnabled(false);
+    appendHtml(html);
+}
 
-    // Через пять сек мы снова пытаемся соединиться с сервером
-    QTimer::singleShot(5000, this, &Widget::connectToServer);
+void Widget::onReconnectScheduled(int delay, int attempt)
+{
+    QString html = QString("%1 <span style='color:#7f8c8d'>"
+                           "<i>Повторное подключение через %2 с (попытка %3)...</i></span>")
+            .arg(datetime())
+            .arg(delay / 1000.0, 0, 'f', 1)
+            .arg(attempt);
+    appendHtml(html);
 }
 
-void Widget::onError(QAbstractSocket::SocketError error)
+void Widget::onReconnected(qint64 elapsed)
 {
-    m_pingTimer->stop();
-    ui->listWidget_users->clear();
+    QString html = QString("%1 <span style='color:#16a085'>"
+                           "<i>Соединение восстановлено за %2 мс</i></span>")
+            .arg(datetime())
+            .arg(elapsed);
+    appendHtml(html);
+}
 
+void Widget::onError(int error, const QString &errorString)
+{
     QString html = QString("%1 <span style='color:#c0392b'>Ошибка сокета №%2: %3</span>")
             .arg(datetime())
             .arg(error)
-            .arg(m_webSocket->errorString());
-    ui->textBrowser->append(html);
-    ui->lineEdit_message->setEnabled(false);
+            .arg(MarkupRenderer::escape(errorString));
+    appendHtml(html);
+}
+
+void Widget::onCaptureFailed(const QString &errorString)
+{
+    QString html = QString("%1 <span style='color:#c0392b'>Запись кадров: %2</span>")
+            .arg(datetime())
+            .arg(MarkupRenderer::escape(errorString));
+    appendHtml(html);
+}
+
+void Widget::onReplayFinished(qint64 frames, qint64 elapsed)
+{
+    // Сетевой поток отдал всё; применяем остаток сразу, не дожидаясь кадра,
+    // чтобы в замер попала и последняя пачка
+    onEventsAvailable();
+    flushIngestQueue();
+    flushPresence();
+    flushIngestQueue();
+
+    double rate = elapsed > 0 ? frames * 1000.0 / elapsed : 0;
+    QVector<qint64> lag = m_deliveryLag.percentiles(QVector<double>() << 0.5 << 0.99);
+
+    qInfo().noquote() << QString("replay: %1 frames in %2 ms (%3 frames/s), "
+                                 "delivery lag p50 %4 us p99 %5 us, max flush %6 events")
+                         .arg(frames)
+                         .arg(elapsed)
+                         .arg(rate, 0, 'f', 0)
+                         .arg(lag.at(0))
+                         .arg(lag.at(1))
+                         .arg(m_maxFlushSize);
+
+    QString html = QString("%1 <span style='color:#16a085'>"
+                           "<i>Воспроизведение завершено: %2 кадров за %3 мс (%4 кадров/с)</i></span>")
+            .arg(datetime())
+            .arg(frames)
+            .arg(elapsed)
+            .arg(rate, 0, 'f', 0);
+    appendHtml(html);
+
+    emit replayCompleted();
 }
 
 void Widget::onReturnPressed()
 {
+    TRACE_SCOPE("send", "gui");
+
     // Достаём сообщение из поля ввода, удалив лишние пробелы
     QString text = ui->lineEdit_message->text().trimmed();
 
@@ -392,95 +1411,139 @@ void Widget::onReturnPressed()
         return;
     }
 
-    // Собираем данные сообщения
-    QJsonObject messageData;
-    messageData.insert("toUserId", m_toUserId);
-    messageData.insert("text", text);
+    // Отправляем сообщение через сетевой поток,
+    // он же упакует его в формат текущего соединения
+    emit sendRequested(m_toUserId, text);
+}
 
-    // Преобразуем JSON-объект в строку
-    QByteArray message = QJsonDocument(messageData).toJson(QJsonDocument::Compact);
+void Widget::onLogPainted()
+{
+    if (!m_messageShown) {
+        return;
+    }
 
-    // Отправляем данные
-    m_webSocket->sendTextMessage(message);
+    Startup::mark("first message rendered");
+    disconnect(ui->listView_messages, &MessageLogView::painted,
+               this, &Widget::onLogPainted);
 }
 
 void Widget::onAnchorClicked(const QUrl &url)
 {
+    // Обычные ссылки из сообщений открываем в браузере
+    if (url.scheme() != "action") {
+        QDesktopServices::openUrl(url);
+        return;
+    }
+
     // При клике на имя пользователя, вставляем его в поле ввода сообщения
     QUrlQuery query(url);
+    QString userName = query.queryItemValue("userName", QUrl::FullyDecoded);
 
     QString text = ui->lineEdit_message->text();
     if (text.isEmpty()) {
-        text = "{" + query.queryItemValue("userName") + "}, ";
+        text = "{" + userName + "}, ";
     }
     else if (text.endsWith(' ')) {
-        text += "{" + query.queryItemValue("userName") + "} ";
+        text += "{" + userName + "} ";
     }
     else {
-        text += " {" + query.queryItemValue("userName") + "} ";
+        text += " {" + userName + "} ";
     }
 
     ui->lineEdit_message->setText(text);
     ui->lineEdit_message->setFocus();
 }
 
-void Widget::sendPong()
+void Widget::onEventsAvailable()
 {
-    QJsonObject messageData;
-    messageData.insert("action", "Pong");
-    QByteArray message = QJsonDocument(messageData).toJson(QJsonDocument::Compact);
-    m_webSocket->sendTextMessage(message);
+    // Сначала снимаем отметку, чтобы не потерять события,
+    // пришедшие во время вычитывания очереди
+    m_worker->acknowledgeEvents();
+
+    ChatEvent event;
+    while (m_events->pop(event)) {
+        m_ingestQueue.append(event);
+    }
+
+    scheduleFlush();
 }
 
-void Widget::onTextMessageReceived(const QString &message)
+void Widget::dispatchEvent(const ChatEvent &event)
 {
-    // Преобразуем полученное сообщение в JSON-объект
-    QJsonObject messageData = QJsonDocument::fromJson(message.toUtf8()).object();
+    TRACE_SCOPE_ID("dispatch", "gui", event.traceId);
+    TRACE_FLOW_END("event", event.traceId);
 
-    QString action = messageData.value("action").toString();
+    EventHandler handler = eventHandlers[event.type];
+    if (handler) {
+        (this->*handler)(event);
+    }
 
-    if (action == "Ping") {
-        // В ответ на "Ping" клиент должен послать действие "Pong",
-        // чтобы сервер понял, что клиент в онлайне
-        sendPong();
+    // Номер из Resynced ещё не доставлен: его события идут следом
+    if (event.type != ChatEvent::Resynced) {
+        m_sequence = qMax(m_sequence, event.sequence);
     }
-    else {
-        int userId = messageData.value("userId").toInt();
-        QString userName = messageData.value("userName").toString();
-        Gender gender = Gender(messageData.value("gender").toInt());
-        QString userColor = messageData.value("userColor").toString();
-
-        if (action == "Authorized") {
-            onUserAuthorized(userId, userName, gender);
-            QJsonArray users = messageData.value("users").toArray();
-            addUsers(users);
-        }
+}
 
-        else if (action == "Connected") {
-            onUserConnected(userId, userName, gender, userColor);
-        }
+void Widget::handleAuthorized(const ChatEvent &event)
+{
+    Startup::mark("authorized");
 
-        else if (action == "Disconnected") {
-            onUserDisconnected(userId, userName, gender, userColor);
-        }
+    // Сервер не смог продолжить с нашего номера события (или это первое
+    // подключение) и прислал всё заново: старый список заменяется целиком
+    if (m_sequence != 0) {
+        QString html = QString("%1 <span style='color:#7f8c8d'>"
+                               "<i>Пропущенные события недоступны, список пользователей загружается заново</i></span>")
+                .arg(datetime());
+        appendHtml(html);
+    }
+    m_sequence = event.sequence;
 
-        else if (action == "ConnectionLost") {
-            onConnectionLost(userId, userName, gender, userColor);
-        }
+    // Накопленные входы и выходы были до снимка: показываем их итог,
+    // а список всё равно заменяется снимком
+    flushPresence();
 
-        else if (action == "PublicMessage") {
-            QString text = messageData.value("text").toString();
-            onPublicMessage(userId, userName, userColor, text);
-        }
+    onUserAuthorized(event.userId, event.userName, Gender(event.gender));
+    m_roster->clear();
+    startRosterSnapshot(event.users);
+}
 
-        else if (action == "PrivateMessage") {
-            QString text = messageData.value("text").toString();
-            onPrivateMessage(userId, userName, userColor, text);
-        }
+void Widget::handleConnected(const ChatEvent &event)
+{
+    onPresence(event);
+}
 
-        else {
-            // неизвестное действие
-            qWarning() << "unknown action: " << action;
-        }
-    }
+void Widget::handleDisconnected(const ChatEvent &event)
+{
+    onPresence(event);
+}
+
+void Widget::handleConnectionLost(const ChatEvent &event)
+{
+    onPresence(event);
+}
+
+void Widget::handlePublicMessage(const ChatEvent &event)
+{
+    onPublicMessage(event.userId, event.userName, event.userColor, event.text);
+}
+
+void Widget::handlePrivateMessage(const ChatEvent &event)
+{
+    onPrivateMessage(event.userId, event.userName, event.userColor, event.text);
+}
+
+void Widget::handleResynced(const ChatEvent &event)
+{
+    // Сервер продолжает с нашего номера: список пользователей и журнал
+    // остаются, а пропущенные события придут следом обычными кадрами
+    m_userId = event.userId;
+    m_userName = event.userName;
+    m_gender = Gender(event.gender);
+    updateHighlightRules();
+
+    QString html = QString("%1 <span style='color:#7f8c8d'>"
+                           "<i>Состояние восстановлено, пропущено событий: %2</i></span>")
+            .arg(datetime())
+            .arg(event.sequence > m_sequence ? event.sequence - m_sequence : 0);
+    appendHtml(html);
 }
@@ -29,31 +29,80 @@
 #define WIDGET_H
 
 #include <QWidget>
-#include <QWebSocket>
-#include <QListWidget>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QModelIndex>
+#include <QSet>
+#include <QStringList>
+#include <QUrl>
 #include "authdialog.h"
+#include "chatevent.h"
+#include "highlightmatcher.h"
+#include "historystore.h"
+#include "latencyhistogram.h"
+#include "messagetemplate.h"
+#include "presenceaggregator.h"
+#include "spscqueue.h"
 
 namespace Ui {
 class Widget;
 }
 
+class MessageLogModel;
+class RosterModel;
+class RosterFilterModel;
+class SearchDialog;
+class ConnectionWorker;
+class QThread;
+class QTimer;
+
+// Одна сессия чата: соединение с сервером, журнал и список пользователей.
+// Сессии живут во вкладках SessionWindow и делят с другими сетевой поток
+// и поток истории.
 class Widget : public QWidget
 {
     Q_OBJECT
 
 public:
-    explicit Widget(QWidget *parent = nullptr);
+    // historyName - каталог истории рядом с программой; пустое имя означает
+    // каталог по адресу сервера, выбранного при подключении. Каталог,
+    // занятый другой сессией, получает номер: history-<сервер>-<порт>-2.
+    // worker - уже открывающее соединение обработчик в сетевом потоке
+    // (быстрый старт); без него сессия создаёт свой.
+    explicit Widget(QThread *networkThread,
+                    QThread *historyThread,
+                    const QString &historyName = QString(),
+                    ConnectionWorker *worker = nullptr,
+                    QWidget *parent = nullptr);
     ~Widget();
 
+    // Память, которую держит сессия, байт (оценка)
+    struct MemoryUsage
+    {
+        qint64 log; // строки журнала
+        qint64 roster; // список пользователей с индексом имён
+        qint64 cache; // свёрстанные строки журнала
+        qint64 pending; // события, строки и записи истории до ближайшего сброса
+        int lines; // строк в журнале
+        quint64 evicted; // строк вытеснено из журнала
+        bool history; // вытесненные сообщения остаются в истории
+    };
+
+    MemoryUsage memoryUsage() const;
+
+    // Освобождает не меньше bytes байт, если это возможно, и возвращает освобождённое
+    qint64 trimMemory(qint64 bytes);
+
+    // Основная сессия: только она сохраняет свой сервер в settings.ini
+    // и пишет историю в общий каталог, с которым этот сервер связан
+    void setPrimary(bool primary);
+    bool isPrimary() const;
+
+    static AuthDialog::ConnectionData savedConnectionData();
+    AuthDialog::ConnectionData connectionData() const;
     void restoreConnectionData();
     void saveConnectionData();
-
-    enum ItemRole {
-        UserIdRole,
-        UserNameRole,
-        GenderRole,
-        UserColorRole
-    };
+    void updateHighlightRules();
 
     enum Gender {
         Unknown,
@@ -62,10 +111,49 @@ public:
     };
 
     void connectToServer();
+    void startConnection(const AuthDialog::ConnectionData &data);
+
+    // Запись кадров соединения в файл и воспроизведение записи вместо сети.
+    // speed - во сколько раз быстрее записи, 0 - без ограничения.
+    void startRecording(const QString &path);
+    void startReplay(const QString &path, double speed);
+    QStringList endpointUrls() const;
+    static QStringList endpointUrls(const AuthDialog::ConnectionData &data,
+                                    const QStringList &extraEndpoints,
+                                    const QString &wireFormat);
+    static QStringList savedEndpointUrls(const AuthDialog::ConnectionData &data);
     void closePrivateMessage();
-    void privateWithUserFromItem(QListWidgetItem *item);
+    void privateWithUserFromIndex(const QModelIndex &index);
+    void filterUsers(const QString &filter);
+
+    void appendHtml(const QString &html);
+    void scheduleFlush();
+    void dispatchEvent(const ChatEvent &event);
+    QString datetime(qint64 time = QDateTime::currentMSecsSinceEpoch());
+    static QString userNameQuery(const QString &userName);
+    QString publicMessageHtml(qint64 time,
+                              int userId,
+                              const QString &userName,
+                              const QString &userColor,
+                              const QString &text);
+    QString privateMessageHtml(qint64 time,
+                               int userId,
+                               const QString &userName,
+                               const QString &userColor,
+                               const QString &text,
+                               bool outgoing);
 
-    QString datetime();
+    void recordHistory(qint64 time,
+                       int type,
+                       int flags,
+                       int userId,
+                       const QString &userName,
+                       const QString &userColor,
+                       const QString &text);
+    void openHistory();
+    void loadHistory(int count);
+    QStringList historyHtml(const QVector<HistoryRecord> &records);
+    QString historyPath() const;
 
     void onUserAuthorized(int userId,
                           const QString &userName,
@@ -79,13 +167,18 @@ public:
                  const QString &userName,
                  Gender gender,
                  const QString &userColor);
-    void addUsers(const QJsonArray &users);
+    void addUsers(const QVector<ChatUser> &users);
+    void startRosterSnapshot(const QVector<ChatUser> &users);
+    void cancelRosterSnapshot();
 
     void onUserDisconnected(int userId,
                             const QString &userName,
                             Gender gender,
                             const QString &userColor);
     void removeUser(int userId);
+    void removeUsers(const QVector<int> &userIds);
+    void onPresence(const ChatEvent &event);
+    void applyPresence(const ChatEvent &event);
 
     void onConnectionLost(int userId,
                           const QString &userName,
@@ -102,21 +195,129 @@ public:
                           const QString &userColor,
                           const QString &text);
 
+signals:
+    void titleChanged(const QString &title);
+    void activity(int lines, bool highlighted); // строки, добавленные в журнал
+    void connectionCanceled();
+    void openRequested(const QStringList &urls);
+    void recordRequested(const QString &path);
+    void replayRequested(const QString &path, double speed);
+    void replayCompleted();
+    void sendRequested(int toUserId, const QString &text);
+    void historyBatchReady(const QVector<HistoryRecord> &records);
+
 public slots:
-    void onConnected();
+    void onConnected(const QString &url);
+    void onAnnounced(bool online, const QString &url);
     void onDisconnected();
-    void onError(QAbstractSocket::SocketError error);
+    void onReconnectScheduled(int delay, int attempt);
+    void onReconnected(qint64 elapsed);
+    void onError(int error, const QString &errorString);
+    void onCaptureFailed(const QString &errorString);
+    void onReplayFinished(qint64 frames, qint64 elapsed);
     void onReturnPressed();
     void onAnchorClicked(const QUrl &url);
-    void sendPong();
-    void onTextMessageReceived(const QString &message);
+    void onLogPainted();
+    void onEventsAvailable();
+    void flushIngestQueue();
+    void ingestRosterSlice();
+    void flushPresence();
+    void onSendQueueChanged(int depth, qint64 bytesInFlight);
+    void updateStatus();
+    void onNetworkRtt(qint64 rtt);
+    void onPingResponse(qint64 response);
+    void updateHealth();
+    void exportHealth();
+    void toggleTracing();
+    void openSearch();
+    void onSearchFinished(const QString &query,
+                          const QVector<HistoryRecord> &records,
+                          qint64 elapsed);
+
+public:
+    static QString dumpTrace();
+
+protected:
+    void showEvent(QShowEvent *event) override;
 
 private:
+    typedef void (Widget::*EventHandler)(const ChatEvent &event);
+    static const EventHandler eventHandlers[ChatEvent::TypeCount];
+
+    void handleAuthorized(const ChatEvent &event);
+    void handleConnected(const ChatEvent &event);
+    void handleDisconnected(const ChatEvent &event);
+    void handleConnectionLost(const ChatEvent &event);
+    void handlePublicMessage(const ChatEvent &event);
+    void handlePrivateMessage(const ChatEvent &event);
+    void handleResynced(const ChatEvent &event);
+
     Ui::Widget *ui;
-    QWebSocket *m_webSocket;
-    QTimer *m_pingTimer;
+    QThread *m_networkThread; // общий для всех сессий
+    ConnectionWorker *m_worker;
+    bool m_workerOpened; // обработчик получен уже открывающим соединение
+    QString m_connectedUrl; // адрес установленного соединения, пусто - соединения нет
+    SpscQueue<ChatEvent> *m_events; // события из сетевого потока, очередь обработчика
+    MessageLogModel *m_messageLog;
+    RosterModel *m_roster;
+    RosterFilterModel *m_rosterFilter; // список, пока в поле поиска что-то введено
+
+    // Снимок списка пользователей из Authorized вставляется порциями
+    QVector<ChatUser> m_rosterSnapshot;
+    int m_rosterSnapshotPos; // сколько пользователей снимка уже обработано
+    QSet<int> m_rosterSnapshotRemoved; // вышедшие до того, как их вставили
+    QElapsedTimer m_rosterSnapshotTime;
+    QTimer *m_rosterTimer;
+
+    // Шквал входов и выходов сворачивается в одну строку за окно
+    PresenceAggregator m_presence;
+    QElapsedTimer m_presenceTime; // с последнего события присутствия
+    QTimer *m_presenceTimer;
+    int m_presenceWindow; // длина окна, мс; 0 - не сворачивать
+
+    QTimer *m_flushTimer; // сброс очереди входящих событий раз в кадр
+    QVector<ChatEvent> m_ingestQueue; // события, ожидающие применения
+    QStringList m_pendingLines; // строки журнала, ожидающие вставки
+    bool m_pendingHighlight; // среди них есть упоминание или личное сообщение
+    bool m_messageShown; // в журнал уже попало сообщение чата
+    int m_lastFlushSize; // сколько событий применено последним сбросом
+    int m_maxFlushSize; // максимальный размер пачки за сессию
+    int m_sendQueueDepth; // сообщений в очереди отправки
+    qint64 m_bytesInFlight; // байт отправлено, но не записано в сокет
+    qint64 m_sendHighWaterMark; // верхняя отметка очереди отправки
+
+    // Здоровье соединения: где именно теряется время
+    LatencyHistogram m_networkRtt; // ping/pong websocket, сеть и сервер
+    LatencyHistogram m_pingResponse; // Ping сервера -> наш Pong, сетевой поток
+    LatencyHistogram m_deliveryLag; // кадр из сокета -> строка в журнале, GUI
+    QTimer *m_healthTimer;
+
+    TimestampCache m_timestamps; // отметка времени строк текущей секунды
+
+    // Подсветка упоминаний: наше имя, псевдонимы и ключевые слова
+    HighlightMatcher m_highlighter;
+    QStringList m_highlightAliases;
+    QStringList m_highlightKeywords;
 
     AuthDialog::ConnectionData m_connectionData;
+    QString m_wireFormat; // запрашиваемый формат обмена: json или cbor
+    QStringList m_extraEndpoints; // запасные адреса сервера
+    int m_reconnectBaseDelay; // первая пауза перед переподключением, мс
+    int m_reconnectMaxDelay; // предельная пауза перед переподключением, мс
+
+    bool m_primary;
+
+    QThread *m_historyThread; // поток записи истории, общий для всех сессий
+    QString m_historyName;
+    QString m_historyPath; // занятый сессией каталог истории
+    HistoryStore *m_historyStore;
+    QVector<HistoryRecord> m_historyPending; // записи до ближайшего сброса
+    bool m_historyEnabled;
+    int m_historyLoadCount; // сколько сообщений истории показывать при запуске
+    qint64 m_historySegmentSize; // размер сегмента истории, байт
+    SearchDialog *m_searchDialog; // создаётся при первом поиске
+
+    quint64 m_sequence; // номер последнего применённого события сервера
 
     int m_toUserId; // кому отправляем сообщение
 